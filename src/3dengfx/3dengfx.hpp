@@ -27,8 +27,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "ggen.hpp"
 #include "light.hpp"
 #include "load_geom.hpp"
+#include "loader.hpp"
 #include "material.hpp"
+#include "matshaders.hpp"
 #include "object.hpp"
+#include "profiler.hpp"
+#include "shaders.hpp"
 #include "texman.hpp"
 #include "textures.hpp"
 
@@ -20,10 +20,12 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #include <iostream>
 #include <list>
+#include <vector>
 #include "opengl.h"
 #include "SDL.h"
 #include "3denginefx.hpp"
 #include "3dgeom.hpp"
+#include "shaders.hpp"
 #include "except.hpp"
 #include "logger.h"
 #include "config_parser.h"
@@ -40,12 +42,14 @@ void (*LoadMatrixGL)(const Matrix4x4 &mat);
 PFNGLLOADTRANSPOSEMATRIXFARBPROC glLoadTransposeMatrixf;
 PFNGLACTIVETEXTUREARBPROC glActiveTexture;
 PFNGLCLIENTACTIVETEXTUREARBPROC glClientActiveTexture;
+PFNGLCOMPRESSEDTEXIMAGE2DARBPROC glCompressedTexImage2D;
 #endif	// OPENGL_1_3
 
 //#ifndef OPENGL_1_5
 /* GL_ARB_vertex_array_object */
 PFNGLBINDBUFFERARBPROC glBindBuffer;
 PFNGLBUFFERDATAARBPROC glBufferData;
+PFNGLBUFFERSUBDATAARBPROC glBufferSubData;
 PFNGLDELETEBUFFERSARBPROC glDeleteBuffers;
 PFNGLISBUFFERARBPROC glIsBuffer;
 PFNGLMAPBUFFERARBPROC glMapBuffer;
@@ -53,6 +57,66 @@ PFNGLUNMAPBUFFERARBPROC glUnmapBuffer;
 PFNGLGENBUFFERSARBPROC glGenBuffers;
 //#endif	/* OPENGL_1_5 */
 
+/* GL_EXT_framebuffer_object */
+PFNGLGENFRAMEBUFFERSEXTPROC glGenFramebuffers;
+PFNGLDELETEFRAMEBUFFERSEXTPROC glDeleteFramebuffers;
+PFNGLBINDFRAMEBUFFEREXTPROC glBindFramebuffer;
+PFNGLFRAMEBUFFERTEXTURE2DEXTPROC glFramebufferTexture2D;
+PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC glFramebufferRenderbuffer;
+PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC glCheckFramebufferStatus;
+PFNGLGENRENDERBUFFERSEXTPROC glGenRenderbuffers;
+PFNGLDELETERENDERBUFFERSEXTPROC glDeleteRenderbuffers;
+PFNGLBINDRENDERBUFFEREXTPROC glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEEXTPROC glRenderbufferStorage;
+
+/* GL_ARB_shader_objects */
+PFNGLCREATESHADEROBJECTARBPROC glCreateShaderObject;
+PFNGLSHADERSOURCEARBPROC glShaderSource;
+PFNGLCOMPILESHADERARBPROC glCompileShader;
+PFNGLCREATEPROGRAMOBJECTARBPROC glCreateProgramObject;
+PFNGLATTACHOBJECTARBPROC glAttachObject;
+PFNGLLINKPROGRAMARBPROC glLinkProgram;
+PFNGLUSEPROGRAMOBJECTARBPROC glUseProgramObject;
+PFNGLDELETEOBJECTARBPROC glDeleteObject;
+PFNGLGETOBJECTPARAMETERIVARBPROC glGetObjectParameteriv;
+PFNGLGETINFOLOGARBPROC glGetInfoLog;
+PFNGLGETUNIFORMLOCATIONARBPROC glGetUniformLocation;
+PFNGLUNIFORM1IARBPROC glUniform1i;
+PFNGLUNIFORM1FARBPROC glUniform1f;
+PFNGLUNIFORM2FARBPROC glUniform2f;
+PFNGLUNIFORM4FVARBPROC glUniform4fv;
+PFNGLUNIFORMMATRIX4FVARBPROC glUniformMatrix4fv;
+
+/* GL_ARB_timer_query */
+PFNGLGENQUERIESARBPROC glGenQueries;
+PFNGLDELETEQUERIESARBPROC glDeleteQueries;
+PFNGLGETQUERYOBJECTIVARBPROC glGetQueryObjectiv;
+PFNGLQUERYCOUNTERPROC glQueryCounter;
+PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+
+/* GL_ARB_map_buffer_range */
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+
+/* GL_ARB_get_program_binary */
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+PFNGLPROGRAMBINARYPROC glProgramBinary;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+PFNGLGETPROGRAMIVPROC glGetProgramiv;
+
+/* GL_ARB_draw_instanced */
+PFNGLDRAWELEMENTSINSTANCEDARBPROC glDrawElementsInstanced;
+
+/* OpenGL 2.0 program objects */
+PFNGLCREATESHADERPROC glCreateShader;
+PFNGLDELETESHADERPROC glDeleteShader;
+PFNGLGETSHADERIVPROC glGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+PFNGLCREATEPROGRAMPROC glCreateProgram;
+PFNGLATTACHSHADERPROC glAttachShader;
+PFNGLDELETEPROGRAMPROC glDeleteProgram;
+PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+PFNGLUSEPROGRAMPROC glUseProgram;
+
 
 static const char *gl_error_string[] = {
 	"GL_INVALID_ENUM",		// 0x500
@@ -81,6 +145,103 @@ static int stencil_ref;
 static bool mipmapping = true;
 static bool wire = false;
 
+/* shadow copy of the GL state set through this interface, so that calls
+ * which wouldn't change anything never reach GL. -1 means unknown, the next
+ * call goes through (see InvalidateStateCache).
+ */
+#define CACHED_UNITS	8
+
+struct StateCache {
+	int blend, ztest, zwrite, lighting, culling, normalize, stencil;
+	int zfunc, front_face;
+	int color_mask;			// bit 0 red ... bit 3 alpha
+	int stencil_mask;		// low 8 bits of the stencil write mask
+	int scissor;
+	int blend_src, blend_dest;
+	int active_unit;
+	int light[8];
+	int tex_enabled[CACHED_UNITS];
+	int tex_color[CACHED_UNITS][4];		// op, arg1, arg2, arg3
+	int tex_alpha[CACHED_UNITS][4];
+	int tex_gen[CACHED_UNITS];
+};
+
+static StateCache state;
+
+/* the vertex arrays Draw() set up last, left enabled so that drawing the
+ * same mesh again needs no setup (see ResetVertexBinding)
+ */
+struct VertexBinding {
+	bool enabled, valid;
+	unsigned int vbo;		// buffer object, or 0 for client memory at data
+	unsigned long offset;	// into vbo
+	const Vertex *data;
+	unsigned int layout;	// VertexFormat of the data
+	bool color_array;		// the layout has colors, GL_COLOR_ARRAY is enabled
+	int coord_index[MAX_TEXTURES];
+};
+
+static VertexBinding vbind;
+
+// per-frame streaming vertex buffer (see AllocStream)
+#define STREAM_BUFFER_SIZE		(2 << 20)
+
+static unsigned int stream_vbo;
+static unsigned long stream_size = STREAM_BUFFER_SIZE;
+static unsigned long stream_pos, stream_demand;
+static unsigned long stream_frame = 1;
+static bool stream_fresh;				// orphaned for this frame
+static std::vector<char> stream_staging;	// without range mapping
+static unsigned long staging_pos, staging_size;
+// matrices changed since LoadXFormMatrices
+static bool proj_dirty = true, modelview_dirty = true;
+static StateStats state_stats;
+static unsigned long frame_issued, frame_elided;
+
+// offscreen default framebuffer (see SetOffscreenFramebuffer)
+static unsigned int offscreen_fbo, offscreen_color, offscreen_depth;
+
+/* what a buffer holds since its last clear, to skip redundant clears. The
+ * depth/stencil contents belong to the depth buffer, which is shared by
+ * all the render targets of the same size.
+ */
+struct ColorContents {
+	bool clear;
+	Color color;
+};
+
+struct DepthContents {
+	bool depth_clear, stencil_clear;
+	scalar_t zval;
+	unsigned char sval;
+};
+
+// render target pool (see AcquireRenderTarget)
+struct RenderTargetEntry {
+	Texture *tex;
+	unsigned int fbo;	// 0 when falling back to copying the back buffer
+	unsigned int format;
+	bool depth;
+	bool in_use;
+	bool discard;		// contents undefined, clear when bound
+	ColorContents contents;
+	int depth_buf;		// index in depth_pool, -1 if none
+};
+
+struct DepthBuffer {
+	int x, y;
+	unsigned int rbuf;
+	DepthContents contents;
+};
+
+static std::vector<RenderTargetEntry> rtarg_pool;
+static std::vector<DepthBuffer> depth_pool;
+static Texture *cur_rtarg;
+static ColorContents fb_color;
+static DepthContents fb_depth;
+
+static void DestroyRenderTargets();
+
 GraphicsInitParameters LoadGraphicsContextConfig(const char *fname) {
 #ifdef _MSC_VER
 	const char *__func__ = "LoadGraphicsContextConfig";
@@ -218,8 +379,20 @@ SysCaps GetSystemCapabilities() {
 	sys_caps.shadow_mapping = (bool)strstr(ext_str, "GL_ARB_shadow");
 	sys_caps.vertex_program = (bool)strstr(ext_str, "GL_ARB_vertex_program");
 	sys_caps.pixel_program = (bool)strstr(ext_str, "GL_ARB_fragment_program");
-	sys_caps.glslang = (bool)strstr(ext_str, "GL_ARB_shading_language_100");
+	sys_caps.glslang = strstr(ext_str, "GL_ARB_shading_language_100") &&
+		strstr(ext_str, "GL_ARB_shader_objects") && strstr(ext_str, "GL_ARB_fragment_shader");
 	sys_caps.point_sprites = (bool)strstr(ext_str, "GL_ARB_point_sprites");
+	sys_caps.fb_objects = (bool)strstr(ext_str, "GL_EXT_framebuffer_object");
+	sys_caps.packed_depth_stencil = (bool)strstr(ext_str, "GL_EXT_packed_depth_stencil");
+	sys_caps.timer_query = (bool)strstr(ext_str, "GL_ARB_timer_query");
+	sys_caps.npot_textures = (bool)strstr(ext_str, "GL_ARB_texture_non_power_of_two");
+	sys_caps.map_buffer_range = (bool)strstr(ext_str, "GL_ARB_map_buffer_range");
+	sys_caps.half_float_vertex = (bool)strstr(ext_str, "GL_ARB_half_float_vertex");
+	sys_caps.program_binary = (bool)strstr(ext_str, "GL_ARB_get_program_binary");
+	sys_caps.s3tc_textures = strstr(ext_str, "GL_ARB_texture_compression") &&
+		strstr(ext_str, "GL_EXT_texture_compression_s3tc");
+	sys_caps.tex_swizzle = strstr(ext_str, "GL_ARB_texture_swizzle") || strstr(ext_str, "GL_EXT_texture_swizzle");
+	sys_caps.draw_instanced = (bool)strstr(ext_str, "GL_ARB_draw_instanced");
 	glGetIntegerv(GL_MAX_TEXTURE_UNITS_ARB, &sys_caps.max_texture_units);
 	
 	// also log these things
@@ -238,6 +411,16 @@ SysCaps GetSystemCapabilities() {
 	EngineLog("Programmable pixel processing: " + string(sys_caps.pixel_program ? "yes\n" : "no\n"));
 	EngineLog("OpenGL 2.0 shading language: " + string(sys_caps.glslang ? "yes\n" : "no\n"));
 	EngineLog("Point sprites: " + string(sys_caps.point_sprites ? "yes\n" : "no\n"));
+	EngineLog("Framebuffer objects: " + string(sys_caps.fb_objects ? "yes\n" : "no\n"));
+	EngineLog("Packed depth/stencil: " + string(sys_caps.packed_depth_stencil ? "yes\n" : "no\n"));
+	EngineLog("GPU timer queries: " + string(sys_caps.timer_query ? "yes\n" : "no\n"));
+	EngineLog("Non power of two textures: " + string(sys_caps.npot_textures ? "yes\n" : "no\n"));
+	EngineLog("Buffer range mapping: " + string(sys_caps.map_buffer_range ? "yes\n" : "no\n"));
+	EngineLog("Half float vertex attributes: " + string(sys_caps.half_float_vertex ? "yes\n" : "no\n"));
+	EngineLog("Program binaries: " + string(sys_caps.program_binary ? "yes\n" : "no\n"));
+	EngineLog("S3TC texture compression: " + string(sys_caps.s3tc_textures ? "yes\n" : "no\n"));
+	EngineLog("Texture swizzling: " + string(sys_caps.tex_swizzle ? "yes\n" : "no\n"));
+	EngineLog("Instanced drawing: " + string(sys_caps.draw_instanced ? "yes\n" : "no\n"));
 	char tex_units_str[10];
 	sprintf(tex_units_str, "%d\n", sys_caps.max_texture_units);
 	EngineLog("Texture units: " + string(tex_units_str));
@@ -389,6 +572,9 @@ void CreateGraphicsContext(const GraphicsInitParameters &gip) {
 	glActiveTexture = (PFNGLACTIVETEXTUREARBPROC)SDL_GL_GetProcAddress("glActiveTextureARB");
 	glClientActiveTexture = (PFNGLCLIENTACTIVETEXTUREARBPROC)SDL_GL_GetProcAddress("glClientActiveTextureARB");
 	if(!glActiveTexture || !glClientActiveTexture) std::cerr << "los poulos\n";
+
+	glCompressedTexImage2D = (PFNGLCOMPRESSEDTEXIMAGE2DARBPROC)SDL_GL_GetProcAddress("glCompressedTexImage2DARB");
+	if(!glCompressedTexImage2D) sys_caps.s3tc_textures = false;
 #else
 	LoadMatrixGL = LoadMatrix_TransposeARB;
 #endif	// OPENGL_1_3
@@ -397,6 +583,7 @@ void CreateGraphicsContext(const GraphicsInitParameters &gip) {
 	if(sys_caps.vertex_buffers) {
 		glBindBuffer = (PFNGLBINDBUFFERARBPROC)SDL_GL_GetProcAddress("glBindBufferARB");
 		glBufferData = (PFNGLBUFFERDATAARBPROC)SDL_GL_GetProcAddress("glBufferDataARB");
+		glBufferSubData = (PFNGLBUFFERSUBDATAARBPROC)SDL_GL_GetProcAddress("glBufferSubDataARB");
 		glDeleteBuffers = (PFNGLDELETEBUFFERSARBPROC)SDL_GL_GetProcAddress("glDeleteBuffersARB");
 		glIsBuffer = (PFNGLISBUFFERARBPROC)SDL_GL_GetProcAddress("glIsBufferARB");
 		glMapBuffer = (PFNGLMAPBUFFERARBPROC)SDL_GL_GetProcAddress("glMapBufferARB");
@@ -404,11 +591,118 @@ void CreateGraphicsContext(const GraphicsInitParameters &gip) {
 		glGenBuffers = (PFNGLGENBUFFERSARBPROC)SDL_GL_GetProcAddress("glGenBuffersARB");
 	}
 //#endif	// OPENGL_1_5
+
+	if(sys_caps.fb_objects) {
+		glGenFramebuffers = (PFNGLGENFRAMEBUFFERSEXTPROC)SDL_GL_GetProcAddress("glGenFramebuffersEXT");
+		glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSEXTPROC)SDL_GL_GetProcAddress("glDeleteFramebuffersEXT");
+		glBindFramebuffer = (PFNGLBINDFRAMEBUFFEREXTPROC)SDL_GL_GetProcAddress("glBindFramebufferEXT");
+		glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DEXTPROC)SDL_GL_GetProcAddress("glFramebufferTexture2DEXT");
+		glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC)SDL_GL_GetProcAddress("glFramebufferRenderbufferEXT");
+		glCheckFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC)SDL_GL_GetProcAddress("glCheckFramebufferStatusEXT");
+		glGenRenderbuffers = (PFNGLGENRENDERBUFFERSEXTPROC)SDL_GL_GetProcAddress("glGenRenderbuffersEXT");
+		glDeleteRenderbuffers = (PFNGLDELETERENDERBUFFERSEXTPROC)SDL_GL_GetProcAddress("glDeleteRenderbuffersEXT");
+		glBindRenderbuffer = (PFNGLBINDRENDERBUFFEREXTPROC)SDL_GL_GetProcAddress("glBindRenderbufferEXT");
+		glRenderbufferStorage = (PFNGLRENDERBUFFERSTORAGEEXTPROC)SDL_GL_GetProcAddress("glRenderbufferStorageEXT");
+	}
+
+	/* program binaries only work with OpenGL 2.0 program objects, so with
+	 * them the programs are created through the core entry points, and the
+	 * ones shared with GL_ARB_shader_objects come from their core names.
+	 */
+	if(sys_caps.program_binary && sys_caps.glslang) {
+		glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glGetProgramBinary");
+		glProgramBinary = (PFNGLPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glProgramBinary");
+		glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)SDL_GL_GetProcAddress("glProgramParameteri");
+		glGetProgramiv = (PFNGLGETPROGRAMIVPROC)SDL_GL_GetProcAddress("glGetProgramiv");
+		glCreateShader = (PFNGLCREATESHADERPROC)SDL_GL_GetProcAddress("glCreateShader");
+		glDeleteShader = (PFNGLDELETESHADERPROC)SDL_GL_GetProcAddress("glDeleteShader");
+		glGetShaderiv = (PFNGLGETSHADERIVPROC)SDL_GL_GetProcAddress("glGetShaderiv");
+		glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)SDL_GL_GetProcAddress("glGetShaderInfoLog");
+		glCreateProgram = (PFNGLCREATEPROGRAMPROC)SDL_GL_GetProcAddress("glCreateProgram");
+		glAttachShader = (PFNGLATTACHSHADERPROC)SDL_GL_GetProcAddress("glAttachShader");
+		glDeleteProgram = (PFNGLDELETEPROGRAMPROC)SDL_GL_GetProcAddress("glDeleteProgram");
+		glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)SDL_GL_GetProcAddress("glGetProgramInfoLog");
+		glUseProgram = (PFNGLUSEPROGRAMPROC)SDL_GL_GetProcAddress("glUseProgram");
+		if(!glGetProgramBinary || !glProgramBinary || !glProgramParameteri || !glGetProgramiv ||
+				!glCreateShader || !glDeleteShader || !glGetShaderiv || !glGetShaderInfoLog ||
+				!glCreateProgram || !glAttachShader || !glDeleteProgram || !glGetProgramInfoLog ||
+				!glUseProgram) {
+			sys_caps.program_binary = false;
+		}
+	} else {
+		sys_caps.program_binary = false;
+	}
+
+	if(sys_caps.glslang) {
+		bool core = sys_caps.program_binary;
+		glCreateShaderObject = (PFNGLCREATESHADEROBJECTARBPROC)SDL_GL_GetProcAddress("glCreateShaderObjectARB");
+		glShaderSource = (PFNGLSHADERSOURCEARBPROC)SDL_GL_GetProcAddress(core ? "glShaderSource" : "glShaderSourceARB");
+		glCompileShader = (PFNGLCOMPILESHADERARBPROC)SDL_GL_GetProcAddress(core ? "glCompileShader" : "glCompileShaderARB");
+		glCreateProgramObject = (PFNGLCREATEPROGRAMOBJECTARBPROC)SDL_GL_GetProcAddress("glCreateProgramObjectARB");
+		glAttachObject = (PFNGLATTACHOBJECTARBPROC)SDL_GL_GetProcAddress("glAttachObjectARB");
+		glLinkProgram = (PFNGLLINKPROGRAMARBPROC)SDL_GL_GetProcAddress(core ? "glLinkProgram" : "glLinkProgramARB");
+		glUseProgramObject = (PFNGLUSEPROGRAMOBJECTARBPROC)SDL_GL_GetProcAddress("glUseProgramObjectARB");
+		glDeleteObject = (PFNGLDELETEOBJECTARBPROC)SDL_GL_GetProcAddress("glDeleteObjectARB");
+		glGetObjectParameteriv = (PFNGLGETOBJECTPARAMETERIVARBPROC)SDL_GL_GetProcAddress("glGetObjectParameterivARB");
+		glGetInfoLog = (PFNGLGETINFOLOGARBPROC)SDL_GL_GetProcAddress("glGetInfoLogARB");
+		glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONARBPROC)SDL_GL_GetProcAddress(core ? "glGetUniformLocation" : "glGetUniformLocationARB");
+		glUniform1i = (PFNGLUNIFORM1IARBPROC)SDL_GL_GetProcAddress(core ? "glUniform1i" : "glUniform1iARB");
+		glUniform1f = (PFNGLUNIFORM1FARBPROC)SDL_GL_GetProcAddress(core ? "glUniform1f" : "glUniform1fARB");
+		glUniform2f = (PFNGLUNIFORM2FARBPROC)SDL_GL_GetProcAddress(core ? "glUniform2f" : "glUniform2fARB");
+		glUniform4fv = (PFNGLUNIFORM4FVARBPROC)SDL_GL_GetProcAddress(core ? "glUniform4fv" : "glUniform4fvARB");
+		glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVARBPROC)SDL_GL_GetProcAddress(core ? "glUniformMatrix4fv" : "glUniformMatrix4fvARB");
+		if(!glShaderSource || !glCompileShader || !glLinkProgram || !glGetUniformLocation) {
+			sys_caps.glslang = sys_caps.program_binary = false;
+		}
+		if(!core && (!glCreateShaderObject || !glUseProgramObject)) {
+			sys_caps.glslang = false;
+		}
+	}
+
+	// instanced draws are only used by the material programs
+	if(sys_caps.draw_instanced) {
+		glDrawElementsInstanced = (PFNGLDRAWELEMENTSINSTANCEDARBPROC)SDL_GL_GetProcAddress("glDrawElementsInstancedARB");
+		if(!glDrawElementsInstanced || !glUniformMatrix4fv || !sys_caps.glslang) {
+			sys_caps.draw_instanced = false;
+		}
+	}
+
+	if(sys_caps.timer_query) {
+		glGenQueries = (PFNGLGENQUERIESARBPROC)SDL_GL_GetProcAddress("glGenQueriesARB");
+		glDeleteQueries = (PFNGLDELETEQUERIESARBPROC)SDL_GL_GetProcAddress("glDeleteQueriesARB");
+		glGetQueryObjectiv = (PFNGLGETQUERYOBJECTIVARBPROC)SDL_GL_GetProcAddress("glGetQueryObjectivARB");
+		glQueryCounter = (PFNGLQUERYCOUNTERPROC)SDL_GL_GetProcAddress("glQueryCounter");
+		glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+		if(!glGenQueries || !glQueryCounter || !glGetQueryObjectui64v) {
+			sys_caps.timer_query = false;
+		}
+	}
+
+	if(sys_caps.map_buffer_range) {
+		glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)SDL_GL_GetProcAddress("glMapBufferRange");
+		if(!glMapBufferRange || !sys_caps.vertex_buffers) {
+			sys_caps.map_buffer_range = false;
+		}
+	}
+
 	
+	InvalidateStateCache();
 	SetDefaultStates();	
 }
 
 void DestroyGraphicsContext() {
+	DestroyRenderTargets();
+	if(stream_vbo) {
+		DeleteBufferObject(stream_vbo);
+		stream_vbo = 0;
+	}
+	if(offscreen_fbo) {
+		glBindFramebuffer(GL_FRAMEBUFFER_EXT, 0);
+		glDeleteFramebuffers(1, &offscreen_fbo);
+		glDeleteRenderbuffers(1, &offscreen_color);
+		glDeleteRenderbuffers(1, &offscreen_depth);
+		offscreen_fbo = 0;
+	}
 	if(gparams.fullscreen) SDL_ShowCursor(1);
 	SDL_Quit();
 }
@@ -420,6 +714,10 @@ void SetDefaultStates() {
 	SetZBuffering(true);
 	SetLighting(true);
 	SetAutoNormalize(false);
+	SetColorWrite(true, true, true, true);
+	SetZWrite(true);
+	SetStencilWriteMask(0xff);
+	SetScissoring(false);
 	
 	glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
 	glLightModeli(GL_LIGHT_MODEL_COLOR_CONTROL, GL_SEPARATE_SPECULAR_COLOR);
@@ -435,142 +733,369 @@ const GraphicsInitParameters *GetGraphicsInitParameters() {
 	return &gparams;
 }
 
+static ColorContents *CurrentColorContents();
+static DepthContents *CurrentDepthContents();
+
+/* a clear only sets the whole buffer with the write masks and the scissor
+ * test at their defaults, anything else leaves the contents unknown. This
+ * goes by the state cache, unknown state (-1) doesn't count as default.
+ */
+static bool FullClear(unsigned int buffers) {
+	if(state.scissor == 1) return false;
+
+	if((buffers & GL_COLOR_BUFFER_BIT) && state.color_mask != 0xf) return false;
+	if((buffers & GL_DEPTH_BUFFER_BIT) && state.zwrite != 1) return false;
+	if((buffers & GL_STENCIL_BUFFER_BIT) && state.stencil_mask != 0xff) return false;
+	return true;
+}
+
 void Clear(const Color &color) {
+	ColorContents *cc = CurrentColorContents();
+	if(cc) {
+		bool full = FullClear(GL_COLOR_BUFFER_BIT);
+		if(full && cc->clear && cc->color.r == color.r && cc->color.g == color.g &&
+				cc->color.b == color.b && cc->color.a == color.a) {
+			return;
+		}
+		cc->clear = full;
+		cc->color = color;
+	}
+
 	glClearColor(color.r, color.g, color.b, color.a);
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void ClearZBuffer(scalar_t zval) {
+	DepthContents *dc = CurrentDepthContents();
+	if(dc) {
+		bool full = FullClear(GL_DEPTH_BUFFER_BIT);
+		if(full && dc->depth_clear && dc->zval == zval) return;
+		dc->depth_clear = full;
+		dc->zval = zval;
+	}
+
 	glClearDepth(zval);
 	glClear(GL_DEPTH_BUFFER_BIT);
 }
 
 void ClearStencil(unsigned char sval) {
+	DepthContents *dc = CurrentDepthContents();
+	if(dc) {
+		bool full = FullClear(GL_STENCIL_BUFFER_BIT);
+		if(full && dc->stencil_clear && dc->sval == sval) return;
+		dc->stencil_clear = full;
+		dc->sval = sval;
+	}
+
 	glClearStencil(sval);
 	glClear(GL_STENCIL_BUFFER_BIT);
 }
 
 void ClearZBufferStencil(scalar_t zval, unsigned char sval) {
+	DepthContents *dc = CurrentDepthContents();
+	if(dc && dc->depth_clear && dc->zval == zval && FullClear(GL_DEPTH_BUFFER_BIT)) {
+		ClearStencil(sval);
+		return;
+	}
+	if(dc && dc->stencil_clear && dc->sval == sval && FullClear(GL_STENCIL_BUFFER_BIT)) {
+		ClearZBuffer(zval);
+		return;
+	}
+	if(dc) {
+		dc->depth_clear = FullClear(GL_DEPTH_BUFFER_BIT);
+		dc->stencil_clear = FullClear(GL_STENCIL_BUFFER_BIT);
+		dc->zval = zval;
+		dc->sval = sval;
+	}
+
 	glClearDepth(zval);
 	glClearStencil(sval);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 }
 
+void MarkTargetDirty() {
+	ColorContents *cc = CurrentColorContents();
+	if(cc) cc->clear = false;
+
+	// this also covers every other target sharing the depth buffer
+	DepthContents *dc = CurrentDepthContents();
+	if(dc) dc->depth_clear = dc->stencil_clear = false;
+}
+
 void Flip() {
-	SDL_GL_SwapBuffers();
+	state_stats.issued = frame_issued;
+	state_stats.elided = frame_elided;
+	state_stats.total_issued += frame_issued;
+	state_stats.total_elided += frame_elided;
+	state_stats.frames++;
+	frame_issued = frame_elided = 0;
+
+	// next frame's streamed geometry goes to fresh storage, sized for this one
+	if(stream_demand > stream_size) {
+		stream_size = (stream_demand + STREAM_BUFFER_SIZE - 1) & ~(STREAM_BUFFER_SIZE - 1);
+	}
+	stream_demand = 0;
+	stream_fresh = false;
+	stream_frame++;
+
+	fb_color.clear = false;
+	fb_depth.depth_clear = fb_depth.stencil_clear = false;
+	if(offscreen_fbo) {
+		glFlush();	// nothing to show
+	} else {
+		SDL_GL_SwapBuffers();
+	}
+}
+
+bool SetOffscreenFramebuffer(int x, int y) {
+	if(!sys_caps.fb_objects) {
+		EngineLog("Offscreen rendering requires GL_EXT_framebuffer_object\n");
+		return false;
+	}
+
+	glGenFramebuffers(1, &offscreen_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER_EXT, offscreen_fbo);
+
+	glGenRenderbuffers(1, &offscreen_color);
+	glBindRenderbuffer(GL_RENDERBUFFER_EXT, offscreen_color);
+	glRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_RGBA8, x, y);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, offscreen_color);
+
+	glGenRenderbuffers(1, &offscreen_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER_EXT, offscreen_depth);
+	if(sys_caps.packed_depth_stencil) {
+		glRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_DEPTH24_STENCIL8_EXT, x, y);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, offscreen_depth);
+	} else {
+		glRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, x, y);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, offscreen_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER_EXT, 0);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		EngineLog("Incomplete offscreen framebuffer\n");
+		glBindFramebuffer(GL_FRAMEBUFFER_EXT, 0);
+		glDeleteFramebuffers(1, &offscreen_fbo);
+		glDeleteRenderbuffers(1, &offscreen_color);
+		glDeleteRenderbuffers(1, &offscreen_depth);
+		offscreen_fbo = 0;
+		return false;
+	}
+
+	char size_str[64];
+	sprintf(size_str, "%dx%d", x, y);
+	EngineLog("Rendering to offscreen framebuffer " + string(size_str) + "\n");
+
+	gparams.x = x;
+	gparams.y = y;
+	SetViewport(0, 0, x, y);
+	return true;
+}
+
+void ReadFramebuffer(void *pixels) {
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, gparams.x, gparams.y, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
 }
 
 void LoadXFormMatrices() {
-	glMatrixMode(GL_PROJECTION);
-	LoadMatrixGL(proj_matrix);
-	
-	Matrix4x4 modelview = view_matrix * world_matrix;
-	glMatrixMode(GL_MODELVIEW);
-	LoadMatrixGL(modelview);
+	if(proj_dirty) {
+		glMatrixMode(GL_PROJECTION);
+		LoadMatrixGL(proj_matrix);
+		proj_dirty = false;
+	}
+
+	if(modelview_dirty) {
+		Matrix4x4 modelview = view_matrix * world_matrix;
+		glMatrixMode(GL_MODELVIEW);
+		LoadMatrixGL(modelview);
+		modelview_dirty = false;
+	}
 }
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
-void Draw(const VertexArray &varray) {
-	LoadXFormMatrices();
+/* points the vertex arrays at varray, unless they already point there.
+ * The buffer object stays attached to the pointers after unbinding it.
+ */
+static void BindVertexArray(const VertexArray &varray) {
+	unsigned int vbo = 0;
+	unsigned long offset = 0;
+	unsigned int layout = VLAYOUT_RAW;
+	const Vertex *data = varray.GetData();
+	if(!varray.GetDynamic() && sys_caps.vertex_buffers) {
+		// 0 for streamed arrays that didn't fit in the stream buffer
+		if((vbo = varray.GetBufferObject())) {
+			offset = varray.GetBufferOffset();
+			layout = varray.GetLayout();
+			data = 0;
+		}
+	}
 
-	bool use_vbo = !varray.GetDynamic() && sys_caps.vertex_buffers;
-	
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_COLOR_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
-	
-	if(use_vbo) {
-		Vertex v;
-		glBindBuffer(GL_ARRAY_BUFFER_ARB, varray.GetBufferObject());
-		glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.pos - (char*)&v));
-		glNormalPointer(GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.normal - (char*)&v));
-		glColorPointer(4, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.color - (char*)&v));
+	if(vbind.valid && vbind.vbo == vbo && vbind.offset == offset && vbind.data == data &&
+			vbind.layout == layout && !memcmp(vbind.coord_index, coord_index, sizeof coord_index)) {
+		if(!vbind.color_array) glColor4f(1.0, 1.0, 1.0, 1.0);
+		return;
+	}
 
+	if(!vbind.enabled) {
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
 		for(int i=0; i<MAX_TEXTURES; i++) {
 			glClientActiveTexture(GL_TEXTURE0 + i);
 			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.tex[coord_index[i]] - (char*)&v));
 		}
-	} else {
-		glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &varray.GetData()->pos);
-		glNormalPointer(GL_FLOAT, sizeof(Vertex), &varray.GetData()->normal);
-		glColorPointer(4, GL_FLOAT, sizeof(Vertex), &varray.GetData()->color);
+		vbind.color_array = false;
+		vbind.enabled = true;
+	}
 
-		for(int i=0; i<MAX_TEXTURES; i++) {
-			glClientActiveTexture(GL_TEXTURE0 + i);
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &varray.GetData()->tex[coord_index[i]]);
+	VertexFormat fmt = GetVertexFormat(layout);
+	const char *base = (const char*)data;
+	if(vbo) {
+		glBindBuffer(GL_ARRAY_BUFFER_ARB, vbo);
+		base = BUFFER_OFFSET(offset);
+	}
+	glVertexPointer(3, GL_FLOAT, fmt.size, base);
+	glNormalPointer(fmt.normal_type, fmt.size, base + fmt.normal_offs);
+
+	// vertices without colors are opaque white
+	bool color_array = fmt.color_offs != -1;
+	if(color_array) {
+		glColorPointer(4, fmt.color_type, fmt.size, base + fmt.color_offs);
+	}
+	if(color_array != vbind.color_array) {
+		if(color_array) {
+			glEnableClientState(GL_COLOR_ARRAY);
+		} else {
+			glDisableClientState(GL_COLOR_ARRAY);
 		}
+		vbind.color_array = color_array;
 	}
-	
-	glDrawArrays(primitive_type, 0, varray.GetCount());
-	
-	if(use_vbo) glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-	
-	glDisableClientState(GL_VERTEX_ARRAY);
-	glDisableClientState(GL_COLOR_ARRAY);
-	glDisableClientState(GL_NORMAL_ARRAY);
-	
+	if(!color_array) glColor4f(1.0, 1.0, 1.0, 1.0);
+
 	for(int i=0; i<MAX_TEXTURES; i++) {
 		glClientActiveTexture(GL_TEXTURE0 + i);
-		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, fmt.tex_type, fmt.size, base + fmt.tex_offs[coord_index[i]]);
 	}
+	if(vbo) glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+
+	vbind.vbo = vbo;
+	vbind.offset = offset;
+	vbind.data = data;
+	vbind.layout = layout;
+	memcpy(vbind.coord_index, coord_index, sizeof coord_index);
+	vbind.valid = true;
 }
 
-void Draw(const VertexArray &varray, const IndexArray &iarray) {
-	static int dbg;
-	dbg++;
-	LoadXFormMatrices();
-
-	bool use_vbo = !varray.GetDynamic() && sys_caps.vertex_buffers;
-	bool use_ibo = false;//!iarray.GetDynamic() && sys_caps.vertex_buffers;
-	
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_COLOR_ARRAY);
-	glEnableClientState(GL_NORMAL_ARRAY);
-	
-	if(use_vbo) {
-		Vertex v;
-		glBindBuffer(GL_ARRAY_BUFFER_ARB, varray.GetBufferObject());
-		glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.pos - (char*)&v));
-		glNormalPointer(GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.normal - (char*)&v));
-		glColorPointer(4, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.color - (char*)&v));
-
+void ResetVertexBinding() {
+	if(vbind.enabled) {
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		if(vbind.color_array) glDisableClientState(GL_COLOR_ARRAY);
 		for(int i=0; i<MAX_TEXTURES; i++) {
 			glClientActiveTexture(GL_TEXTURE0 + i);
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), (void*)((char*)&v.tex[coord_index[i]] - (char*)&v));
+			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 		}
-	} else {
-		glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &varray.GetData()->pos);
-		glNormalPointer(GL_FLOAT, sizeof(Vertex), &varray.GetData()->normal);
-		glColorPointer(4, GL_FLOAT, sizeof(Vertex), &varray.GetData()->color);
+		vbind.color_array = false;
+		vbind.enabled = false;
+	}
+	vbind.valid = false;
+}
 
-		for(int i=0; i<MAX_TEXTURES; i++) {
-			glClientActiveTexture(GL_TEXTURE0 + i);
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &varray.GetData()->tex[coord_index[i]]);
-		}
+void DeleteBufferObject(unsigned int buffer) {
+	// deleting the buffer detaches it from the vertex arrays
+	if(vbind.vbo == buffer) vbind.valid = false;
+	glDeleteBuffers(1, &buffer);
+}
+
+void *AllocStream(unsigned long size, unsigned long *offset) {
+	if(!sys_caps.vertex_buffers) return 0;
+
+	size = (size + 63) & ~63UL;
+	stream_demand += size;
+
+	if(!stream_vbo) glGenBuffers(1, &stream_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER_ARB, stream_vbo);
+
+	/* orphan the storage of the last frame instead of waiting for the draws
+	 * still using it, the driver hands us a new block.
+	 */
+	if(!stream_fresh) {
+		glBufferData(GL_ARRAY_BUFFER_ARB, stream_size, 0, GL_STREAM_DRAW_ARB);
+		stream_pos = 0;
+		stream_fresh = true;
+	}
+
+	if(stream_pos + size > stream_size) {
+		glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+		return 0;	// the buffer grows for the next frame
+	}
+	*offset = stream_pos;
+	stream_pos += size;
+
+	// nothing written this frame is ever overwritten, no need to synchronize
+	if(sys_caps.map_buffer_range) {
+		return glMapBufferRange(GL_ARRAY_BUFFER_ARB, *offset, size, GL_MAP_WRITE_BIT |
+				GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
 	}
 
-	if(use_ibo) {
+	if(stream_staging.size() < size) stream_staging.resize(size);
+	staging_pos = *offset;
+	staging_size = size;
+	return &stream_staging[0];
+}
+
+void UnmapStream() {
+	if(sys_caps.map_buffer_range) {
+		glUnmapBuffer(GL_ARRAY_BUFFER_ARB);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER_ARB, staging_pos, staging_size, &stream_staging[0]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+unsigned int GetStreamBuffer() {
+	return stream_vbo;
+}
+
+unsigned long GetStreamFrame() {
+	return stream_frame;
+}
+
+void Draw(const VertexArray &varray) {
+	LoadXFormMatrices();
+	MarkTargetDirty();
+	BindVertexArray(varray);
+
+	glDrawArrays(primitive_type, 0, varray.GetCount());
+}
+
+void Draw(const VertexArray &varray, const IndexArray &iarray) {
+	LoadXFormMatrices();
+	MarkTargetDirty();
+	BindVertexArray(varray);
+
+	if(!iarray.GetDynamic() && sys_caps.vertex_buffers) {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, iarray.GetBufferObject());
-		glDrawElements(primitive_type, iarray.GetCount(), GL_UNSIGNED_SHORT, 0);
+		glDrawElements(primitive_type, iarray.GetCount(), iarray.GetIndexType(), BUFFER_OFFSET(0));
 	} else {
-		glDrawElements(primitive_type, iarray.GetCount(), GL_UNSIGNED_SHORT, iarray.GetData());
+		if(sys_caps.vertex_buffers) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		glDrawElements(primitive_type, iarray.GetCount(), iarray.GetIndexType(), iarray.GetDrawData());
 	}
-	
-	if(use_ibo) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
-	if(use_vbo) glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-	
-	glDisableClientState(GL_VERTEX_ARRAY);
-	glDisableClientState(GL_COLOR_ARRAY);
-	glDisableClientState(GL_NORMAL_ARRAY);
-	
-	for(int i=0; i<MAX_TEXTURES; i++) {
-		glClientActiveTexture(GL_TEXTURE0 + i);
-		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+void DrawInstanced(const VertexArray &varray, const IndexArray &iarray, int count) {
+	if(count <= 0) return;
+
+	LoadXFormMatrices();
+	MarkTargetDirty();
+	BindVertexArray(varray);
+
+	if(!iarray.GetDynamic() && sys_caps.vertex_buffers) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, iarray.GetBufferObject());
+		glDrawElementsInstanced(primitive_type, iarray.GetCount(), iarray.GetIndexType(), BUFFER_OFFSET(0), count);
+	} else {
+		if(sys_caps.vertex_buffers) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		glDrawElementsInstanced(primitive_type, iarray.GetCount(), iarray.GetIndexType(), iarray.GetDrawData(), count);
 	}
 }
 
@@ -580,32 +1105,91 @@ int GetTextureUnitCount() {
 
 //////////////////// render states /////////////////////
 
+void InvalidateStateCache() {
+	memset(&state, 0xff, sizeof state);	// all -1
+	vbind.valid = false;
+	proj_dirty = modelview_dirty = true;
+	InvalidateProgramCache();
+}
+
+const StateStats *GetStateStats() {
+	return &state_stats;
+}
+
+// returns true if the new value has to be passed on to GL
+static inline bool StateChange(int *cached, int val) {
+	if(*cached == val) {
+		frame_elided++;
+		return false;
+	}
+	*cached = val;
+	frame_issued++;
+	return true;
+}
+
+static void SetCap(int *cached, unsigned int cap, bool enable) {
+	if(StateChange(cached, enable)) {
+		if(enable) {
+			glEnable(cap);
+		} else {
+			glDisable(cap);
+		}
+	}
+}
+
+// leaves tex_unit active, callers rely on that for the state they set directly
+static void SelectTextureUnit(int tex_unit) {
+	if(StateChange(&state.active_unit, tex_unit)) {
+		glActiveTexture(GL_TEXTURE0 + tex_unit);
+	}
+}
+
+// the combiner of a unit, arg3 == TARG_NONE leaves the third source alone
+static bool CombinerChange(int *cached, int op, int arg1, int arg2, int arg3) {
+	if(cached[0] == op && cached[1] == arg1 && cached[2] == arg2 &&
+			(arg3 == TARG_NONE || cached[3] == arg3)) {
+		frame_elided++;
+		return false;
+	}
+	cached[0] = op;
+	cached[1] = arg1;
+	cached[2] = arg2;
+	if(arg3 != TARG_NONE) cached[3] = arg3;
+	frame_issued++;
+	return true;
+}
+
 void SetPrimitiveType(PrimitiveType pt) {
 	primitive_type = pt;
 }
 
 void SetBackfaceCulling(bool enable) {
-	if(enable) {
-		glEnable(GL_CULL_FACE);
-	} else {
-		glDisable(GL_CULL_FACE);
-	}
+	SetCap(&state.culling, GL_CULL_FACE, enable);
 }
 
 void SetFrontFace(FaceOrder order) {
-	glFrontFace(order);
+	if(StateChange(&state.front_face, order)) {
+		glFrontFace(order);
+	}
 }
 
 void SetAutoNormalize(bool enable) {
-	if(enable) {
-		glEnable(GL_NORMALIZE);
-	} else {
-		glDisable(GL_NORMALIZE);
-	}
+	SetCap(&state.normalize, GL_NORMALIZE, enable);
 }
 
 void SetColorWrite(bool red, bool green, bool blue, bool alpha) {
-	glColorMask(red, green, blue, alpha);
+	int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if(StateChange(&state.color_mask, mask)) {
+		glColorMask(red, green, blue, alpha);
+	}
+}
+
+void SetScissoring(bool enable) {
+	SetCap(&state.scissor, GL_SCISSOR_TEST, enable);
+}
+
+void SetScissorRect(unsigned int x, unsigned int y, unsigned int xsize, unsigned int ysize) {
+	glScissor(x, y, xsize, ysize);
 }
 
 void SetWireframe(bool enable) {
@@ -616,42 +1200,41 @@ void SetWireframe(bool enable) {
 ///////////////// blending states ///////////////
 
 void SetAlphaBlending(bool enable) {
-	if(enable) {
-		glEnable(GL_BLEND);
-	} else {
-		glDisable(GL_BLEND);
-	}
+	SetCap(&state.blend, GL_BLEND, enable);
 }
 
 void SetBlendFunc(BlendingFactor src, BlendingFactor dest) {
+	if(state.blend_src == src && state.blend_dest == dest) {
+		frame_elided++;
+		return;
+	}
+	state.blend_src = src;
+	state.blend_dest = dest;
+	frame_issued++;
 	glBlendFunc(src, dest);
 }
 
 ///////////////// zbuffer states ////////////////
 
 void SetZBuffering(bool enable) {
-	if(enable) {
-		glEnable(GL_DEPTH_TEST);
-	} else {
-		glDisable(GL_DEPTH_TEST);
-	}
+	SetCap(&state.ztest, GL_DEPTH_TEST, enable);
 }
 
 void SetZWrite(bool enable) {
-	glDepthMask(enable);
+	if(StateChange(&state.zwrite, enable)) {
+		glDepthMask(enable);
+	}
 }
 
 void SetZFunc(CmpFunc func) {
-	glDepthFunc(func);
+	if(StateChange(&state.zfunc, func)) {
+		glDepthFunc(func);
+	}
 }
 
 /////////////// stencil states //////////////////
 void SetStencilBuffering(bool enable) {
-	if(enable) {
-		glEnable(GL_STENCIL_TEST);
-	} else {
-		glDisable(GL_STENCIL_TEST);
-	}
+	SetCap(&state.stencil, GL_STENCIL_TEST, enable);
 }
 
 void SetStencilPassOp(StencilOp sop) {
@@ -684,6 +1267,12 @@ void SetStencilReference(unsigned int ref) {
 	stencil_ref = ref;
 }
 
+void SetStencilWriteMask(unsigned int mask) {
+	if(StateChange(&state.stencil_mask, mask & 0xff)) {
+		glStencilMask(mask);
+	}
+}
+
 ///////////// texture & material states //////////////
 void SetTextureFiltering(int tex_unit, TextureFilteringType tex_filter) {
 	
@@ -722,28 +1311,181 @@ void SetTextureBorderColor(int tex_unit, const Color &color) {
 }
 
 void SetTexture(int tex_unit, Texture *tex) {
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
+	SelectTextureUnit(tex_unit);
 	glBindTexture(GL_TEXTURE_2D, tex->tex_id);
 }
 
 void SetMipMapping(bool enable) {
-	mipmapping = true;
+	mipmapping = enable;
+}
+
+bool GetMipMapping() {
+	return mipmapping;
 }
 
 void SetMaterial(const Material &mat) {
 	mat.SetGLMaterial();
 }
 
+static RenderTargetEntry *FindRenderTarget(Texture *tex) {
+	if(!tex) return 0;
+	for(size_t i=0; i<rtarg_pool.size(); i++) {
+		if(rtarg_pool[i].tex == tex) return &rtarg_pool[i];
+	}
+	return 0;
+}
+
+// the framebuffer object of the current render target, or the default one
+static unsigned int CurrentFramebuffer() {
+	RenderTargetEntry *rt = FindRenderTarget(cur_rtarg);
+	return rt && rt->fbo ? rt->fbo : offscreen_fbo;
+}
+
+/* contents of the buffer we're drawing to. Not tracked without framebuffer
+ * objects, the render targets are just the back buffer at different times.
+ */
+static ColorContents *CurrentColorContents() {
+	if(!sys_caps.fb_objects) return 0;
+	if(!cur_rtarg) return &fb_color;
+
+	RenderTargetEntry *rt = FindRenderTarget(cur_rtarg);
+	return rt && rt->fbo ? &rt->contents : 0;
+}
+
+static DepthContents *CurrentDepthContents() {
+	if(!sys_caps.fb_objects) return 0;
+	if(!cur_rtarg) return &fb_depth;
+
+	RenderTargetEntry *rt = FindRenderTarget(cur_rtarg);
+	return rt && rt->fbo && rt->depth_buf != -1 ? &depth_pool[rt->depth_buf].contents : 0;
+}
+
+// returns the index in depth_pool of the depth buffer for that size
+static int GetDepthBuffer(int x, int y) {
+	for(size_t i=0; i<depth_pool.size(); i++) {
+		if(depth_pool[i].x == x && depth_pool[i].y == y) {
+			return (int)i;
+		}
+	}
+
+	DepthBuffer db;
+	db.x = x;
+	db.y = y;
+	db.contents.depth_clear = db.contents.stencil_clear = false;
+	glGenRenderbuffers(1, &db.rbuf);
+	glBindRenderbuffer(GL_RENDERBUFFER_EXT, db.rbuf);
+	if(sys_caps.packed_depth_stencil) {
+		glRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_DEPTH24_STENCIL8_EXT, x, y);
+	} else {
+		glRenderbufferStorage(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, x, y);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER_EXT, 0);
+
+	depth_pool.push_back(db);
+	return (int)depth_pool.size() - 1;
+}
+
+static bool CreateTargetFramebuffer(RenderTargetEntry *rt) {
+	glGenFramebuffers(1, &rt->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER_EXT, rt->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, rt->tex->tex_id, 0);
+
+	if(rt->depth) {
+		rt->depth_buf = GetDepthBuffer(rt->tex->width, rt->tex->height);
+		unsigned int rbuf = depth_pool[rt->depth_buf].rbuf;
+		if(sys_caps.packed_depth_stencil) {
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rbuf);
+		}
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rbuf);
+	}
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+	glBindFramebuffer(GL_FRAMEBUFFER_EXT, CurrentFramebuffer());
+
+	if(!complete) {
+		EngineLog("Incomplete render target framebuffer, copying from the back buffer instead\n");
+		glDeleteFramebuffers(1, &rt->fbo);
+		rt->fbo = 0;
+		rt->depth_buf = -1;
+	}
+	return complete;
+}
+
+Texture *AcquireRenderTarget(int x, int y, unsigned int format, bool depth) {
+	for(size_t i=0; i<rtarg_pool.size(); i++) {
+		RenderTargetEntry *rt = &rtarg_pool[i];
+		if(!rt->in_use && (int)rt->tex->width == x && (int)rt->tex->height == y &&
+				rt->format == format && rt->depth == depth) {
+			rt->in_use = true;
+			rt->discard = true;
+			return rt->tex;
+		}
+	}
+
+	RenderTargetEntry rt;
+	rt.tex = new Texture;
+	rt.tex->AddFrame();
+	rt.tex->width = x;
+	rt.tex->height = y;
+	rt.tex->pitch = x * sizeof(Pixel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	rt.fbo = 0;
+	rt.format = format;
+	rt.depth = depth;
+	rt.in_use = true;
+	rt.discard = true;
+	rt.contents.clear = false;
+	rt.depth_buf = -1;
+	if(sys_caps.fb_objects) {
+		CreateTargetFramebuffer(&rt);
+	}
+
+	rtarg_pool.push_back(rt);
+	return rt.tex;
+}
+
+void ReleaseRenderTarget(Texture *tex) {
+	RenderTargetEntry *rt = FindRenderTarget(tex);
+	if(rt) {
+		if(tex == cur_rtarg) SetRenderTarget(0);
+		rt->in_use = false;
+	}
+}
+
+static void DestroyRenderTargets() {
+	if(cur_rtarg) SetRenderTarget(0);
+
+	for(size_t i=0; i<rtarg_pool.size(); i++) {
+		if(rtarg_pool[i].fbo) {
+			glDeleteFramebuffers(1, &rtarg_pool[i].fbo);
+		}
+		delete rtarg_pool[i].tex;
+	}
+	rtarg_pool.clear();
+
+	for(size_t i=0; i<depth_pool.size(); i++) {
+		glDeleteRenderbuffers(1, &depth_pool[i].rbuf);
+	}
+	depth_pool.clear();
+}
+
 void SetRenderTarget(Texture *tex) {
-	static Texture *prev;
-	
-	if(tex == prev) return;
+	if(tex == cur_rtarg) return;
 
-	if(prev) {
-		SetTexture(0, prev);
-		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, prev->width, prev->height);
+	RenderTargetEntry *prev = FindRenderTarget(cur_rtarg);
+	if(cur_rtarg && !(prev && prev->fbo)) {
+		SetTexture(0, cur_rtarg);
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, cur_rtarg->width, cur_rtarg->height);
 		glGetError();	// swallow
 	}
+	cur_rtarg = tex;
+
+	if(sys_caps.fb_objects) {
+		glBindFramebuffer(GL_FRAMEBUFFER_EXT, CurrentFramebuffer());
+	}
 	
 	if(!tex) {
 		SetViewport(0, 0, gparams.x, gparams.y);
@@ -751,24 +1493,40 @@ void SetRenderTarget(Texture *tex) {
 		SetViewport(0, 0, tex->width, tex->height);
 	}
 
-	prev = tex;
+	RenderTargetEntry *rt = FindRenderTarget(tex);
+	if(rt && rt->fbo && rt->discard) {
+		Clear(Color(0.0f, 0.0f, 0.0f));
+		ClearZBufferStencil(1.0f, 0);
+		rt->discard = false;
+	}
 }		
 
 // multitexturing interface
 
 void EnableTextureUnit(int tex_unit) {
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
-	glEnable(GL_TEXTURE_2D);
+	SelectTextureUnit(tex_unit);
+	if(tex_unit >= CACHED_UNITS) {
+		glEnable(GL_TEXTURE_2D);
+		return;
+	}
+	SetCap(state.tex_enabled + tex_unit, GL_TEXTURE_2D, true);
 }
 
 void DisableTextureUnit(int tex_unit) {
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
-	glDisable(GL_TEXTURE_2D);
+	SelectTextureUnit(tex_unit);
+	if(tex_unit >= CACHED_UNITS) {
+		glDisable(GL_TEXTURE_2D);
+		return;
+	}
+	SetCap(state.tex_enabled + tex_unit, GL_TEXTURE_2D, false);
 }
 
 void SetTextureUnitColor(int tex_unit, TextureBlendFunction op, TextureBlendArgument arg1, TextureBlendArgument arg2, TextureBlendArgument arg3) {
 	
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
+	SelectTextureUnit(tex_unit);
+	if(tex_unit < CACHED_UNITS && !CombinerChange(state.tex_color[tex_unit], op, arg1, arg2, arg3)) {
+		return;
+	}
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
 	glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, op);
 	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, arg1);
@@ -780,7 +1538,10 @@ void SetTextureUnitColor(int tex_unit, TextureBlendFunction op, TextureBlendArgu
 
 void SetTextureUnitAlpha(int tex_unit, TextureBlendFunction op, TextureBlendArgument arg1, TextureBlendArgument arg2, TextureBlendArgument arg3) {
 	
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
+	SelectTextureUnit(tex_unit);
+	if(tex_unit < CACHED_UNITS && !CombinerChange(state.tex_alpha[tex_unit], op, arg1, arg2, arg3)) {
+		return;
+	}
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
 	glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, op);
 	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_ALPHA, arg1);
@@ -796,21 +1557,47 @@ void SetTextureCoordIndex(int tex_unit, int index) {
 
 void SetTextureConstant(int tex_unit, const Color &col) {
 	float color[] = {col.r, col.g, col.b, col.a};
-	glActiveTexture(GL_TEXTURE0 + tex_unit);
+	SelectTextureUnit(tex_unit);
 	glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, color);
 }
 
 //void SetTextureTransformState(int sttex_unitage, TexTransformState TexXForm);
-//void SetTextureCoordGenerator(int stage, TexGen tgen);
+
+void SetTextureCoordGenerator(int tex_unit, TexGen tgen) {
+	SelectTextureUnit(tex_unit);
+	if(tex_unit < CACHED_UNITS && !StateChange(state.tex_gen + tex_unit, tgen)) return;
+
+	if(tgen == TEXGEN_SPHERE_MAP) {
+		glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
+		glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
+		glEnable(GL_TEXTURE_GEN_S);
+		glEnable(GL_TEXTURE_GEN_T);
+	} else {
+		glDisable(GL_TEXTURE_GEN_S);
+		glDisable(GL_TEXTURE_GEN_T);
+	}
+}
 
 
 // lighting states
 void SetLighting(bool enable) {
-	if(enable) {
-		glEnable(GL_LIGHTING);
-	} else {
-		glDisable(GL_LIGHTING);
+	SetCap(&state.lighting, GL_LIGHTING, enable);
+}
+
+void SetLight(int n, bool enable) {
+	SetCap(state.light + n, GL_LIGHT0 + n, enable);
+}
+
+bool GetLighting() {
+	return state.lighting == 1;
+}
+
+unsigned int GetLightMask() {
+	unsigned int mask = 0;
+	for(int i=0; i<8; i++) {
+		if(state.light[i] == 1) mask |= 1 << i;
 	}
+	return mask;
 }
 
 void SetAmbientLight(const Color &ambient_color) {
@@ -827,14 +1614,17 @@ void SetMatrix(TransformType xform_type, const Matrix4x4 &mat, int num) {
 	switch(xform_type) {
 	case XFORM_WORLD:
 		world_matrix = mat;
+		modelview_dirty = true;
 		break;
 		
 	case XFORM_VIEW:
 		view_matrix = mat;
+		modelview_dirty = true;
 		break;
 		
 	case XFORM_PROJECTION:
 		proj_matrix = mat;
+		proj_dirty = true;
 		break;
 		
 	case XFORM_TEXTURE:
@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "material.hpp"
 #include "3dgeom.hpp"
 
+// read only, use SetMatrix to change them
 extern Matrix4x4 world_matrix, view_matrix;
 
 void CreateGraphicsContext(const GraphicsInitParameters &gip);
@@ -39,14 +40,67 @@ void ClearZBuffer(scalar_t zval);
 void ClearStencil(unsigned char sval);
 void ClearZBufferStencil(scalar_t zval, unsigned char sval);
 
+/* the clear functions do nothing when the render target wasn't drawn to
+ * since it was cleared to the same values. Drawing that doesn't go through
+ * Draw() has to call MarkTargetDirty() for that to work.
+ */
+void MarkTargetDirty();
+
 void Flip();
 
+/* makes an offscreen framebuffer of the specified size the default render
+ * target in place of the window, GetGraphicsInitParameters() reports the
+ * new size afterwards. Requires framebuffer object support.
+ */
+bool SetOffscreenFramebuffer(int x, int y);
+
+/* reads back the default framebuffer as 32bit BGRA pixels, bottom-up */
+void ReadFramebuffer(void *pixels);
+
+// loads the matrices to GL, if they changed since the last time
 void LoadXFormMatrices();
+
+/* Draw() leaves the vertex arrays enabled and pointing at the last array
+ * drawn, so drawing it again only costs the draw call. Code that draws
+ * from vertex arrays of its own has to call ResetVertexBinding() first.
+ */
 void Draw(const VertexArray &varray);
 void Draw(const VertexArray &varray, const IndexArray &iarray);
+/* draws count instances with one call, only with SysCaps::draw_instanced.
+ * The bound program has to place each instance (see Object::RenderInstances).
+ */
+void DrawInstanced(const VertexArray &varray, const IndexArray &iarray, int count);
+void ResetVertexBinding();
+
+// for geometry arrays, deletes a buffer object that may be bound for drawing
+void DeleteBufferObject(unsigned int buffer);
+
+/* per-frame streaming vertex buffer. AllocStream reserves size bytes and
+ * returns where to write them, GPU memory when the buffer can be mapped by
+ * range, with their offset in GetStreamBuffer(). UnmapStream must follow
+ * before anything else is drawn. The space lasts until Flip(); it returns 0
+ * when the buffer is full, which then grows for the next frame.
+ */
+void *AllocStream(unsigned long size, unsigned long *offset);
+void UnmapStream();
+unsigned int GetStreamBuffer();
+unsigned long GetStreamFrame();		// changes with every Flip()
 
 int GetTextureUnitCount();
 
+/* the state functions below remember what they last set and skip calls
+ * that wouldn't change anything. Code that changes the same state with
+ * direct GL calls must call InvalidateStateCache() afterwards.
+ */
+struct StateStats {
+	unsigned long issued, elided;				// during the last frame
+	unsigned long total_issued, total_elided;
+	unsigned long frames;
+};
+
+void InvalidateStateCache();
+const StateStats *GetStateStats();	// updated by Flip()
+
 ////// render states //////
 void SetPrimitiveType(PrimitiveType pt);
 void SetBackfaceCulling(bool enable);
@@ -54,6 +108,9 @@ void SetFrontFace(FaceOrder order);
 void SetAutoNormalize(bool enable);
 //void SetBillboarding(bool enable);
 void SetColorWrite(bool red, bool green, bool blue, bool alpha);
+// the scissor test is only known to be on when enabled through here
+void SetScissoring(bool enable);
+void SetScissorRect(unsigned int x, unsigned int y, unsigned int xsize, unsigned int ysize);
 void SetWireframe(bool enable);
 
 // blending states
@@ -73,6 +130,7 @@ void SetStencilPassZFailOp(StencilOp sop);
 void SetStencilOp(StencilOp fail, StencilOp spass_zfail, StencilOp pass);
 void SetStencilFunc(CmpFunc func);
 void SetStencilReference(unsigned int ref);
+void SetStencilWriteMask(unsigned int mask);
 
 // texture & material states
 void SetTextureFiltering(int tex_unit, TextureFilteringType tex_filter);
@@ -81,8 +139,22 @@ void SetTextureBorderColor(int tex_unit, const Color &color);
 void SetTexture(int tex_unit, Texture *tex);
 //void SetTextureFactor(dword factor);
 void SetMipMapping(bool enable);
+bool GetMipMapping();
 void SetMaterial(const Material &mat);
 
+/* render target textures of any size (limited to the window size and powers
+ * of two without framebuffer objects and non power of two textures, see
+ * SysCaps). They come from a pool keyed by size and format, targets of the
+ * same size share one depth/stencil buffer. Release puts them back, the
+ * contents are cleared when an acquired target is first drawn to.
+ */
+Texture *AcquireRenderTarget(int x, int y, unsigned int format = GL_RGBA8, bool depth = true);
+void ReleaseRenderTarget(Texture *tex);
+
+/* draws into tex from now on, 0 for the framebuffer. Renders directly to
+ * the texture when framebuffer objects are available, otherwise it's copied
+ * from the back buffer when the target changes again.
+ */
 void SetRenderTarget(Texture *tex);
 
 // multitexturing interface
@@ -93,7 +165,7 @@ void SetTextureUnitAlpha(int tex_unit, TextureBlendFunction op, TextureBlendArgu
 void SetTextureCoordIndex(int tex_unit, int index);
 void SetTextureConstant(int tex_unit, const Color &col);
 //void SetTextureTransformState(int sttex_unitage, TexTransformState TexXForm);
-//void SetTextureCoordGenerator(int stage, TexGen tgen);
+void SetTextureCoordGenerator(int tex_unit, TexGen tgen);
 
 // programmable interface
 //TODO: implement the vertex/fragment program interface
@@ -101,6 +173,9 @@ void SetTextureConstant(int tex_unit, const Color &col);
 
 // lighting states
 void SetLighting(bool enable);
+void SetLight(int n, bool enable);	// n in [0, 8)
+bool GetLighting();
+unsigned int GetLightMask();		// bit n set if light n is enabled
 //void SetColorVertex(bool enable);
 void SetAmbientLight(const Color &ambient_color);
 void SetShadingMode(ShadeMode mode);
@@ -71,6 +71,11 @@ enum TextureBlendArgument {
 	TARG_NONE
 };
 
+enum TexGen {
+	TEXGEN_NONE,
+	TEXGEN_SPHERE_MAP
+};
+
 enum CmpFunc {
 	CMP_NEVER		= GL_NEVER,
     CMP_LESS		= GL_LESS,
@@ -145,6 +150,16 @@ struct SysCaps {
 	bool pixel_program;
 	bool glslang;
 	bool point_sprites;
+	bool fb_objects;
+	bool packed_depth_stencil;
+	bool timer_query;
+	bool npot_textures;
+	bool map_buffer_range;
+	bool half_float_vertex;
+	bool program_binary;
+	bool s3tc_textures;
+	bool tex_swizzle;
+	bool draw_instanced;
 	int max_texture_units;
 };
 
@@ -19,7 +19,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include <string>
+#include <cstring>
 #include "3dscene.hpp"
+#include "profiler.hpp"
+#include "shaders.hpp"
+#include "matshaders.hpp"
 
 using std::string;
 
@@ -34,6 +38,8 @@ Scene::Scene() {
 
 	AmbientLight = Color(0.0f, 0.0f, 0.0f);
 	ManageData = true;
+
+	cull_stats.drawn = cull_stats.culled = 0;
 }
 
 Scene::~Scene() {
@@ -149,6 +155,15 @@ std::list<Object*> *Scene::GetObjectsList() {
 	return &objects;
 }
 
+unsigned int Scene::GetLightMask() const {
+	unsigned int mask = 0;
+	int light_count = 0;
+	for(int i=0; i<8; i++) {
+		if(lights[i]) mask |= 1 << light_count++;
+	}
+	return mask;
+}
+
 
 void Scene::SetActiveCamera(Camera *cam) {
 	ActiveCamera = cam;
@@ -191,11 +206,107 @@ void Scene::SetupLights(unsigned long msec) const {
 			lights[i]->SetGLLight(LightIndex++, msec);
 		}
 	}
-	glDisable(GL_LIGHT0 + LightIndex);
+	if(LightIndex < 8) SetLight(LightIndex, false);
 	//gc->D3DDevice->LightEnable(LightIndex, false);
 }
 
+/* render queue keys:
+ * opaque objects - material program features (hi 16-30), diffuse texture
+ *     (hi 0-15), envmap (lo 16-31), zwrite (lo 1) and flat shading (lo 0)
+ * transparent objects (alpha < 1 or blending) - hi 31 set, lo holds the
+ *     view space depth, inverted to sort back to front.
+ */
+static void MakeRenderKey(RenderQueueItem *item, Object *obj, const Vector3 &view_pos) {
+	Material *mat = obj->GetMaterialPtr();
+	RenderParams rp = obj->GetRenderParams();
+
+	if(mat->alpha < 1.0f || rp.blending) {
+		// flip the float bits around so that they compare as unsigned ints
+		union {float f; unsigned int i;} depth;
+		depth.f = view_pos.z;
+		depth.i = depth.i & 0x80000000 ? ~depth.i : depth.i | 0x80000000;
+
+		item->key_hi = 0x80000000;
+		item->key_lo = ~depth.i;
+		return;
+	}
+
+	unsigned int diffuse = mat->tex[TEXTYPE_DIFFUSE] ? mat->tex[TEXTYPE_DIFFUSE]->tex_id : 0;
+	unsigned int envmap = mat->tex[TEXTYPE_ENVMAP] ? mat->tex[TEXTYPE_ENVMAP]->tex_id : 0;
+
+	unsigned int features = GetMaterialFeatures(*mat);
+
+	item->key_hi = ((features & 0x7fff) << 16) | (diffuse & 0xffff);
+	item->key_lo = ((envmap & 0xffff) << 16) | (rp.zwrite ? 2 : 0) | (rp.shading == SHADING_FLAT ? 1 : 0);
+}
+
+static inline unsigned int KeyDigit(const RenderQueueItem &item, int digit) {
+	unsigned int word = digit < 4 ? item.key_lo : item.key_hi;
+	return (word >> ((digit & 3) * 8)) & 0xff;
+}
+
+/* LSD radix sort of the queue on its keys, 8 bits at a time. It's stable,
+ * so objects with equal keys stay in the order they were added.
+ */
+static void RadixSort(std::vector<RenderQueueItem> *items, std::vector<RenderQueueItem> *tmp) {
+	size_t count = items->size();
+	if(count < 2) return;
+	tmp->resize(count);
+
+	static size_t hist[8][256];
+	memset(hist, 0, sizeof hist);
+	for(size_t i=0; i<count; i++) {
+		for(int d=0; d<8; d++) {
+			hist[d][KeyDigit((*items)[i], d)]++;
+		}
+	}
+
+	for(int d=0; d<8; d++) {
+		// skip the digits that are the same in all keys
+		if(hist[d][KeyDigit((*items)[0], d)] == count) continue;
+
+		size_t offs = 0;
+		for(int i=0; i<256; i++) {
+			size_t n = hist[d][i];
+			hist[d][i] = offs;
+			offs += n;
+		}
+
+		RenderQueueItem *src = &(*items)[0];
+		RenderQueueItem *dest = &(*tmp)[0];
+		for(size_t i=0; i<count; i++) {
+			dest[hist[d][KeyDigit(src[i], d)]++] = src[i];
+		}
+		items->swap(*tmp);
+	}
+}
+
+/* planes of the view frustum in world space, extracted from the combined
+ * projection and view matrix, facing inwards.
+ */
+static void GetFrustumPlanes(const Matrix4x4 &proj_view, Vector4 *planes) {
+	const Matrix4x4 &m = proj_view;
+	for(int i=0; i<3; i++) {
+		planes[i * 2] = Vector4(m[3][0] + m[i][0], m[3][1] + m[i][1], m[3][2] + m[i][2], m[3][3] + m[i][3]);
+		planes[i * 2 + 1] = Vector4(m[3][0] - m[i][0], m[3][1] - m[i][1], m[3][2] - m[i][2], m[3][3] - m[i][3]);
+	}
+
+	for(int i=0; i<6; i++) {
+		scalar_t len = Vector3(planes[i].x, planes[i].y, planes[i].z).Length();
+		planes[i] /= len;
+	}
+}
+
+static bool SphereInFrustum(const Vector3 &center, scalar_t radius, const Vector4 *planes) {
+	for(int i=0; i<6; i++) {
+		scalar_t dist = planes[i].x * center.x + planes[i].y * center.y + planes[i].z * center.z + planes[i].w;
+		if(dist < -radius) return false;
+	}
+	return true;
+}
+
 void Scene::Render(unsigned long msec) const {
+	PROF_SCOPE("Scene::Render");
 	::SetAmbientLight(AmbientLight);
 
 	// set camera
@@ -211,16 +322,63 @@ void Scene::Render(unsigned long msec) const {
 	Matrix4x4 proj = CreateProjectionMatrix(ActiveCamera->GetFOV(), 1.333333f, near_clip, far_clip);
 	SetMatrix(XFORM_PROJECTION, proj);
 
-	// render objects
+	Matrix4x4 view = GetMatrix(XFORM_VIEW);
+	Vector4 frustum[6];
+	GetFrustumPlanes(proj * view, frustum);
+
+	// queue up the objects within the view frustum, render them in key order
+	world_xforms.resize(objects.size());
+	render_queue.clear();
+
+	Matrix4x4 *xform = world_xforms.empty() ? 0 : &world_xforms[0];
 	std::list<Object *>::const_iterator iter = objects.begin();
-	while(iter != objects.end()) {
+	for(; iter != objects.end(); xform++) {
 		Object *obj = *iter++;
+		*xform = obj->GetPRS(msec).GetXFormMatrix();
+
+		// the bounding sphere in world space, scaled by the largest axis scale
+		const Sphere &bsph = obj->GetTriMeshPtr()->GetBoundingSphere();
+		Vector3 center = bsph.GetPosition().Transformed(*xform);
+		scalar_t scale_sq = 0.0;
+		for(int j=0; j<3; j++) {
+			scalar_t len_sq = SQ((*xform)[0][j]) + SQ((*xform)[1][j]) + SQ((*xform)[2][j]);
+			if(len_sq > scale_sq) scale_sq = len_sq;
+		}
+
+		if(!SphereInFrustum(center, bsph.GetRadius() * sqrt(scale_sq), frustum)) {
+			continue;
+		}
+
+		RenderQueueItem item;
+		item.obj = obj;
+		item.xform = xform;
+		MakeRenderKey(&item, obj, center.Transformed(view));
+		render_queue.push_back(item);
+	}
+	RadixSort(&render_queue, &sort_tmp);
 
-		obj->Render(msec);
+	for(size_t i=0; i<render_queue.size(); i++) {
+		render_queue[i].obj->Render(*render_queue[i].xform, false);
+	}
+
+	cull_stats.drawn = render_queue.size();
+	cull_stats.culled = objects.size() - render_queue.size();
+
+	// the objects leave their states set, back to the defaults
+	if(!render_queue.empty()) {
+		SetProgram(0);
+		SetAlphaBlending(false);
+		SetZWrite(true);
+		SetShadingMode(SHADING_GOURAUD);
+		int units = GetTextureUnitCount();
+		for(int i=0; i<MAX_TEXTURES && i<units; i++) {
+			DisableTextureUnit(i);
+			SetTextureCoordGenerator(i, TEXGEN_NONE);
+		}
 	}
 	/*
 	for(int i=0; i<8; i++) {
-		if(lights[i]) glDisable(GL_LIGHT0 + i);
+		if(lights[i]) SetLight(i, false);
 	}
 	*/
 
@@ -234,3 +392,7 @@ void Scene::Render(unsigned long msec) const {
 	}
 	*/
 }
+
+const CullStats *Scene::GetCullStats() const {
+	return &cull_stats;
+}
@@ -26,6 +26,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
 #include <list>
+#include <vector>
 //#include "3dengfx.hpp"
 #include "camera.hpp"
 #include "light.hpp"
@@ -39,6 +40,21 @@ struct ShadowVolume {
 };
 */
 
+/* Render queue entries, sorted on a 64bit key (two words, key_hi is the
+ * most significant) so that opaque objects sharing states are drawn
+ * together, and transparent objects after them, back to front.
+ */
+struct RenderQueueItem {
+	unsigned int key_hi, key_lo;
+	Object *obj;
+	const Matrix4x4 *xform;
+};
+
+// objects of the last Scene::Render call
+struct CullStats {
+	unsigned long drawn, culled;
+};
+
 class Scene {
 private:
 	Light *lights[8];
@@ -59,6 +75,11 @@ private:
 	bool UseFog;
 	Color FogColor;
 	float NearFogRange, FarFogRange;
+
+	// rebuilt every frame, kept around to reuse the memory
+	mutable std::vector<RenderQueueItem> render_queue, sort_tmp;
+	mutable std::vector<Matrix4x4> world_xforms;
+	mutable CullStats cull_stats;
 		
 public:
 
@@ -81,6 +102,9 @@ public:
 
 	std::list<Object*> *GetObjectsList();
 
+	// the GL lights Render() enables for the scene's lights
+	unsigned int GetLightMask() const;
+
 	void SetActiveCamera(Camera *cam);
 	Camera *GetActiveCamera() const;
 
@@ -96,6 +120,8 @@ public:
 
 	//void RenderShadows() const;
 	void Render(unsigned long msec = XFORM_LOCAL_PRS) const;
+
+	const CullStats *GetCullStats() const;
 };
 	
 
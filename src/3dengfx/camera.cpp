@@ -18,15 +18,15 @@ along with 3dengfx; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include "3denginefx.hpp"
 #include "camera.hpp"
 
 void Camera::Activate(unsigned long msec) const {
-	extern Matrix4x4 view_matrix;
-	
 	PRS prs = GetPRS(msec);
 
-	view_matrix = prs.rotation.Inverse().GetRotationMatrix();
-	view_matrix.Translate(-prs.position);
+	Matrix4x4 view = prs.rotation.Inverse().GetRotationMatrix();
+	view.Translate(-prs.position);
+	SetMatrix(XFORM_VIEW, view);
 }
 
 
@@ -50,8 +50,6 @@ Vector3 TargetCamera::GetTarget(unsigned long msec) const {
 }
 
 void TargetCamera::Activate(unsigned long msec) const {
-	extern Matrix4x4 view_matrix;
-
 	Vector3 pos = GetPRS(msec).position;
 	Vector3 targ = target.GetPRS(msec).position;
 
@@ -63,10 +61,10 @@ void TargetCamera::Activate(unsigned long msec) const {
 	float ty = -DotProduct(v, pos);
 	float tz = -DotProduct(n, pos);
 
-	view_matrix = Matrix4x4(u.x, u.y, u.z, tx,
-							v.x, v.y, v.z, ty,
-							n.x, n.y, n.z, tz,
-							0.0, 0.0, 0.0, 1.0);
+	SetMatrix(XFORM_VIEW, Matrix4x4(u.x, u.y, u.z, tx,
+								v.x, v.y, v.z, ty,
+								n.x, n.y, n.z, tz,
+								0.0, 0.0, 0.0, 1.0));
 }
 
 void TargetCamera::Roll(scalar_t angle, unsigned long msec) {
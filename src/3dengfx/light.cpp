@@ -128,7 +128,7 @@ void PointLight::SetGLLight(int n, unsigned long time) const {
 	glLightf(light_num, GL_LINEAR_ATTENUATION, (float)attenuation[1]);
 	glLightf(light_num, GL_QUADRATIC_ATTENUATION, (float)attenuation[2]);
 	
-	glEnable(light_num);
+	SetLight(n, true);
 	
 	glPopMatrix();
 }
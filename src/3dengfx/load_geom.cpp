@@ -18,9 +18,13 @@ along with 3dengfx; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <string>
 #include "load_geom.hpp"
 #include "nlibase.h"
 #include "texman.hpp"
+#include "loader.hpp"
+
+using std::string;
 
 char *tex_path, *geom_path;
 
@@ -47,20 +51,25 @@ const char *GetDataPath(DataPathType dtype) {
 }
 
 
+static string MakePath(const char *dir, const char *fname) {
+	return dir ? string(dir) + string(fname) : string(fname);
+}
+
 Object *LoadObject(const char *name, char *src, int flags) {
+	if(flags & LGEOM_FILE) {
+		// the loader threads may have parsed it already
+		Object *obj = TakeLoadedObject(name, MakePath(geom_path, src).c_str(), tex_path);
+		if(obj) return obj;
+	}
+	return LoadObject(name, src, flags, tex_path, geom_path);
+}
+
+Object *LoadObject(const char *name, char *src, int flags, const char *tpath, const char *gpath) {
 	
 	NASE_File *ase;
-
 	if(flags & LGEOM_FILE) {
-
-		if(geom_path) {
-			char *filename = new char[strlen(src) + strlen(geom_path) + 1];
-			strcpy(filename, geom_path);
-			strcat(filename, src);
-			src = filename;
-		}
-		
-		if(!(ase = NASE_OpenFile(src))) {
+		string filename = MakePath(gpath, src);
+		if(!(ase = NASE_OpenFile(filename.c_str()))) {
 			return 0;
 		}
 	} else if(flags & LGEOM_MEM) {
@@ -106,26 +115,12 @@ Object *LoadObject(const char *name, char *src, int flags) {
 		mat->bump_intensity = 1.0f;	// FIXME: see above
 
 		if(nmat->tex[NASE_TEX_DIFFUSE]) {
-			char *fname;
-			if(tex_path) {
-				fname = new char[strlen(tex_path) + strlen(nmat->tex[NASE_TEX_DIFFUSE]->filename) + 1];
-				strcpy(fname, tex_path);
-				strcat(fname, nmat->tex[NASE_TEX_DIFFUSE]->filename);
-			} else {
-				fname = nmat->tex[NASE_TEX_DIFFUSE]->filename;
-			}
-			mat->tex[TEXTYPE_DIFFUSE] = GetTexture(fname);
+			string fname = MakePath(tpath, nmat->tex[NASE_TEX_DIFFUSE]->filename);
+			mat->tex[TEXTYPE_DIFFUSE] = GetTexture(fname.c_str());
 		}
 		if(nmat->tex[NASE_TEX_REFLECT]) {
-			char *fname;
-			if(tex_path) {
-				fname = new char[strlen(tex_path) + strlen(nmat->tex[NASE_TEX_REFLECT]->filename) + 1];
-				strcpy(fname, tex_path);
-				strcat(fname, nmat->tex[NASE_TEX_REFLECT]->filename);
-			} else {
-				fname = nmat->tex[NASE_TEX_REFLECT]->filename;
-			}
-			mat->tex[TEXTYPE_ENVMAP] = GetTexture(fname);
+			string fname = MakePath(tpath, nmat->tex[NASE_TEX_REFLECT]->filename);
+			mat->tex[TEXTYPE_ENVMAP] = GetTexture(fname.c_str());
 		}
 		/*if(nmat->tex[NASE_TEX_BUMP]) {
 			mat->tex[TEXTYPE_BUMPMAP] = GetTexture(nmat->tex[NASE_TEX_BUMP]->filename);
@@ -157,6 +152,8 @@ Object *LoadObject(const char *name, char *src, int flags) {
 	
 	obj->SetTriMesh(TriMesh(varray, nmesh->vcount, tarray, nmesh->tcount));
 	obj->GetTriMeshPtr()->CalculateNormals();
+	delete [] varray;
+	delete [] tarray;
 	
 	/* get local PRS */
 	obj->SetPosition(Vector3(nobj->prs.pos.x, nobj->prs.pos.y, nobj->prs.pos.z));
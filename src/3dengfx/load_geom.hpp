@@ -32,5 +32,7 @@ void SetDataPath(const char *path, DataPathType dtype);
 const char *GetDataPath(DataPathType dtype);
 
 Object *LoadObject(const char *name, char *src, int flags);
+// same as above, but with explicit data paths instead of the ones set by SetDataPath
+Object *LoadObject(const char *name, char *src, int flags, const char *tpath, const char *gpath);
 
 #endif	// _LOAD_GEOM_HPP_
@@ -0,0 +1,261 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include "loader.hpp"
+#include "load_geom.hpp"
+#include "sceneloader.hpp"
+#include "texman.hpp"
+#include "tpool.h"
+
+using std::string;
+using std::vector;
+
+enum {ASSET_TEXTURE, ASSET_OBJECT, ASSET_SCENE};
+
+struct Request {
+	int type;
+	string name, fname;
+	string tpath, gpath;	// data paths at the time of the request
+	string key;				// the file name as the loading functions see it
+	void *data;				// the parsed object or scene
+	int refs;				// loads left to serve from it, the last one takes it
+	bool done;
+};
+
+static tpool *pool;
+static Uint32 main_thread;
+static SDL_mutex *lock;
+
+// parsed objects and scenes wait here until they are taken
+static vector<Request*> requests;
+
+// requests in the current batch, for the progress bar
+static int req_total, req_done;
+
+static void LoadJob(void *data);
+
+bool StartLoader(int threads) {
+	if(pool) return true;
+
+	main_thread = SDL_ThreadID();
+	if(!lock && !(lock = SDL_CreateMutex())) {
+		return false;
+	}
+	if(!InitTexManLock() || !SceneLoader::InitLock()) {
+		return false;
+	}
+	if(!(pool = tpool_create(threads))) {
+		return false;
+	}
+	req_total = req_done = 0;
+	return true;
+}
+
+void StopLoader() {
+	if(!pool) return;
+
+	tpool_destroy(pool);
+	pool = 0;
+
+	UploadPendingTextures();
+
+	for(size_t i=0; i<requests.size(); i++) {
+		if(requests[i]->type == ASSET_OBJECT) {
+			delete (Object*)requests[i]->data;
+		} else if(requests[i]->type == ASSET_SCENE) {
+			delete (Scene*)requests[i]->data;
+		}
+		delete requests[i];
+	}
+	requests.clear();
+}
+
+bool InLoaderThread() {
+	return pool && SDL_ThreadID() != main_thread;
+}
+
+static Request *FindRequest(int type, const char *name, const char *key, const char *tpath) {
+	if(!tpath) tpath = "";
+
+	for(size_t i=0; i<requests.size(); i++) {
+		Request *req = requests[i];
+		if(req->type == type && req->key == key && req->tpath == tpath && (!name || req->name == name)) {
+			return req;
+		}
+	}
+	return 0;
+}
+
+static void AddRequest(int type, const char *name, const char *fname, const char *tpath, const char *gpath) {
+	if(!pool) return;
+
+	string key = gpath ? string(gpath) + fname : string(fname);
+
+	SDL_LockMutex(lock);
+	Request *req = FindRequest(type, name, key.c_str(), tpath);
+	if(req) {
+		req->refs++;
+		SDL_UnlockMutex(lock);
+		return;
+	}
+
+	req = new Request;
+	req->type = type;
+	req->name = name ? name : "";
+	req->fname = fname;
+	req->tpath = tpath ? tpath : "";
+	req->gpath = gpath ? gpath : "";
+	req->key = key;
+	req->data = 0;
+	req->refs = 1;
+	req->done = false;
+
+	// textures go straight to texman, there's nothing to keep around
+	if(type != ASSET_TEXTURE) {
+		requests.push_back(req);
+	}
+
+	if(req_done == req_total) {
+		req_total = req_done = 0;
+	}
+	req_total++;
+	SDL_UnlockMutex(lock);
+
+	tpool_enqueue(pool, LoadJob, req);
+}
+
+void RequestTexture(const char *fname) {
+	if(FindTexture(fname)) return;
+	AddRequest(ASSET_TEXTURE, 0, fname, 0, 0);
+}
+
+void RequestObject(const char *name, const char *fname) {
+	AddRequest(ASSET_OBJECT, name, fname, GetDataPath(DPATH_TEX), GetDataPath(DPATH_GEOM));
+}
+
+void RequestScene(const char *fname) {
+	AddRequest(ASSET_SCENE, 0, fname, SceneLoader::GetDataPath(), 0);
+}
+
+static void LoadJob(void *data) {
+	Request *req = (Request*)data;
+	void *res = 0;
+
+	switch(req->type) {
+	case ASSET_TEXTURE:
+		GetTexture(req->fname.c_str());
+		break;
+
+	case ASSET_OBJECT:
+		res = LoadObject(req->name.c_str(), (char*)req->fname.c_str(), LGEOM_FILE,
+				req->tpath.c_str(), req->gpath.c_str());
+		break;
+
+	case ASSET_SCENE:
+		{
+			Scene *scn;
+			if(SceneLoader::LoadScene(req->fname.c_str(), &scn, req->tpath.c_str())) {
+				res = scn;
+			}
+		}
+		break;
+	}
+
+	SDL_LockMutex(lock);
+	req_done++;
+	if(req->type == ASSET_TEXTURE) {
+		delete req;
+	} else {
+		req->data = res;
+		req->done = true;
+	}
+	SDL_UnlockMutex(lock);
+}
+
+bool UpdateLoader(unsigned long max_msec) {
+	unsigned long start = SDL_GetTicks();
+
+	while(UploadPendingTextures(1) && SDL_GetTicks() - start < max_msec);
+
+	SDL_LockMutex(lock);
+	bool done = req_done == req_total;
+	SDL_UnlockMutex(lock);
+
+	return done && !UploadPendingTextures(0);
+}
+
+void FinishLoading() {
+	if(pool) tpool_wait(pool);
+	UploadPendingTextures();
+}
+
+float GetLoadProgress() {
+	// every parsed request may still have a texture waiting for upload
+	SDL_LockMutex(lock);
+	int done = req_done - UploadPendingTextures(0);
+	int total = req_total;
+	SDL_UnlockMutex(lock);
+
+	if(!total) return 1.0f;
+	return done > 0 ? (float)done / (float)total : 0.0f;
+}
+
+static void *TakeLoaded(int type, const char *name, const char *key, const char *tpath) {
+	if(!pool || InLoaderThread()) return 0;
+
+	SDL_LockMutex(lock);
+	Request *req = FindRequest(type, name, key, tpath);
+	if(req && !req->done) {
+		// requested but not parsed yet, wait for it rather than load it twice
+		SDL_UnlockMutex(lock);
+		tpool_wait(pool);
+		SDL_LockMutex(lock);
+	}
+
+	void *data = 0;
+	if(req) {
+		if(type == ASSET_OBJECT && req->refs > 1) {
+			data = req->data ? new Object(*(Object*)req->data) : 0;
+			req->refs--;
+		} else {
+			data = req->data;
+			for(size_t i=0; i<requests.size(); i++) {
+				if(requests[i] == req) {
+					requests.erase(requests.begin() + i);
+					break;
+				}
+			}
+			delete req;
+		}
+	}
+	SDL_UnlockMutex(lock);
+	return data;
+}
+
+Object *TakeLoadedObject(const char *name, const char *fname, const char *tpath) {
+	return (Object*)TakeLoaded(ASSET_OBJECT, name, fname, tpath);
+}
+
+Scene *TakeLoadedScene(const char *fname, const char *tpath) {
+	return (Scene*)TakeLoaded(ASSET_SCENE, 0, fname, tpath);
+}
@@ -0,0 +1,63 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _LOADER_HPP_
+#define _LOADER_HPP_
+
+#include "object.hpp"
+#include "3dscene.hpp"
+
+/* Asynchronous asset loader: a pool of threads parses geometry and
+ * decodes images into system memory, while the main thread keeps
+ * drawing and uploads the results to OpenGL with UpdateLoader().
+ * Requests capture the data paths set at the time of the call. The
+ * parsed data are picked up by the regular LoadObject(), GetTexture()
+ * and SceneLoader::LoadScene() calls, so the code using them doesn't
+ * have to know whether the loader ran or not.
+ */
+
+// threads <= 0 starts one thread per processor
+bool StartLoader(int threads = 0);
+// waits for the pending requests and frees any data nobody asked for
+void StopLoader();
+
+// true when called from one of the loader threads
+bool InLoaderThread();
+
+void RequestTexture(const char *fname);
+void RequestObject(const char *name, const char *fname);	// ASE
+void RequestScene(const char *fname);						// 3DS
+
+/* uploads the textures decoded so far, for at most max_msec milliseconds,
+ * and returns true when all requests are parsed and uploaded.
+ */
+bool UpdateLoader(unsigned long max_msec);
+// blocks until all requests are parsed and uploaded
+void FinishLoading();
+// progress of the requests made since the loader was last idle
+float GetLoadProgress();
+
+/* used by the loading functions, they return 0 if the asset wasn't requested
+ * with the same file name and texture path.
+ */
+Object *TakeLoadedObject(const char *name, const char *fname, const char *tpath);
+Scene *TakeLoadedScene(const char *fname, const char *tpath);
+
+#endif	// _LOADER_HPP_
@@ -0,0 +1,322 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "opengl.h"
+#include "matshaders.hpp"
+#include "shaders.hpp"
+#include "3denginefx.hpp"
+
+using std::string;
+
+struct MatProgram {
+	unsigned int features;
+	unsigned int prog;		// 0 if it failed to build
+	int inst_mv, inst_color;	// uniform locations of instanced programs
+};
+
+static std::vector<MatProgram> programs;
+static int last_used = -1;
+
+#define CACHE_MAGIC		"MSC1"
+
+static const char *vsdr_body =
+	"#ifdef INSTANCED\n"
+	"uniform mat4 inst_mv[MAX_INSTANCES];\n"
+	"uniform vec4 inst_color[MAX_INSTANCES];	// emissive rgb, alpha\n"
+	"#endif\n"
+	"\n"
+	"void AddLight(in gl_LightSourceParameters ls, in gl_LightProducts lp,\n"
+	"		in vec3 pos, in vec3 n, inout vec4 dif, inout vec4 spec)\n"
+	"{\n"
+	"	vec3 ldir = ls.position.xyz;\n"
+	"	float att = 1.0;\n"
+	"	if(ls.position.w != 0.0) {\n"
+	"		ldir -= pos;\n"
+	"		float dist = length(ldir);\n"
+	"		att = 1.0 / (ls.constantAttenuation + ls.linearAttenuation * dist +\n"
+	"				ls.quadraticAttenuation * dist * dist);\n"
+	"	}\n"
+	"	ldir = normalize(ldir);\n"
+	"\n"
+	"	float ndotl = dot(n, ldir);\n"
+	"	dif += att * lp.ambient;\n"
+	"	if(ndotl > 0.0) {\n"
+	"		vec3 h = normalize(ldir - normalize(pos));\n"
+	"		dif += att * ndotl * lp.diffuse;\n"
+	"		spec += att * pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) * lp.specular;\n"
+	"	}\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"#ifdef INSTANCED\n"
+	"	mat4 mv = inst_mv[gl_InstanceIDARB];\n"
+	"	vec4 vpos = mv * gl_Vertex;\n"
+	"	gl_Position = gl_ProjectionMatrix * vpos;\n"
+	"	vec3 pos = vpos.xyz;\n"
+	"	vec3 n = normalize((mv * vec4(gl_Normal, 0.0)).xyz);\n"
+	"#else\n"
+	"	gl_Position = ftransform();\n"
+	"	vec3 pos = vec3(gl_ModelViewMatrix * gl_Vertex);\n"
+	"	vec3 n = normalize(gl_NormalMatrix * gl_Normal);\n"
+	"#endif\n"
+	"\n"
+	"#ifdef LIGHTING\n"
+	"	vec4 dif = gl_FrontLightModelProduct.sceneColor;\n"
+	"	vec4 spec = vec4(0.0);\n"
+	"	ADD_LIGHTS\n"
+	"#ifdef INSTANCED\n"
+	"	dif.rgb += inst_color[gl_InstanceIDARB].rgb - gl_FrontMaterial.emission.rgb;\n"
+	"	gl_FrontColor = vec4(dif.rgb, inst_color[gl_InstanceIDARB].a);\n"
+	"#else\n"
+	"	gl_FrontColor = vec4(dif.rgb, gl_FrontMaterial.diffuse.a);\n"
+	"#endif\n"
+	"	gl_FrontSecondaryColor = spec;\n"
+	"#else\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"	gl_FrontSecondaryColor = vec4(0.0);\n"
+	"#endif\n"
+	"\n"
+	"#ifdef DIFFUSE\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"#endif\n"
+	"#ifdef ENVMAP\n"
+	"	vec3 r = reflect(normalize(pos), n);\n"
+	"	float m = 2.0 * sqrt(r.x * r.x + r.y * r.y + (r.z + 1.0) * (r.z + 1.0));\n"
+	"	gl_TexCoord[1] = vec4(r.x / m + 0.5, r.y / m + 0.5, 0.0, 1.0);\n"
+	"#endif\n"
+	"}\n";
+
+static const char *psdr_body =
+	"uniform sampler2D diffuse_map;\n"
+	"uniform sampler2D env_map;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 col = gl_Color;\n"
+	"#ifdef DIFFUSE\n"
+	"	col *= texture2D(diffuse_map, gl_TexCoord[0].st);\n"
+	"#endif\n"
+	"#ifdef ENVMAP\n"
+	"	vec4 env = texture2D(env_map, gl_TexCoord[1].st);\n"
+	"	col = vec4(min(col.rgb + env.rgb, 1.0), col.a * env.a);\n"
+	"#endif\n"
+	"	gl_FragColor = vec4(col.rgb + gl_SecondaryColor.rgb, col.a);\n"
+	"}\n";
+
+// the same lighting and combiners as the fixed function path of Object
+static string FeatureDefines(unsigned int features) {
+	string defs;
+	if(features & MATF_DIFFUSE) defs += "#define DIFFUSE\n";
+	if(features & MATF_ENVMAP) defs += "#define ENVMAP\n";
+	if(features & MATF_LIGHTING) defs += "#define LIGHTING\n";
+	if(features & MATF_INSTANCED) {
+		char def[64];
+		sprintf(def, "#define INSTANCED\n#define MAX_INSTANCES %d\n", MAT_MAX_INSTANCES);
+		defs += def;
+	}
+
+	// the light sources are indexed with constants, one call per light
+	defs += "#define ADD_LIGHTS";
+	for(int i=0; i<8; i++) {
+		if(features & (1 << (MATF_LIGHT_SHIFT + i))) {
+			char call[128];
+			sprintf(call, " AddLight(gl_LightSource[%d], gl_FrontLightProduct[%d], pos, n, dif, spec);", i, i);
+			defs += call;
+		}
+	}
+	return defs + "\n";
+}
+
+// sampler units, also needed after loading a binary since that resets them
+static void InitProgram(unsigned int prog, unsigned int features) {
+	unsigned int prev = GetProgram();
+	SetProgram(prog);
+	SetUniform(prog, "diffuse_map", 0);
+	SetUniform(prog, "env_map", features & MATF_DIFFUSE ? 1 : 0);
+	SetProgram(prev);
+}
+
+static void AddProgram(unsigned int features, unsigned int prog) {
+	MatProgram mp;
+	mp.features = features;
+	mp.prog = prog;
+	mp.inst_mv = mp.inst_color = -1;
+	if(prog && (features & MATF_INSTANCED)) {
+		mp.inst_mv = GetUniformLocation(prog, "inst_mv");
+		mp.inst_color = GetUniformLocation(prog, "inst_color");
+	}
+	programs.push_back(mp);
+	last_used = (int)programs.size() - 1;
+}
+
+// identifies the driver the program binaries came from
+static string DriverString() {
+	return string((const char*)glGetString(GL_RENDERER)) + " " + (const char*)glGetString(GL_VERSION);
+}
+
+unsigned int GetMaterialFeatures(const Material &mat) {
+	return GetMaterialFeatures(mat, GetLighting(), GetLightMask());
+}
+
+unsigned int GetMaterialFeatures(const Material &mat, bool lighting, unsigned int light_mask) {
+	unsigned int features = 0;
+	if(mat.tex[TEXTYPE_DIFFUSE]) features |= MATF_DIFFUSE;
+	if(mat.tex[TEXTYPE_ENVMAP]) features |= MATF_ENVMAP;
+	if(lighting) {
+		features |= MATF_LIGHTING | (light_mask << MATF_LIGHT_SHIFT);
+	}
+	return features;
+}
+
+unsigned int GetMaterialProgram(unsigned int features) {
+	SysCaps caps = GetSystemCapabilities();
+	if(!caps.glslang) return 0;
+	if((features & MATF_INSTANCED) && !caps.draw_instanced) return 0;
+
+	// objects tend to come in runs with the same features
+	if(last_used != -1 && programs[last_used].features == features) {
+		return programs[last_used].prog;
+	}
+	for(size_t i=0; i<programs.size(); i++) {
+		if(programs[i].features == features) {
+			last_used = (int)i;
+			return programs[i].prog;
+		}
+	}
+
+	string defs = FeatureDefines(features);
+	// #extension has to come before anything but other directives
+	string vext = features & MATF_INSTANCED ? "#extension GL_ARB_draw_instanced : enable\n" : "";
+	unsigned int prog = CreateProgram((vext + defs + vsdr_body).c_str(), (defs + psdr_body).c_str(), true);
+	if(prog) {
+		InitProgram(prog, features);
+	} else {
+		EngineLog("material program build failed, using the fixed function pipeline\n");
+	}
+
+	AddProgram(features, prog);
+	return prog;
+}
+
+bool LoadProgramCache(const char *fname) {
+	if(!GetSystemCapabilities().program_binary) return false;
+
+	FILE *fp = fopen(fname, "rb");
+	if(!fp) return false;
+
+	char magic[4];
+	unsigned int id_len;
+	if(fread(magic, 1, 4, fp) < 4 || memcmp(magic, CACHE_MAGIC, 4) ||
+			fread(&id_len, sizeof id_len, 1, fp) < 1) {
+		fclose(fp);
+		return false;
+	}
+
+	// check the sizes read from the file before allocating anything for them
+	string driver = DriverString();
+	if(id_len != driver.size()) {
+		EngineLog(string("ignoring program cache ") + fname + " from another driver\n");
+		fclose(fp);
+		return false;
+	}
+
+	std::vector<char> buf(id_len + 1);
+	if(fread(&buf[0], 1, id_len, fp) < id_len || memcmp(&buf[0], driver.c_str(), id_len)) {
+		EngineLog(string("ignoring program cache ") + fname + " from another driver\n");
+		fclose(fp);
+		return false;
+	}
+
+	long data_start = ftell(fp);
+	fseek(fp, 0, SEEK_END);
+	long file_size = ftell(fp);
+	fseek(fp, data_start, SEEK_SET);
+
+	unsigned int hdr[3];	// features, binary format, size
+	while(fread(hdr, sizeof *hdr, 3, fp) == 3) {
+		if(!hdr[2] || hdr[2] > (unsigned long)(file_size - ftell(fp))) break;
+
+		buf.resize(hdr[2]);
+		if(fread(&buf[0], 1, hdr[2], fp) < hdr[2]) break;
+
+		// rejected binaries will be compiled from source when needed
+		unsigned int prog = CreateProgramFromBinary(hdr[1], &buf[0], hdr[2]);
+		if(!prog) continue;
+
+		InitProgram(prog, hdr[0]);
+		AddProgram(hdr[0], prog);
+	}
+	fclose(fp);
+	return true;
+}
+
+bool SaveProgramCache(const char *fname) {
+	if(!GetSystemCapabilities().program_binary) return false;
+
+	FILE *fp = fopen(fname, "wb");
+	if(!fp) return false;
+
+	string driver = DriverString();
+	unsigned int id_len = driver.size();
+	fwrite(CACHE_MAGIC, 1, 4, fp);
+	fwrite(&id_len, sizeof id_len, 1, fp);
+	fwrite(driver.c_str(), 1, id_len, fp);
+
+	std::vector<char> buf;
+	for(size_t i=0; i<programs.size(); i++) {
+		if(!programs[i].prog) continue;
+
+		int size = GetProgramBinarySize(programs[i].prog);
+		if(!size) continue;
+		buf.resize(size);
+
+		unsigned int format;
+		GetProgramBinary(programs[i].prog, &buf[0], size, &format);
+
+		unsigned int hdr[] = {programs[i].features, format, (unsigned int)size};
+		fwrite(hdr, sizeof *hdr, 3, fp);
+		fwrite(&buf[0], 1, size, fp);
+	}
+	fclose(fp);
+	return true;
+}
+
+void SetMaterialInstances(unsigned int prog, const float *modelview, const float *color, int count) {
+	for(size_t i=0; i<programs.size(); i++) {
+		if(programs[i].prog == prog) {
+			SetUniformMatrix4v(programs[i].inst_mv, modelview, count);
+			SetUniform4v(programs[i].inst_color, color, count);
+			return;
+		}
+	}
+}
+
+void DestroyMaterialPrograms() {
+	for(size_t i=0; i<programs.size(); i++) {
+		DestroyProgram(programs[i].prog);
+	}
+	programs.clear();
+	last_used = -1;
+}
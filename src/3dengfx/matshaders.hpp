@@ -0,0 +1,67 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MATSHADERS_HPP_
+#define _MATSHADERS_HPP_
+
+#include "material.hpp"
+
+/* GLSL programs generated from the material features, replacing the fixed
+ * function texture combiners of Object::Render. One program is compiled
+ * per combination of features and kept around, and the whole set can be
+ * saved to disk as program binaries (GL_ARB_get_program_binary) so that
+ * later runs don't compile anything.
+ */
+
+enum {
+	MATF_DIFFUSE	= 1,	// diffuse texture on unit 0, modulated
+	MATF_ENVMAP		= 2,	// sphere map on the next unit, added
+	MATF_LIGHTING	= 4,	// lit with the enabled lights, else vertex colors
+	MATF_INSTANCED	= 16	// placed per instance, see SetMaterialInstances
+};
+#define MATF_LIGHT_SHIFT	8	// the enabled lights mask goes in bits 8-15
+#define MAT_MAX_INSTANCES	16	// instances per DrawInstanced call
+
+// the features needed to draw mat with the current lighting state
+unsigned int GetMaterialFeatures(const Material &mat);
+// same for the given lighting state, to build programs ahead of time
+unsigned int GetMaterialFeatures(const Material &mat, bool lighting, unsigned int light_mask);
+
+/* returns the program for the features, compiling it if it's not in the
+ * cache yet. 0 if GLSL is not available or the program failed to build,
+ * in which case the fixed function pipeline should be used.
+ */
+unsigned int GetMaterialProgram(unsigned int features);
+
+/* the program binaries are only good for the driver that wrote them,
+ * LoadProgramCache ignores files written by a different renderer or version.
+ */
+bool LoadProgramCache(const char *fname);
+bool SaveProgramCache(const char *fname);
+
+/* uploads the per instance data of a MATF_INSTANCED program: count (up to
+ * MAT_MAX_INSTANCES) column major modelview matrices and emissive rgb +
+ * alpha colors, indexed by the instance id in the vertex shader.
+ */
+void SetMaterialInstances(unsigned int prog, const float *modelview, const float *color, int count);
+
+void DestroyMaterialPrograms();
+
+#endif	// _MATSHADERS_HPP_
@@ -18,9 +18,12 @@ along with 3dengfx; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <cstring>
 #include "opengl.h"
 #include "object.hpp"
 #include "3denginefx.hpp"
+#include "shaders.hpp"
+#include "matshaders.hpp"
 
 
 Object::Object() {
@@ -56,9 +59,15 @@ TriMesh Object::GetTriMesh() const {
 }
 
 void Object::SetDynamic(bool enable) {
-	const_cast<VertexArray*>(mesh.GetVertexArray())->SetDynamic(enable);
-	const_cast<TriangleArray*>(mesh.GetTriangleArray())->SetDynamic(enable);
-	//const_cast<IndexArray*>(mesh.GetIndexArray())->SetDynamic(enable);
+	mesh.GetModVertexArray()->SetDynamic(enable);
+	// the index array is rebuilt from the triangles, taking this setting
+	mesh.GetModTriangleArray()->SetDynamic(enable);
+}
+
+void Object::SetStreaming(bool enable) {
+	mesh.GetModVertexArray()->SetStreaming(enable);
+	// only the vertices change, the indices can stay in a buffer object
+	if(enable) mesh.GetModTriangleArray()->SetDynamic(false);
 }
 
 bool Object::GetDynamic() const {
@@ -124,10 +133,7 @@ void Object::Render8TexUnits() {
 		//SetTextureUnitColor(tex_unit, TOP_MODULATE, TARG_TEXTURE, TARG_CONSTANT);
 		SetTextureUnitColor(tex_unit, TOP_REPLACE, TARG_TEXTURE, TARG_PREV);
 		SetTextureUnitAlpha(tex_unit, TOP_REPLACE, TARG_PREV, TARG_TEXTURE);
-		glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-		glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-		glEnable(GL_TEXTURE_GEN_S);
-		glEnable(GL_TEXTURE_GEN_T);
+		SetTextureCoordGenerator(tex_unit, TEXGEN_SPHERE_MAP);
 		SetTexture(tex_unit, mat.tex[TEXTYPE_ENVMAP]);
 		tex_id = mat.tex[TEXTYPE_ENVMAP]->tex_id;
 		tex_unit++;
@@ -186,65 +192,144 @@ void Object::Render8TexUnits() {
 	
 	for(int i=0; i<tex_unit; i++) {
 		DisableTextureUnit(i);
-		glDisable(GL_TEXTURE_GEN_S);
-		glDisable(GL_TEXTURE_GEN_T);
+		SetTextureCoordGenerator(i, TEXGEN_NONE);
 	}
 }
 	
 
-void Object::Render(unsigned long time) {
-	world_mat = GetPRS(time).GetXFormMatrix();
+void Object::Render(unsigned long time, bool restore_state) {
+	Render(GetPRS(time).GetXFormMatrix(), restore_state);
+}
+
+void Object::Render(const Matrix4x4 &xform, bool restore_state) {
+	world_mat = xform;
 	
 	SetMatrix(XFORM_WORLD, world_mat);
-	mat.SetGLMaterial();
 	
 	//Render8TexUnits();
-	RenderHack();
+	RenderHack(restore_state);
+}
+
+void Object::RenderHack(bool restore_state) {
+	int tex_units = SetRenderStates(!restore_state);
+	Draw(*mesh.GetVertexArray(), *mesh.GetIndexArray());
+	if(restore_state) ResetRenderStates(tex_units);
 }
 
-void Object::RenderHack() {
+// returns the number of fixed function texture units used
+int Object::SetRenderStates(bool clear_units) {
 	::SetMaterial(mat);
 	int tex_unit = 0;
 
-	if(mat.tex[TEXTYPE_DIFFUSE]) {
+	unsigned int prog = GetMaterialProgram(GetMaterialFeatures(mat));
+	SetProgram(prog);
+	if(prog) {
+		// the program does the texturing, the textures just have to be bound
+		int prog_unit = 0;
+		SetTextureCoordIndex(0, 0);
+		if(mat.tex[TEXTYPE_DIFFUSE]) SetTexture(prog_unit++, mat.tex[TEXTYPE_DIFFUSE]);
+		if(mat.tex[TEXTYPE_ENVMAP]) SetTexture(prog_unit, mat.tex[TEXTYPE_ENVMAP]);
+	} else if(mat.tex[TEXTYPE_DIFFUSE]) {
 		EnableTextureUnit(tex_unit);
 		SetTextureCoordIndex(tex_unit, 0);
 		SetTextureUnitColor(tex_unit, TOP_MODULATE, TARG_TEXTURE, TARG_PREV);
 		SetTextureUnitAlpha(tex_unit, TOP_MODULATE, TARG_TEXTURE, TARG_PREV);
+		SetTextureCoordGenerator(tex_unit, TEXGEN_NONE);
 		SetTexture(tex_unit, mat.tex[TEXTYPE_DIFFUSE]);
 		//tex_id = mat.tex[TEXTYPE_DIFFUSE]->tex_id;
 		tex_unit++;
 	}
 	
-	if(mat.tex[TEXTYPE_ENVMAP]) {
+	if(!prog && mat.tex[TEXTYPE_ENVMAP]) {
 		EnableTextureUnit(tex_unit);
 		SetTextureUnitColor(tex_unit, TOP_ADD, TARG_TEXTURE, TARG_PREV);
 		SetTextureUnitAlpha(tex_unit, TOP_MODULATE, TARG_PREV, TARG_TEXTURE);
-		glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-		glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-		glEnable(GL_TEXTURE_GEN_S);
-		glEnable(GL_TEXTURE_GEN_T);
+		SetTextureCoordGenerator(tex_unit, TEXGEN_SPHERE_MAP);
 		SetTexture(tex_unit, mat.tex[TEXTYPE_ENVMAP]);
 		//tex_id = mat.tex[TEXTYPE_ENVMAP]->tex_id;
 		tex_unit++;
 	}
+
+	if(clear_units && !prog) {
+		// units left enabled by the previous object
+		int units = GetTextureUnitCount();
+		for(int i=tex_unit; i<MAX_TEXTURES && i<units; i++) {
+			DisableTextureUnit(i);
+		}
+	}
 	
 	::SetZWrite(render_params.zwrite);
 	SetShadingMode(render_params.shading);
 	SetAlphaBlending(render_params.blending);
 	//SetAlphaBlending(true);
 	SetBlendFunc(render_params.src_blend, render_params.dest_blend);
-	
-	Draw(*mesh.GetVertexArray(), *mesh.GetIndexArray());
+	return tex_unit;
+}
 
+void Object::ResetRenderStates(int tex_units) {
+	SetProgram(0);
 	//SetAlphaBlending(false);
 	if(render_params.blending) SetAlphaBlending(false);
 	if(render_params.zwrite) ::SetZWrite(true);
 	if(render_params.shading == SHADING_FLAT) SetShadingMode(SHADING_GOURAUD);
 	
-	for(int i=0; i<tex_unit; i++) {
+	for(int i=0; i<tex_units; i++) {
 		DisableTextureUnit(i);
-		glDisable(GL_TEXTURE_GEN_S);
-		glDisable(GL_TEXTURE_GEN_T);
+		SetTextureCoordGenerator(i, TEXGEN_NONE);
+	}
+}
+
+void Object::RenderInstances(const Matrix4x4 *xforms, int count, const Color *emissive, const scalar_t *alpha) {
+	if(count <= 0) return;
+
+	int tex_units = SetRenderStates(false);
+	const VertexArray *varray = mesh.GetVertexArray();
+	const IndexArray *iarray = mesh.GetIndexArray();
+
+	// batches of MAT_MAX_INSTANCES with the instanced variant of the material program
+	unsigned int inst_prog = 0;
+	if(GetProgram() && GetSystemCapabilities().draw_instanced) {
+		inst_prog = GetMaterialProgram(GetMaterialFeatures(mat) | MATF_INSTANCED);
+	}
+
+	if(inst_prog) {
+		SetProgram(inst_prog);
+		SetMatrix(XFORM_WORLD, xforms[count - 1]);
+
+		float mv[MAT_MAX_INSTANCES * 16], color[MAT_MAX_INSTANCES * 4];
+		for(int first=0; first<count; first+=MAT_MAX_INSTANCES) {
+			int batch = count - first < MAT_MAX_INSTANCES ? count - first : MAT_MAX_INSTANCES;
+			for(int i=0; i<batch; i++) {
+				Matrix4x4 xform = (view_matrix * xforms[first + i]).Transposed();
+				memcpy(mv + i * 16, xform.OpenGLMatrix(), 16 * sizeof *mv);
+
+				const Color &ems = emissive ? emissive[first + i] : mat.emissive_color;
+				color[i * 4] = ems.r;
+				color[i * 4 + 1] = ems.g;
+				color[i * 4 + 2] = ems.b;
+				color[i * 4 + 3] = mat.diffuse_color.a * (alpha ? alpha[first + i] : mat.alpha);
+			}
+			SetMaterialInstances(inst_prog, mv, color, batch);
+			DrawInstanced(*varray, *iarray, batch);
+		}
+		world_mat = xforms[count - 1];
+
+		ResetRenderStates(tex_units);
+		return;
 	}
+
+	// one draw per instance on hardware without GLSL or instancing
+	Material inst_mat = mat;
+	for(int i=0; i<count; i++) {
+		SetMatrix(XFORM_WORLD, xforms[i]);
+		if(emissive || alpha) {
+			if(emissive) inst_mat.emissive_color = emissive[i];
+			if(alpha) inst_mat.alpha = alpha[i];
+			::SetMaterial(inst_mat);
+		}
+		Draw(*varray, *iarray);
+	}
+	world_mat = xforms[count - 1];
+
+	ResetRenderStates(tex_units);
 }
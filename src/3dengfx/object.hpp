@@ -37,7 +37,9 @@ private:
 	//void Render2TexUnits();
 	//void Render4TexUnits();
 	void Render8TexUnits();
-	void RenderHack();
+	void RenderHack(bool restore_state);
+	int SetRenderStates(bool clear_units);
+	void ResetRenderStates(int tex_units);
 	
 public:
 	std::string name;
@@ -51,6 +53,9 @@ public:
 
 	void SetDynamic(bool enable);
 	bool GetDynamic() const;
+
+	// for meshes rewritten every frame (see GeometryArray::SetStreaming)
+	void SetStreaming(bool enable);
 	
 	void SetMaterial(const Material &mat);
 	Material *GetMaterialPtr();
@@ -66,7 +71,19 @@ public:
 	void SetBlendingMode(BlendingFactor sblend, BlendingFactor dblend);
 	void SetWireframe(bool enable);
 		
-	void Render(unsigned long time = XFORM_LOCAL_PRS);
+	/* restore_state false leaves the render states of the object set, for
+	 * drawing many objects in a row (see Scene::Render).
+	 */
+	void Render(unsigned long time = XFORM_LOCAL_PRS, bool restore_state = true);
+	void Render(const Matrix4x4 &xform, bool restore_state = true);	// world xform given
+
+	/* draws the mesh count times with the given world transformations,
+	 * setting up the render states only once. emissive and alpha, when not
+	 * 0, replace the material's emissive color and alpha per instance.
+	 * With a material program and GL_ARB_draw_instanced the instances are
+	 * drawn in batches with DrawInstanced, otherwise one by one.
+	 */
+	void RenderInstances(const Matrix4x4 *xforms, int count, const Color *emissive = 0, const scalar_t *alpha = 0);
 };
 
 #endif	// _OBJECT_HPP_
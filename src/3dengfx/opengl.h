@@ -53,12 +53,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 extern PFNGLLOADTRANSPOSEMATRIXFARBPROC glLoadTransposeMatrixf;
 extern PFNGLACTIVETEXTUREARBPROC glActiveTexture;
 extern PFNGLCLIENTACTIVETEXTUREARBPROC glClientActiveTexture;
+extern PFNGLCOMPRESSEDTEXIMAGE2DARBPROC glCompressedTexImage2D;
 #endif	/* OPENGL_1_3 */
 
 //#ifndef OPENGL_1_5
 /* GL_ARB_vertex_array_object */
 extern PFNGLBINDBUFFERARBPROC glBindBuffer;
 extern PFNGLBUFFERDATAARBPROC glBufferData;
+extern PFNGLBUFFERSUBDATAARBPROC glBufferSubData;
 extern PFNGLDELETEBUFFERSARBPROC glDeleteBuffers;
 extern PFNGLISBUFFERARBPROC glIsBuffer;
 extern PFNGLMAPBUFFERARBPROC glMapBuffer;
@@ -66,4 +68,66 @@ extern PFNGLUNMAPBUFFERARBPROC glUnmapBuffer;
 extern PFNGLGENBUFFERSARBPROC glGenBuffers;
 //#endif	/* OPENGL_1_5 */
 
+/* GL_EXT_framebuffer_object */
+extern PFNGLGENFRAMEBUFFERSEXTPROC glGenFramebuffers;
+extern PFNGLDELETEFRAMEBUFFERSEXTPROC glDeleteFramebuffers;
+extern PFNGLBINDFRAMEBUFFEREXTPROC glBindFramebuffer;
+extern PFNGLFRAMEBUFFERTEXTURE2DEXTPROC glFramebufferTexture2D;
+extern PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC glFramebufferRenderbuffer;
+extern PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC glCheckFramebufferStatus;
+extern PFNGLGENRENDERBUFFERSEXTPROC glGenRenderbuffers;
+extern PFNGLDELETERENDERBUFFERSEXTPROC glDeleteRenderbuffers;
+extern PFNGLBINDRENDERBUFFEREXTPROC glBindRenderbuffer;
+extern PFNGLRENDERBUFFERSTORAGEEXTPROC glRenderbufferStorage;
+
+/* GL_ARB_shader_objects */
+extern PFNGLCREATESHADEROBJECTARBPROC glCreateShaderObject;
+extern PFNGLSHADERSOURCEARBPROC glShaderSource;
+extern PFNGLCOMPILESHADERARBPROC glCompileShader;
+extern PFNGLCREATEPROGRAMOBJECTARBPROC glCreateProgramObject;
+extern PFNGLATTACHOBJECTARBPROC glAttachObject;
+extern PFNGLLINKPROGRAMARBPROC glLinkProgram;
+extern PFNGLUSEPROGRAMOBJECTARBPROC glUseProgramObject;
+extern PFNGLDELETEOBJECTARBPROC glDeleteObject;
+extern PFNGLGETOBJECTPARAMETERIVARBPROC glGetObjectParameteriv;
+extern PFNGLGETINFOLOGARBPROC glGetInfoLog;
+extern PFNGLGETUNIFORMLOCATIONARBPROC glGetUniformLocation;
+extern PFNGLUNIFORM1IARBPROC glUniform1i;
+extern PFNGLUNIFORM1FARBPROC glUniform1f;
+extern PFNGLUNIFORM2FARBPROC glUniform2f;
+extern PFNGLUNIFORM4FVARBPROC glUniform4fv;
+extern PFNGLUNIFORMMATRIX4FVARBPROC glUniformMatrix4fv;
+
+/* GL_ARB_timer_query (and the query objects of GL_ARB_occlusion_query) */
+extern PFNGLGENQUERIESARBPROC glGenQueries;
+extern PFNGLDELETEQUERIESARBPROC glDeleteQueries;
+extern PFNGLGETQUERYOBJECTIVARBPROC glGetQueryObjectiv;
+extern PFNGLQUERYCOUNTERPROC glQueryCounter;
+extern PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+
+/* GL_ARB_draw_instanced */
+extern PFNGLDRAWELEMENTSINSTANCEDARBPROC glDrawElementsInstanced;
+
+/* GL_ARB_map_buffer_range */
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+
+/* GL_ARB_get_program_binary */
+extern PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+extern PFNGLGETPROGRAMIVPROC glGetProgramiv;
+
+/* OpenGL 2.0 program objects, used instead of the GL_ARB_shader_objects
+ * handles when program binaries are available (SysCaps::program_binary)
+ */
+extern PFNGLCREATESHADERPROC glCreateShader;
+extern PFNGLDELETESHADERPROC glDeleteShader;
+extern PFNGLGETSHADERIVPROC glGetShaderiv;
+extern PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+extern PFNGLCREATEPROGRAMPROC glCreateProgram;
+extern PFNGLATTACHSHADERPROC glAttachShader;
+extern PFNGLDELETEPROGRAMPROC glDeleteProgram;
+extern PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+extern PFNGLUSEPROGRAMPROC glUseProgram;
+
 #endif	/* _OPENGL_H_ */
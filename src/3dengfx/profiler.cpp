@@ -0,0 +1,331 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "opengl.h"
+#include "3denginefx.hpp"
+#include "profiler.hpp"
+
+#if defined(unix) || defined(__unix__)
+#include <sys/time.h>
+#else	// assume win32
+#include <windows.h>
+#endif	// defined(unix) || defined(__unix__)
+
+using std::vector;
+using std::cerr;
+
+#define HIST_SIZE		1024		// frames kept for the percentiles
+#define MAX_EVENTS		(1 << 20)	// trace events kept for the dump
+#define MAX_DEPTH		64
+#define GPU_FRAMES		4			// frames in flight before reading queries back
+#define GPU_QUERIES		512			// timestamp queries per frame
+
+bool prof_enabled;
+
+struct Zone {
+	char *name;
+	unsigned long calls;
+	double total_cpu, total_gpu;		// usec
+	double frame_cpu, frame_gpu;
+	bool in_frame;
+	float cpu_hist[HIST_SIZE], gpu_hist[HIST_SIZE];	// msec per frame
+	int cpu_count, gpu_count;
+};
+
+struct Event {
+	int zone;
+	double start, dur;	// usec
+};
+
+struct OpenZone {
+	int zone;
+	double start;
+	int query;
+};
+
+struct GpuRange {
+	int zone;
+	int begin_query, end_query;
+};
+
+struct GpuFrame {
+	unsigned int query[GPU_QUERIES];
+	int used;
+	double cpu_start;
+	vector<GpuRange> ranges;
+};
+
+static vector<Zone*> zones;
+static vector<Event> cpu_events, gpu_events;
+
+static OpenZone stack[MAX_DEPTH];
+static int depth;
+
+static bool use_gpu;
+static GpuFrame gpu_frame[GPU_FRAMES];
+static int cur_gpu_frame;
+static unsigned long frame_count;
+
+static double start_usec;
+
+static double GetMicroSec() {
+#if defined(unix) || defined(__unix__)
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (double)tv.tv_sec * 1000000.0 + (double)tv.tv_usec;
+#else
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if(!freq.QuadPart) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart * 1000000.0 / (double)freq.QuadPart;
+#endif
+}
+
+void EnableProfiler(bool enable) {
+	if(enable && !start_usec) {
+		start_usec = GetMicroSec();
+
+		use_gpu = GetSystemCapabilities().timer_query;
+		if(use_gpu) {
+			for(int i=0; i<GPU_FRAMES; i++) {
+				glGenQueries(GPU_QUERIES, gpu_frame[i].query);
+			}
+		}
+		gpu_frame[cur_gpu_frame].cpu_start = 0.0;
+	}
+	prof_enabled = enable;
+}
+
+int ProfZone(const char *name) {
+	for(size_t i=0; i<zones.size(); i++) {
+		if(!strcmp(zones[i]->name, name)) return (int)i;
+	}
+
+	Zone *z = new Zone;
+	memset(z, 0, sizeof *z);
+	z->name = new char[strlen(name) + 1];
+	strcpy(z->name, name);
+	zones.push_back(z);
+	return (int)zones.size() - 1;
+}
+
+static int IssueTimestamp() {
+	GpuFrame *gf = gpu_frame + cur_gpu_frame;
+	if(gf->used >= GPU_QUERIES) return -1;
+
+	glQueryCounter(gf->query[gf->used], GL_TIMESTAMP);
+	return gf->used++;
+}
+
+void ProfBegin(int zone) {
+	if(depth >= MAX_DEPTH) return;
+
+	OpenZone *oz = stack + depth++;
+	oz->zone = zone;
+	oz->query = use_gpu ? IssueTimestamp() : -1;
+	oz->start = GetMicroSec() - start_usec;
+}
+
+void ProfEnd(int zone) {
+	if(!depth || stack[depth - 1].zone != zone) return;	// unbalanced
+
+	double now = GetMicroSec() - start_usec;
+	OpenZone *oz = stack + --depth;
+	Zone *z = zones[zone];
+
+	double dur = now - oz->start;
+	z->calls++;
+	z->total_cpu += dur;
+	z->frame_cpu += dur;
+	z->in_frame = true;
+
+	if(cpu_events.size() < MAX_EVENTS) {
+		Event ev = {zone, oz->start, dur};
+		cpu_events.push_back(ev);
+	}
+
+	if(oz->query != -1) {
+		int end_query = IssueTimestamp();
+		if(end_query != -1) {
+			GpuRange r = {zone, oz->query, end_query};
+			gpu_frame[cur_gpu_frame].ranges.push_back(r);
+		}
+	}
+}
+
+static void PushHist(float *hist, int *count, float val) {
+	hist[*count % HIST_SIZE] = val;
+	(*count)++;
+}
+
+/* reads back the timestamps of a frame issued GPU_FRAMES ago, by now
+ * they should be available and this doesn't stall the pipeline.
+ */
+static void ResolveGpuFrame(GpuFrame *gf) {
+	if(gf->ranges.empty()) {
+		gf->used = 0;
+		return;
+	}
+
+	// the first query of the frame is the earliest timestamp
+	GLuint64 base;
+	glGetQueryObjectui64v(gf->query[0], GL_QUERY_RESULT, &base);
+
+	for(size_t i=0; i<gf->ranges.size(); i++) {
+		GpuRange *r = &gf->ranges[i];
+		GLuint64 t0, t1;
+		glGetQueryObjectui64v(gf->query[r->begin_query], GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(gf->query[r->end_query], GL_QUERY_RESULT, &t1);
+
+		double dur = (double)(t1 - t0) / 1000.0;
+		Zone *z = zones[r->zone];
+		z->total_gpu += dur;
+		z->frame_gpu += dur;
+
+		// GPU events are placed on the trace relative to the frame's CPU start
+		if(gpu_events.size() < MAX_EVENTS) {
+			Event ev = {r->zone, gf->cpu_start + (double)(t0 - base) / 1000.0, dur};
+			gpu_events.push_back(ev);
+		}
+	}
+
+	for(size_t i=0; i<zones.size(); i++) {
+		Zone *z = zones[i];
+		if(z->frame_gpu > 0.0) {
+			PushHist(z->gpu_hist, &z->gpu_count, (float)(z->frame_gpu / 1000.0));
+			z->frame_gpu = 0.0;
+		}
+	}
+
+	gf->ranges.clear();
+	gf->used = 0;
+}
+
+void ProfFrame() {
+	if(!prof_enabled) return;
+
+	for(size_t i=0; i<zones.size(); i++) {
+		Zone *z = zones[i];
+		if(z->in_frame) {
+			PushHist(z->cpu_hist, &z->cpu_count, (float)(z->frame_cpu / 1000.0));
+			z->frame_cpu = 0.0;
+			z->in_frame = false;
+		}
+	}
+	frame_count++;
+
+	if(use_gpu) {
+		cur_gpu_frame = (cur_gpu_frame + 1) % GPU_FRAMES;
+		ResolveGpuFrame(gpu_frame + cur_gpu_frame);
+		gpu_frame[cur_gpu_frame].cpu_start = GetMicroSec() - start_usec;
+	}
+}
+
+static float Percentile(const float *hist, int count, float p) {
+	if(!count) return 0.0f;
+	if(count > HIST_SIZE) count = HIST_SIZE;
+
+	vector<float> sorted(hist, hist + count);
+	std::sort(sorted.begin(), sorted.end());
+	int idx = (int)(p * (count - 1) + 0.5f);
+	return sorted[idx];
+}
+
+static void WriteName(FILE *fp, const char *name) {
+	fputc('"', fp);
+	while(*name) {
+		if(*name == '"' || *name == '\\') fputc('\\', fp);
+		fputc(*name++, fp);
+	}
+	fputc('"', fp);
+}
+
+static void WriteTrace(FILE *fp) {
+	fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+	fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+
+	const vector<Event> *ev_list[] = {&cpu_events, &gpu_events};
+	for(int i=0; i<2; i++) {
+		const vector<Event> &events = *ev_list[i];
+		for(size_t j=0; j<events.size(); j++) {
+			fprintf(fp, ",\n{\"name\": ");
+			WriteName(fp, zones[events[j].zone]->name);
+			fprintf(fp, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+					i + 1, events[j].start, events[j].dur);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+}
+
+static void WriteCSV(FILE *fp) {
+	fprintf(fp, "zone,calls,cpu_total_ms,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,gpu_total_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms\n");
+	for(size_t i=0; i<zones.size(); i++) {
+		const Zone *z = zones[i];
+		fprintf(fp, "%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", z->name, z->calls,
+				z->total_cpu / 1000.0, Percentile(z->cpu_hist, z->cpu_count, 0.5f),
+				Percentile(z->cpu_hist, z->cpu_count, 0.95f), Percentile(z->cpu_hist, z->cpu_count, 0.99f),
+				z->total_gpu / 1000.0, Percentile(z->gpu_hist, z->gpu_count, 0.5f),
+				Percentile(z->gpu_hist, z->gpu_count, 0.95f), Percentile(z->gpu_hist, z->gpu_count, 0.99f));
+	}
+}
+
+bool ProfDump(const char *fname) {
+	if(!start_usec) return false;
+
+	// collect whatever the GPU has finished with
+	if(use_gpu) {
+		glFinish();
+		for(int i=1; i<=GPU_FRAMES; i++) {
+			ResolveGpuFrame(gpu_frame + (cur_gpu_frame + i) % GPU_FRAMES);
+		}
+	}
+
+	fprintf(stderr, "profile (%lu frames, msec per frame of the last %d)\n", frame_count, HIST_SIZE);
+	fprintf(stderr, "%-24s %8s %8s %8s %8s %8s %8s\n", "zone", "cpu p50", "p95", "p99", "gpu p50", "p95", "p99");
+	for(size_t i=0; i<zones.size(); i++) {
+		const Zone *z = zones[i];
+		fprintf(stderr, "%-24s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", z->name,
+				Percentile(z->cpu_hist, z->cpu_count, 0.5f), Percentile(z->cpu_hist, z->cpu_count, 0.95f),
+				Percentile(z->cpu_hist, z->cpu_count, 0.99f), Percentile(z->gpu_hist, z->gpu_count, 0.5f),
+				Percentile(z->gpu_hist, z->gpu_count, 0.95f), Percentile(z->gpu_hist, z->gpu_count, 0.99f));
+	}
+
+	FILE *fp = fopen(fname, "w");
+	if(!fp) {
+		cerr << "ProfDump: could not open " << fname << " for writing\n";
+		return false;
+	}
+
+	const char *suffix = strrchr(fname, '.');
+	if(suffix && !strcmp(suffix, ".csv")) {
+		WriteCSV(fp);
+	} else {
+		WriteTrace(fp);
+	}
+	fclose(fp);
+	return true;
+}
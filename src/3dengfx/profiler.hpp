@@ -0,0 +1,62 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PROFILER_HPP_
+#define _PROFILER_HPP_
+
+/* Frame profiler: named zones measured on the CPU and, when
+ * GL_ARB_timer_query is available, on the GPU. Zones nest. Use the
+ * PROF_SCOPE macro to time a block, it costs a branch when the profiler
+ * is disabled.
+ */
+
+extern bool prof_enabled;
+
+void EnableProfiler(bool enable);
+inline bool ProfilerEnabled() {return prof_enabled;}
+
+// returns the id for the named zone, registering it on the first call
+int ProfZone(const char *name);
+
+void ProfBegin(int zone);
+void ProfEnd(int zone);
+
+// marks the end of a frame, call once per frame after rendering
+void ProfFrame();
+
+/* writes the collected data, as CSV (p50/p95/p99 per zone) if the file
+ * name ends in .csv, otherwise as a chrome://tracing trace_event JSON.
+ * A summary is printed to stderr in both cases.
+ */
+bool ProfDump(const char *fname);
+
+class ProfScope {
+private:
+	int zone;
+public:
+	ProfScope(int zone) : zone(zone) {if(prof_enabled) ProfBegin(zone);}
+	~ProfScope() {if(prof_enabled) ProfEnd(zone);}
+};
+
+#define PROF_SCOPE(name) \
+	static const int prof_zone = ProfZone(name); \
+	ProfScope prof_scope(prof_zone)
+
+#endif	// _PROFILER_HPP_
@@ -22,8 +22,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <string>
 #include <cassert>
 #include <cctype>
+#include <SDL.h>
 #include "3dengfx.hpp"
 #include "sceneloader.hpp"
+#include "loader.hpp"
 #include "3dschunks.h"
 
 using std::string;
@@ -45,6 +47,26 @@ namespace SceneLoader {
 	string ObjectName;
 
 	bool SaveNormalFile = false;
+
+	/* the parser state above is global, loads from the loader threads are
+	 * serialized. The lock is created by StartLoader (through InitLock).
+	 */
+	SDL_mutex *lock;
+
+	inline void LockLoader() {
+		if(lock) SDL_LockMutex(lock);
+	}
+
+	inline void UnlockLoader() {
+		if(lock) SDL_UnlockMutex(lock);
+	}
+}
+
+bool SceneLoader::InitLock() {
+	if(!lock && !(lock = SDL_CreateMutex())) {
+		return false;
+	}
+	return true;
 }
 
 using namespace SceneLoader;
@@ -100,7 +122,13 @@ static void SaveNormalsToFile(const char *fname, Scene *scene);
 
 
 void SceneLoader::SetDataPath(const char *path) {
+	LockLoader();
 	datapath = path;
+	UnlockLoader();
+}
+
+const char *SceneLoader::GetDataPath() {
+	return datapath.c_str();
 }
 
 void SceneLoader::SetNormalFileSaving(bool enable) {
@@ -116,7 +144,41 @@ void SceneLoader::SetNormalFileSaving(bool enable) {
 // the data from specified file       //
 ////////////////////////////////////////
 
+static bool LoadSceneFile(const char *fname, Scene **scene);
+static bool LoadObjectFile(const char *fname, const char *ObjectName, Object **obj);
+
 bool SceneLoader::LoadScene(const char *fname, Scene **scene) {
+	LockLoader();
+	string path = datapath;
+	UnlockLoader();
+
+	// the loader threads may have parsed it already
+	if((*scene = TakeLoadedScene(fname, path.c_str()))) return true;
+
+	LockLoader();
+	bool res = LoadSceneFile(fname, scene);
+	UnlockLoader();
+	return res;
+}
+
+bool SceneLoader::LoadScene(const char *fname, Scene **scene, const char *path) {
+	LockLoader();
+	string prev_path = datapath;
+	datapath = path;
+	bool res = LoadSceneFile(fname, scene);
+	datapath = prev_path;
+	UnlockLoader();
+	return res;
+}
+
+bool SceneLoader::LoadObject(const char *fname, const char *ObjectName, Object **obj) {
+	LockLoader();
+	bool res = LoadObjectFile(fname, ObjectName, obj);
+	UnlockLoader();
+	return res;
+}
+
+static bool LoadSceneFile(const char *fname, Scene **scene) {
 	if(!LoadMaterials(fname, &mat)) return false;
 
 	FILE *file = fopen(fname, "rb");
@@ -220,7 +282,7 @@ bool SceneLoader::LoadScene(const char *fname, Scene **scene) {
 
 
 
-bool SceneLoader::LoadObject(const char *fname, const char *ObjectName, Object **obj) {
+static bool LoadObjectFile(const char *fname, const char *ObjectName, Object **obj) {
 	if(!LoadMaterials(fname, &mat)) return false;
 
 	FILE *file = fopen(fname, "rb");
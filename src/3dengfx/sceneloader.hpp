@@ -27,11 +27,17 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 namespace SceneLoader {
 	void SetDataPath(const char *path);
+	const char *GetDataPath();
 	void SetNormalFileSaving(bool enable);
 
 	bool LoadObject(const char *fname, const char *objname, Object **obj);
 	bool LoadScene(const char *fname, Scene **scene);
+	// same as above, with an explicit texture path instead of the one set by SetDataPath
+	bool LoadScene(const char *fname, Scene **scene, const char *path);
 	bool LoadMaterials(const char *fname, Material **materials);
+
+	// creates the lock serializing the loads, StartLoader calls it
+	bool InitLock();
 }
 
 #endif	// _SCENELOADER_H_
@@ -0,0 +1,240 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string>
+#include "opengl.h"
+#include "shaders.hpp"
+#include "3denginefx.hpp"
+
+static unsigned int cur_prog;
+static bool prog_known = true;		// false after InvalidateProgramCache
+
+/* with program binaries the programs are OpenGL 2.0 program objects, since
+ * glProgramBinary and glGetProgramiv don't take GL_ARB_shader_objects
+ * handles. Without them the ARB handles are used and nothing is cached.
+ */
+static inline bool CoreObjects() {
+	return GetSystemCapabilities().program_binary;
+}
+
+static void LogInfo(unsigned int obj, bool prog, const char *what) {
+	int len = 0;
+	if(!CoreObjects()) {
+		glGetObjectParameteriv(obj, GL_OBJECT_INFO_LOG_LENGTH_ARB, &len);
+	} else if(prog) {
+		glGetProgramiv(obj, GL_INFO_LOG_LENGTH, &len);
+	} else {
+		glGetShaderiv(obj, GL_INFO_LOG_LENGTH, &len);
+	}
+	if(len <= 1) return;
+
+	char *info = new char[len + 1];
+	if(!CoreObjects()) {
+		glGetInfoLog(obj, len, 0, info);
+	} else if(prog) {
+		glGetProgramInfoLog(obj, len, 0, info);
+	} else {
+		glGetShaderInfoLog(obj, len, 0, info);
+	}
+	info[len] = 0;
+	EngineLog(std::string(what) + ":\n" + info + "\n");
+	delete [] info;
+}
+
+static void DeleteShader(unsigned int sdr) {
+	if(CoreObjects()) {
+		glDeleteShader(sdr);
+	} else {
+		glDeleteObject(sdr);
+	}
+}
+
+static void DeleteProgram(unsigned int prog) {
+	if(CoreObjects()) {
+		glDeleteProgram(prog);
+	} else {
+		glDeleteObject(prog);
+	}
+}
+
+static bool LinkStatus(unsigned int prog) {
+	int status;
+	if(CoreObjects()) {
+		glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	} else {
+		glGetObjectParameteriv(prog, GL_OBJECT_LINK_STATUS_ARB, &status);
+	}
+	return status != 0;
+}
+
+static unsigned int CreateShader(GLenum type, const char *src) {
+	unsigned int sdr = CoreObjects() ? glCreateShader(type) : glCreateShaderObject(type);
+	glShaderSource(sdr, 1, &src, 0);
+	glCompileShader(sdr);
+
+	int status;
+	if(CoreObjects()) {
+		glGetShaderiv(sdr, GL_COMPILE_STATUS, &status);
+	} else {
+		glGetObjectParameteriv(sdr, GL_OBJECT_COMPILE_STATUS_ARB, &status);
+	}
+	LogInfo(sdr, false, status ? "shader compiler warnings" : "shader compilation failed");
+	if(!status) {
+		DeleteShader(sdr);
+		return 0;
+	}
+	return sdr;
+}
+
+unsigned int CreateProgram(const char *vsrc, const char *psrc, bool retrievable) {
+	if(!GetSystemCapabilities().glslang) return 0;
+
+	unsigned int vsdr = 0, psdr = 0;
+	if(vsrc && !(vsdr = CreateShader(GL_VERTEX_SHADER_ARB, vsrc))) {
+		return 0;
+	}
+	if(psrc && !(psdr = CreateShader(GL_FRAGMENT_SHADER_ARB, psrc))) {
+		if(vsdr) DeleteShader(vsdr);
+		return 0;
+	}
+
+	unsigned int prog;
+	if(CoreObjects()) {
+		prog = glCreateProgram();
+		if(vsdr) glAttachShader(prog, vsdr);
+		if(psdr) glAttachShader(prog, psdr);
+		if(retrievable) {
+			glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+	} else {
+		prog = glCreateProgramObject();
+		if(vsdr) glAttachObject(prog, vsdr);
+		if(psdr) glAttachObject(prog, psdr);
+	}
+	glLinkProgram(prog);
+
+	// the program keeps them around for as long as it needs them
+	if(vsdr) DeleteShader(vsdr);
+	if(psdr) DeleteShader(psdr);
+
+	bool status = LinkStatus(prog);
+	LogInfo(prog, true, status ? "shader linker warnings" : "shader linking failed");
+	if(!status) {
+		DeleteProgram(prog);
+		return 0;
+	}
+	return prog;
+}
+
+unsigned int CreateProgramFromBinary(unsigned int format, const void *bin, int size) {
+	if(!GetSystemCapabilities().program_binary) return 0;
+
+	unsigned int prog = glCreateProgram();
+	glProgramBinary(prog, format, bin, size);
+	if(!LinkStatus(prog)) {
+		glDeleteProgram(prog);
+		return 0;
+	}
+	return prog;
+}
+
+int GetProgramBinarySize(unsigned int prog) {
+	if(!GetSystemCapabilities().program_binary) return 0;
+
+	int size = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+	return size > 0 ? size : 0;
+}
+
+void GetProgramBinary(unsigned int prog, void *buf, int size, unsigned int *format) {
+	GLenum fmt = 0;
+	glGetProgramBinary(prog, size, 0, &fmt, buf);
+	*format = fmt;
+}
+
+void DestroyProgram(unsigned int prog) {
+	if(!prog) return;
+	if(prog == cur_prog) SetProgram(0);
+	DeleteProgram(prog);
+}
+
+void SetProgram(unsigned int prog) {
+	if(!prog_known || prog != cur_prog) {
+		if(CoreObjects()) {
+			glUseProgram(prog);
+		} else {
+			glUseProgramObject(prog);
+		}
+		cur_prog = prog;
+		prog_known = true;
+	}
+}
+
+unsigned int GetProgram() {
+	return cur_prog;
+}
+
+void InvalidateProgramCache() {
+	prog_known = false;
+}
+
+void SetUniform(unsigned int prog, const char *name, int val) {
+	int loc = glGetUniformLocation(prog, name);
+	if(loc != -1) glUniform1i(loc, val);
+}
+
+void SetUniform(unsigned int prog, const char *name, float val) {
+	int loc = glGetUniformLocation(prog, name);
+	if(loc != -1) glUniform1f(loc, val);
+}
+
+void SetUniform(unsigned int prog, const char *name, float x, float y) {
+	int loc = glGetUniformLocation(prog, name);
+	if(loc != -1) glUniform2f(loc, x, y);
+}
+
+void SetUniform4v(unsigned int prog, const char *name, const float *vec, int count) {
+	int loc = glGetUniformLocation(prog, name);
+	if(loc != -1) glUniform4fv(loc, count, vec);
+}
+
+int GetUniformLocation(unsigned int prog, const char *name) {
+	return glGetUniformLocation(prog, name);
+}
+
+void SetUniform(int loc, int val) {
+	if(loc != -1) glUniform1i(loc, val);
+}
+
+void SetUniform(int loc, float val) {
+	if(loc != -1) glUniform1f(loc, val);
+}
+
+void SetUniform(int loc, float x, float y) {
+	if(loc != -1) glUniform2f(loc, x, y);
+}
+
+void SetUniform4v(int loc, const float *vec, int count) {
+	if(loc != -1) glUniform4fv(loc, count, vec);
+}
+
+void SetUniformMatrix4v(int loc, const float *mat, int count) {
+	if(loc != -1) glUniformMatrix4fv(loc, count, GL_FALSE, mat);
+}
@@ -0,0 +1,67 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _SHADERS_HPP_
+#define _SHADERS_HPP_
+
+/* GLSL programs, available when SysCaps::glslang is set. They are OpenGL
+ * 2.0 program objects when SysCaps::program_binary is set, and
+ * GL_ARB_shader_objects handles otherwise. vsrc may be 0 to keep the fixed
+ * function vertex processing. CreateProgram returns 0 on failure, the
+ * compiler and linker messages go to the engine log. retrievable asks the
+ * driver to keep the program binary around for GetProgramBinary.
+ */
+unsigned int CreateProgram(const char *vsrc, const char *psrc, bool retrievable = false);
+void DestroyProgram(unsigned int prog);
+
+/* program binaries, only with SysCaps::program_binary. CreateProgramFromBinary
+ * returns 0 if the driver rejects the binary, GetProgramBinarySize returns 0
+ * if there's none to get.
+ */
+unsigned int CreateProgramFromBinary(unsigned int format, const void *bin, int size);
+int GetProgramBinarySize(unsigned int prog);
+void GetProgramBinary(unsigned int prog, void *buf, int size, unsigned int *format);
+
+// 0 goes back to the fixed function pipeline
+void SetProgram(unsigned int prog);
+unsigned int GetProgram();
+
+// forgets the current program after direct GL calls, see InvalidateStateCache
+void InvalidateProgramCache();
+
+// uniforms of the current program, unknown names are ignored
+void SetUniform(unsigned int prog, const char *name, int val);
+void SetUniform(unsigned int prog, const char *name, float val);
+void SetUniform(unsigned int prog, const char *name, float x, float y);
+void SetUniform4v(unsigned int prog, const char *name, const float *vec, int count);
+
+/* same as above with a location from GetUniformLocation, for programs
+ * set every frame. Locations stay valid until the program is relinked,
+ * -1 (unknown names) is ignored.
+ */
+int GetUniformLocation(unsigned int prog, const char *name);
+void SetUniform(int loc, int val);
+void SetUniform(int loc, float val);
+void SetUniform(int loc, float x, float y);
+void SetUniform4v(int loc, const float *vec, int count);
+// count column major 4x4 matrices
+void SetUniformMatrix4v(int loc, const float *mat, int count);
+
+#endif	// _SHADERS_HPP_
@@ -21,74 +21,311 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <map>
 #include <cstring>
+#include <SDL.h>
 #include "texman.hpp"
-#include "hashtable.hpp"
+#include "loader.hpp"
+#include "3denginefx.hpp"
 extern "C" {
 #include "image.h"
+#include "texfile.h"
 }
 using std::string;
 
-static HashTable<string, Texture*> textures;
-static bool texman_initialized = false;
+/* the texture names, in an open addressing table with linear probing.
+ * The slots keep the hash of their name so that only a matching hash leads
+ * to a string compare, and a lookup doesn't allocate anything. The size is
+ * a power of two, doubled when it gets 3/4 full.
+ */
+struct NameSlot {
+	uint32_t hash;
+	char *name;		// 0 for an empty slot
+	Texture *tex;
+};
+static std::vector<NameSlot> names;
+static size_t name_count;
 
-/*
- * Hashing algorithm for strings from:
- * Sedgewick's "Algorithms in C++, third edition" 
- * parts 1-4, Chapter 14 (hashing) p.593
+#define MIN_NAME_SLOTS	64
+
+// identifies identical images, which share a texture whatever their names
+struct ContentKey {
+	uint32_t hash[2];
+	unsigned long width, height;
+	int format;
+
+	bool operator <(const ContentKey &k) const;
+};
+static std::map<ContentKey, Texture*> tex_contents;
+
+// everything registered, named or not, with its reference count
+struct TexRecord {
+	int refs;
+	bool has_key;
+	ContentKey key;
+};
+static std::map<Texture*, TexRecord> records;
+
+/* the loader threads add textures concurrently with the main thread, the
+ * lock is created by StartLoader (through InitTexManLock) before any of them
+ * runs, until then there's only the main thread and nothing to lock.
  */
-template <class KeyType>
-static unsigned int Hash(const KeyType &key, unsigned long size) {
-	int hash = 0, a = 31415, b = 27183;
-	char *str = strdup(((string)key).c_str());
-	char *sptr = str;
+static SDL_mutex *texman_lock;
 
-	while(*sptr) {
-		hash = (a * hash + *sptr++) % size;
-		a = a * b % (size - 1);
+static inline void LockTexMan() {
+	if(texman_lock) SDL_LockMutex(texman_lock);
+}
+
+static inline void UnlockTexMan() {
+	if(texman_lock) SDL_UnlockMutex(texman_lock);
+}
+
+bool InitTexManLock() {
+	if(!texman_lock && !(texman_lock = SDL_CreateMutex())) {
+		return false;
 	}
+	return true;
+}
 
-	free(str);
+// decoded (or mapped) by a loader thread, waiting for the main thread to upload it
+struct PendingTexture {
+	Texture *tex;
+	Pixel *pixels;
+	TexFile *tf;
+	unsigned long width, height;
+	TextureFormat format;
+};
+static std::vector<PendingTexture> pending;
 
-	return (unsigned int)(hash < 0 ? (hash + size) : hash);
+// FNV-1a
+static uint32_t HashName(const char *str) {
+	uint32_t hash = 2166136261U;
+	while(*str) {
+		hash = (hash ^ (unsigned char)*str++) * 16777619;
+	}
+	return hash;
 }
 
+bool ContentKey::operator <(const ContentKey &k) const {
+	if(hash[0] != k.hash[0]) return hash[0] < k.hash[0];
+	if(hash[1] != k.hash[1]) return hash[1] < k.hash[1];
+	if(width != k.width) return width < k.width;
+	if(height != k.height) return height < k.height;
+	return format < k.format;
+}
 
+// two independent 32bit hashes of the data, good enough to trust a match
+static ContentKey MakeContentKey(const uint32_t *data, unsigned long count,
+		unsigned long width, unsigned long height, TextureFormat fmt) {
+	uint32_t h0 = 2166136261U, h1 = 0x9e3779b9;
+	for(unsigned long i=0; i<count; i++) {
+		h0 = (h0 ^ data[i]) * 16777619;
+		h1 = (h1 ^ data[i]) * 0x5bd1e995;
+		h1 ^= h1 >> 15;
+	}
 
-static void InitTexMan() {
-	textures.SetHashFunction(Hash);
-	texman_initialized = true;
+	ContentKey key;
+	key.hash[0] = h0;
+	key.hash[1] = h1;
+	key.width = width;
+	key.height = height;
+	key.format = fmt;
+	return key;
 }
 
-void AddTexture(Texture *texture, const char *fname) {
+/* the smallest format that holds the image without loss: luminance for
+ * greyscale images, no alpha channel for opaque ones, and only alpha for
+ * white images with transparency (like particle sprites and masks).
+ */
+static TextureFormat ChooseFormat(const Pixel *pixels, unsigned long count) {
+	bool grey = true, white = true, opaque = true;
 
-	if(!texman_initialized) InitTexMan();
+	for(unsigned long i=0; i<count && (grey || opaque); i++) {
+		Pixel p = pixels[i];
+		unsigned int b = p & 0xff, g = (p >> 8) & 0xff, r = (p >> 16) & 0xff;
 
-	if(!fname) {	// enter a randomly named texture
-		textures.Insert(tmpnam(0), texture);
-	} else {
-		textures.Insert(fname, texture);
+		if(r != g || g != b) {
+			grey = white = false;
+		} else if(r != 0xff) {
+			white = false;
+		}
+		if((p >> 24) != 0xff) opaque = false;
+	}
+
+	if(opaque) return grey ? TFMT_L8 : TFMT_RGB8;
+	if(white && GetSystemCapabilities().tex_swizzle) return TFMT_A8;
+	return grey ? TFMT_LA8 : TFMT_RGBA8;
+}
+
+static TexRecord *GetRecord(Texture *texture) {
+	std::map<Texture*, TexRecord>::iterator iter = records.find(texture);
+	if(iter == records.end()) {
+		TexRecord rec;
+		rec.refs = 0;
+		rec.has_key = false;
+		iter = records.insert(std::pair<Texture* const, TexRecord>(texture, rec)).first;
+	}
+	return &iter->second;
+}
+
+static size_t FindSlot(const char *fname, uint32_t hash) {
+	size_t mask = names.size() - 1;
+	size_t i = hash & mask;
+	while(names[i].name && (names[i].hash != hash || strcmp(names[i].name, fname) != 0)) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static void ResizeNames(size_t size) {
+	std::vector<NameSlot> old;
+	old.swap(names);
+
+	NameSlot empty = {0, 0, 0};
+	names.resize(size, empty);
+
+	for(size_t i=0; i<old.size(); i++) {
+		if(old[i].name) {
+			names[FindSlot(old[i].name, old[i].hash)] = old[i];
+		}
+	}
+}
+
+/* empties slot i, moving back the entries of the same probe run that would
+ * not be reachable through the hole, so there's no need for tombstones.
+ */
+static void EraseSlot(size_t i) {
+	size_t mask = names.size() - 1;
+	free(names[i].name);
+
+	size_t j = i;
+	for(;;) {
+		j = (j + 1) & mask;
+		if(!names[j].name) break;
+
+		size_t home = names[j].hash & mask;
+		bool reachable = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+		if(!reachable) {
+			names[i] = names[j];
+			i = j;
+		}
+	}
+	names[i].name = 0;
+	name_count--;
+}
+
+static void AddTextureUnlocked(Texture *texture, const char *fname) {
+	GetRecord(texture);
+	if(!fname) return;
+
+	if((name_count + 1) * 4 > names.size() * 3) {
+		ResizeNames(names.empty() ? MIN_NAME_SLOTS : names.size() * 2);
+	}
+
+	uint32_t hash = HashName(fname);
+	size_t i = FindSlot(fname, hash);
+	if(!names[i].name) {
+		names[i].hash = hash;
+		names[i].name = strdup(fname);
+		name_count++;
+	}
+	names[i].tex = texture;
+}
+
+static void AddContentUnlocked(Texture *texture, const ContentKey &key) {
+	TexRecord *rec = GetRecord(texture);
+	rec->has_key = true;
+	rec->key = key;
+	tex_contents[key] = texture;
+}
+
+static Texture *FindTextureUnlocked(const char *fname) {
+	if(names.empty()) return 0;
+
+	const NameSlot &slot = names[FindSlot(fname, HashName(fname))];
+	return slot.name ? slot.tex : 0;
+}
+
+static void RemoveTextureUnlocked(Texture *texture) {
+	std::map<Texture*, TexRecord>::iterator iter = records.find(texture);
+	if(iter == records.end()) return;
+
+	// the same slot is checked again, another entry may have moved there
+	for(size_t i=0; i<names.size();) {
+		if(names[i].name && names[i].tex == texture) {
+			EraseSlot(i);
+		} else {
+			i++;
+		}
+	}
+
+	if(iter->second.has_key) {
+		tex_contents.erase(iter->second.key);
+	}
+	records.erase(iter);
+
+	for(size_t i=0; i<pending.size(); i++) {
+		if(pending[i].tex == texture) {
+			free(pending[i].pixels);
+			UnmapTexFile(pending[i].tf);
+			pending.erase(pending.begin() + i);
+			break;
+		}
 	}
 }
 
-// TODO: implement this one, after making HashTable remove by value
+void AddTexture(Texture *texture, const char *fname) {
+	LockTexMan();
+	AddTextureUnlocked(texture, fname);
+	UnlockTexMan();
+}
+
+// removes the texture from the database, it's not deleted
 void RemoveTexture(Texture *texture) {
+	LockTexMan();
+	RemoveTextureUnlocked(texture);
+	UnlockTexMan();
 }
 
 Texture *FindTexture(const char *fname) {
+	LockTexMan();
+	Texture *tex = FindTextureUnlocked(fname);
+	UnlockTexMan();
+	return tex;
+}
 
-	if(!texman_initialized) InitTexMan();
 
-	Pair<string, Texture*> *res = textures.Find(fname);
-	return res ? res->val : 0;
-}
+/* maps the baked version of an image (the same name with a .btx extension,
+ * made by tex_bake) if there is one and the hardware can use its format.
+ */
+static TexFile *MapBakedTexture(const char *fname) {
+	string baked = fname;
+	string::size_type dot = baked.rfind('.');
+	if(dot != string::npos && baked.find('/', dot) == string::npos) {
+		baked.erase(dot);
+	}
+	baked += ".btx";
 
+	TexFile *tf = MapTexFile(baked.c_str());
+	if(tf && tf->format != TEXFMT_BGRA8 && !GetSystemCapabilities().s3tc_textures) {
+		UnmapTexFile(tf);
+		tf = 0;
+	}
+	return tf;
+}
 
 /* ----- GetTexture() function -----
  * first looks in the texture database in constant time (hash table)
  * if the texture is already there it just returns the pointer. If the
  * texture is not there it tries to load the image data, create the texture
- * and return it, and if it fails it returns a NULL pointer
+ * and return it, and if it fails it returns a NULL pointer.
+ * Baked textures are preferred over the image itself, their mipmap
+ * levels are uploaded straight from the mapped file. Images are stored in
+ * the smallest format that fits their contents, and an image identical to
+ * one already loaded returns the existing texture under the new name too.
+ * When called from a loader thread the texture is returned right away
+ * but its pixels are only uploaded by UploadPendingTextures().
  */
 Texture *GetTexture(const char *fname) {
 
@@ -96,11 +333,171 @@ Texture *GetTexture(const char *fname) {
 	if((tex = FindTexture(fname))) return tex;
 
 	PixelBuffer pbuf;
-	if(!(pbuf.buffer = (Pixel*)LoadImage(fname, &pbuf.width, &pbuf.height))) {
+	pbuf.width = pbuf.height = 0;
+	TexFile *tf = MapBakedTexture(fname);
+	if(!tf && !(pbuf.buffer = (Pixel*)LoadImage(fname, &pbuf.width, &pbuf.height))) {
 		return 0;
 	}
 
+	TextureFormat fmt;
+	ContentKey key;
+	if(tf) {
+		fmt = GetTexFileFormat(tf);
+		key = MakeContentKey((const uint32_t*)tf->level_data[0], tf->level_size[0] / 4, tf->width, tf->height, fmt);
+	} else {
+		fmt = ChooseFormat(pbuf.buffer, pbuf.width * pbuf.height);
+		key = MakeContentKey(pbuf.buffer, pbuf.width * pbuf.height, pbuf.width, pbuf.height, fmt);
+	}
+
+	LockTexMan();
+	// another thread may have loaded the same file in the meantime
+	if(!(tex = FindTextureUnlocked(fname))) {
+		std::map<ContentKey, Texture*>::iterator iter = tex_contents.find(key);
+		if(iter != tex_contents.end()) {
+			tex = iter->second;
+			AddTextureUnlocked(tex, fname);
+		}
+	}
+
+	if(tex) {
+		UnlockTexMan();
+		UnmapTexFile(tf);
+		free(pbuf.buffer);
+		pbuf.buffer = 0;
+		return tex;
+	}
+
 	tex = new Texture;
-	tex->SetPixelData(pbuf);
+	AddTextureUnlocked(tex, fname);
+	AddContentUnlocked(tex, key);
+
+	if(InLoaderThread()) {
+		PendingTexture pt;
+		pt.tex = tex;
+		pt.pixels = pbuf.buffer;
+		pt.tf = tf;
+		pt.format = fmt;
+		pt.width = pbuf.width;
+		pt.height = pbuf.height;
+		pending.push_back(pt);
+		UnlockTexMan();
+
+		pbuf.buffer = 0;
+		return tex;
+	}
+	UnlockTexMan();
+
+	if(tf) {
+		tex->SetTexFileData(tf);
+		UnmapTexFile(tf);
+	} else {
+		tex->SetPixelData(pbuf, fmt);
+	}
+
+	// LoadImage() allocates with malloc, don't let ~Buffer delete [] it
+	free(pbuf.buffer);
+	pbuf.buffer = 0;
+	return tex;
+}
+
+int UploadPendingTextures(int max_count) {
+	LockTexMan();
+	while(pending.size() && max_count--) {
+		PendingTexture pt = pending.back();
+		pending.pop_back();
+		UnlockTexMan();
+
+		if(pt.tf) {
+			pt.tex->SetTexFileData(pt.tf);
+			UnmapTexFile(pt.tf);
+		} else {
+			PixelBuffer pbuf;
+			pbuf.buffer = pt.pixels;
+			pbuf.width = pt.width;
+			pbuf.height = pt.height;
+			pt.tex->SetPixelData(pbuf, pt.format);
+
+			free(pbuf.buffer);
+			pbuf.buffer = 0;
+		}
+
+		LockTexMan();
+	}
+	int count = (int)pending.size();
+	UnlockTexMan();
+	return count;
+}
+
+Texture *AcquireTexture(const char *fname) {
+	Texture *tex = GetTexture(fname);
+	if(tex) AddTextureRef(tex);
 	return tex;
 }
+
+void AddTextureRef(Texture *tex) {
+	LockTexMan();
+	GetRecord(tex)->refs++;
+	UnlockTexMan();
+}
+
+void ReleaseTexture(Texture *tex) {
+	LockTexMan();
+	std::map<Texture*, TexRecord>::iterator iter = records.find(tex);
+	if(iter == records.end() || --iter->second.refs > 0) {
+		UnlockTexMan();
+		return;
+	}
+	RemoveTextureUnlocked(tex);
+	UnlockTexMan();
+
+	delete tex;
+}
+
+unsigned long GetTextureMemory() {
+	unsigned long total = 0;
+
+	LockTexMan();
+	std::map<Texture*, TexRecord>::iterator iter = records.begin();
+	while(iter != records.end()) {
+		total += (iter++)->first->GetMemoryUsage();
+	}
+	UnlockTexMan();
+	return total;
+}
+
+void LogTextureUsage() {
+	static const char *fmt_names[] = {"L8", "A8", "LA8", "RGB8", "RGBA8", "DXT1", "DXT5"};
+	char buf[512];
+
+	LockTexMan();
+	EngineLog("Texture memory usage:\n");
+
+	unsigned long total = 0;
+	std::map<Texture*, TexRecord>::iterator iter = records.begin();
+	while(iter != records.end()) {
+		Texture *tex = iter->first;
+
+		// the first of its names, a texture may have more than one
+		const char *name = "<unnamed>";
+		for(size_t i=0; i<names.size(); i++) {
+			if(names[i].name && names[i].tex == tex) {
+				name = names[i].name;
+				break;
+			}
+		}
+
+		// still waiting for the upload if it has no size
+		unsigned long size = tex->GetMemoryUsage();
+		sprintf(buf, "  %-40.200s %4lux%-4lu %-5s refs: %d  %lu kb\n", name,
+				size ? tex->width : 0, size ? tex->height : 0,
+				fmt_names[tex->GetFormat()], iter->second.refs, (size + 1023) / 1024);
+		EngineLog(buf);
+
+		total += size;
+		iter++;
+	}
+
+	sprintf(buf, "  total: %lu kb in %lu textures\n", (total + 1023) / 1024, (unsigned long)records.size());
+	EngineLog(buf);
+	UnlockTexMan();
+}
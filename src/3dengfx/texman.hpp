@@ -29,4 +29,37 @@ Texture *FindTexture(const char *fname);
 
 Texture *GetTexture(const char *fname);
 
+// creates the lock guarding the database, StartLoader calls it
+bool InitTexManLock();
+
+/* reference counting for shared textures: AcquireTexture is GetTexture
+ * taking a reference, and ReleaseTexture deletes the texture when the last
+ * reference goes (after removing it from the database, under all its names).
+ * Textures only obtained with GetTexture live until they're removed.
+ *
+ * The counts only cover the holders that took a reference. GetTexture
+ * itself takes none, and neither do the scene and geometry loaders for
+ * the material textures they set, so a texture may only be released
+ * while every pointer to it that will still be used belongs to a holder
+ * with a reference (e.g. a part that took them with AddTextures).
+ * Textures nobody took a reference to (like the ones the loader decoded
+ * for parts that never loaded) are never deleted this way.
+ */
+Texture *AcquireTexture(const char *fname);
+void AddTextureRef(Texture *tex);
+void ReleaseTexture(Texture *tex);
+
+// texture memory of all the textures in the database, in bytes
+unsigned long GetTextureMemory();
+
+// logs the size, format, references and memory of each texture
+void LogTextureUsage();
+
+/* textures requested from the loader threads are decoded there, but
+ * the actual OpenGL upload is deferred to the next call of this function
+ * from the rendering thread. It uploads at most max_count textures
+ * (all of them if max_count < 0) and returns the number still pending.
+ */
+int UploadPendingTextures(int max_count = -1);
+
 #endif	// _TEXMAN_HPP_
@@ -21,9 +21,46 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <cassert>
 #include "opengl.h"
 #include "textures.hpp"
+#include "3denginefx.hpp"
+extern "C" {
+#include "texfile.h"
+}
 
 static PixelBuffer undef_pbuf;
 
+static GLenum InternalFormat(TextureFormat fmt) {
+	switch(fmt) {
+	case TFMT_L8:
+		return GL_LUMINANCE8;
+	case TFMT_A8:
+		return GL_ALPHA8;
+	case TFMT_LA8:
+		return GL_LUMINANCE8_ALPHA8;
+	case TFMT_RGB8:
+		return GL_RGB8;
+	case TFMT_DXT1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TFMT_DXT5:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TFMT_RGBA8:
+	default:
+		break;
+	}
+	return GL_RGBA8;
+}
+
+TextureFormat GetTexFileFormat(const TexFile *tf) {
+	switch(tf->format) {
+	case TEXFMT_DXT1:
+		return TFMT_DXT1;
+	case TEXFMT_DXT5:
+		return TFMT_DXT5;
+	default:
+		break;
+	}
+	return TFMT_RGBA8;
+}
+
 static void GenUndefImage(int x, int y) {
 	if((int)undef_pbuf.width != x && (int)undef_pbuf.height != y) {
 		if(undef_pbuf.buffer) {
@@ -43,6 +80,10 @@ static void GenUndefImage(int x, int y) {
 Texture::Texture(int x, int y) {
 	width = x;
 	height = y;
+	tex_id = 0;
+	active_frame = 0;
+	format = TFMT_RGBA8;
+	levels = 0;
 	
 	if(x != -1 && y != -1) {
 		GenUndefImage(x, y);
@@ -51,6 +92,12 @@ Texture::Texture(int x, int y) {
 }		
 		
 
+Texture::~Texture() {
+	if(frame_tex_id.size()) {
+		glDeleteTextures(frame_tex_id.size(), &frame_tex_id[0]);
+	}
+}
+
 void Texture::AddFrame() {
 	glGenTextures(1, &tex_id);
 	glBindTexture(GL_TEXTURE_2D, tex_id);
@@ -88,12 +135,24 @@ void Texture::Lock() {
 
 void Texture::Unlock() {
 	glBindTexture(GL_TEXTURE_2D, tex_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat(format), width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 	
 	delete [] buffer;
+	buffer = 0;
 }
 
-void Texture::SetPixelData(const PixelBuffer &pbuf) {
+// alpha textures get white instead of black color channels
+void Texture::SetSwizzle(TextureFormat new_format) {
+	if((format == TFMT_A8) != (new_format == TFMT_A8)) {
+		bool white = new_format == TFMT_A8;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R_EXT, white ? GL_ONE : GL_RED);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G_EXT, white ? GL_ONE : GL_GREEN);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B_EXT, white ? GL_ONE : GL_BLUE);
+	}
+	format = new_format;
+}
+
+void Texture::SetPixelData(const PixelBuffer &pbuf, TextureFormat fmt) {
 	
 	if(!frame_tex_id.size()) {
 		AddFrame();
@@ -103,8 +162,89 @@ void Texture::SetPixelData(const PixelBuffer &pbuf) {
 	height = pbuf.height;
 	
 	glBindTexture(GL_TEXTURE_2D, tex_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pbuf.buffer);
+	// only level 0 is defined, keep the texture complete for mipmapped filtering
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	SetSwizzle(fmt);
+	levels = 1;
+	glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat(fmt), width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pbuf.buffer);
 	/* NOTE: is the previous function asyncronous? Do I have to wait for it
 	** before going on, to ensure texture data integrity? possible bug if so.
 	*/
 }
+
+void Texture::SetTexFileData(const TexFile *tf) {
+
+	if(!frame_tex_id.size()) {
+		AddFrame();
+	}
+
+	width = tf->width;
+	height = tf->height;
+
+	glBindTexture(GL_TEXTURE_2D, tex_id);
+	SetSwizzle(GetTexFileFormat(tf));
+	levels = tf->levels;
+
+	unsigned long xsz = width, ysz = height;
+	for(int i=0; i<tf->levels; i++) {
+		switch(tf->format) {
+		case TEXFMT_DXT1:
+		case TEXFMT_DXT5:
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, InternalFormat(format), xsz, ysz, 0, tf->level_size[i], tf->level_data[i]);
+			break;
+
+		case TEXFMT_BGRA8:
+		default:
+			glTexImage2D(GL_TEXTURE_2D, i, InternalFormat(format), xsz, ysz, 0, GL_BGRA, GL_UNSIGNED_BYTE, tf->level_data[i]);
+			break;
+		}
+
+		if(xsz > 1) xsz /= 2;
+		if(ysz > 1) ysz /= 2;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tf->levels - 1);
+	if(tf->levels > 1 && GetMipMapping()) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+}
+
+TextureFormat Texture::GetFormat() const {
+	return format;
+}
+
+unsigned long Texture::GetMemoryUsage() const {
+	unsigned long size = 0;
+	unsigned long xsz = width, ysz = height;
+
+	for(int i=0; i<levels; i++) {
+		switch(format) {
+		case TFMT_L8:
+		case TFMT_A8:
+			size += xsz * ysz;
+			break;
+
+		case TFMT_LA8:
+			size += xsz * ysz * 2;
+			break;
+
+		case TFMT_DXT1:
+			size += TexFileLevelSize(TEXFMT_DXT1, xsz, ysz);
+			break;
+
+		case TFMT_DXT5:
+			size += TexFileLevelSize(TEXFMT_DXT5, xsz, ysz);
+			break;
+
+		case TFMT_RGB8:		// padded to 32bit by the drivers anyway
+		case TFMT_RGBA8:
+		default:
+			size += xsz * ysz * 4;
+			break;
+		}
+
+		if(xsz > 1) xsz /= 2;
+		if(ysz > 1) ysz /= 2;
+	}
+	return size * frame_tex_id.size();
+}
@@ -24,6 +24,25 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <vector>
 #include "pbuffer.hpp"
 
+struct TexFile;
+
+/* internal texture formats, smaller ones are picked by GetTexture() when
+ * the image doesn't need all the channels. TFMT_A8 reads back as white
+ * with the alpha of the texture (needs SysCaps::tex_swizzle).
+ */
+enum TextureFormat {
+	TFMT_L8,
+	TFMT_A8,
+	TFMT_LA8,
+	TFMT_RGB8,
+	TFMT_RGBA8,
+	TFMT_DXT1,
+	TFMT_DXT5
+};
+
+// the format a baked texture file is uploaded in
+TextureFormat GetTexFileFormat(const TexFile *tf);
+
 /* ---- Texture class ----
 ** it does NOT hold the actual pixel data, if we need access to
 ** the pixels we have to call Lock() then the data are retrieved from
@@ -39,6 +58,10 @@ private:
 	// for animated textures this will hold all the tex_ids of the frames
 	std::vector<unsigned int> frame_tex_id;
 	unsigned int active_frame;
+	TextureFormat format;
+	int levels;		// mipmap levels defined
+
+	void SetSwizzle(TextureFormat new_format);
 	
 
 public:
@@ -47,6 +70,7 @@ public:
 							 */
 
 	Texture(int x = -1, int y = -1);
+	~Texture();
 
 	void AddFrame();
 	void AddFrame(const PixelBuffer &pbuf);
@@ -57,7 +81,20 @@ public:
 	void Lock();		// get a valid pixel pointer
 	void Unlock();		// update system data & invalidate pointer
 	
-	void SetPixelData(const PixelBuffer &pbuf);
+	/* the pixels are always 32bit BGRA, fmt is the format they are stored
+	 * in by OpenGL, and it has to hold the channels the image uses.
+	 */
+	void SetPixelData(const PixelBuffer &pbuf, TextureFormat fmt = TFMT_RGBA8);
+
+	/* uploads all the mipmap levels of a baked texture file as they are,
+	 * the compressed formats need SysCaps::s3tc_textures.
+	 */
+	void SetTexFileData(const TexFile *tf);
+
+	TextureFormat GetFormat() const;
+
+	// bytes of texture memory taken by all the frames and mipmap levels
+	unsigned long GetMemoryUsage() const;
 };
 
 #endif	// _TEXTURES_HPP_
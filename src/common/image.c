@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 /* Local function prototypes */
 static void *LoadPNG(FILE *fp, unsigned long *xsz, unsigned long *ysz);
+static int SavePNG(FILE *fp, const uint32_t *pixels, unsigned long xsz, unsigned long ysz);
 
 /* implementation */
 
@@ -49,6 +50,20 @@ void *LoadImage(const char *fname, unsigned long *xsz, unsigned long *ysz) {
 	return 0;
 }
 
+int SaveImage(const char *fname, const void *pixels, unsigned long xsz, unsigned long ysz) {
+	FILE *file;
+	int res;
+
+	if(!(file = fopen(fname, "wb"))) {
+		fprintf(stderr, "Image saving error: could not open file %s\n", fname);
+		return -1;
+	}
+
+	res = SavePNG(file, pixels, xsz, ysz);
+	fclose(file);
+	return res;
+}
+
 void FreeImage(void *img) {
 	free(img);
 }
@@ -122,3 +137,46 @@ void *LoadPNG(FILE *fp, unsigned long *xsz, unsigned long *ysz) {
 	png_destroy_read_struct(&png_ptr, &info_ptr, 0);
 	return pixels;
 }
+
+static int SavePNG(FILE *fp, const uint32_t *pixels, unsigned long xsz, unsigned long ysz) {
+	png_struct *png_ptr;
+	png_info *info_ptr;
+	png_byte **rows;
+	unsigned long i;
+
+	if(!(png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0))) {
+		return -1;
+	}
+
+	if(!(info_ptr = png_create_info_struct(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, 0);
+		return -1;
+	}
+
+	if(!(rows = malloc(ysz * sizeof *rows))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return -1;
+	}
+	for(i=0; i<ysz; i++) {
+		rows[i] = (png_byte*)(pixels + i * xsz);
+	}
+
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		free(rows);
+		return -1;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_IHDR(png_ptr, info_ptr, xsz, ysz, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_set_compression_level(png_ptr, 3);	/* speed matters more than size here */
+
+	/* our pixels are BGRA in memory, drop the alpha byte */
+	png_set_rows(png_ptr, info_ptr, rows);
+	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_BGR | PNG_TRANSFORM_STRIP_FILLER_AFTER, 0);
+
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	free(rows);
+	return 0;
+}
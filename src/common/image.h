@@ -26,6 +26,11 @@ extern "C" {
 
 void *LoadImage(const char *fname, unsigned long *xsz, unsigned long *ysz);
 
+/* saves 32bit pixels in the same layout LoadImage returns as an RGB PNG,
+ * returns 0 on success, -1 on failure.
+ */
+int SaveImage(const char *fname, const void *pixels, unsigned long xsz, unsigned long ysz);
+
 #ifdef __cplusplus
 }
 #endif	/* __cplusplus */
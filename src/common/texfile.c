@@ -0,0 +1,185 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif	/* __unix__ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "texfile.h"
+
+#ifdef WIN32
+#include <io.h>
+#include "mmap_win32.h"
+#endif	/* WIN32 */
+
+#ifndef O_BINARY
+#define O_BINARY	0
+#endif	/* O_BINARY */
+
+/* level data start at 16 byte boundaries */
+#define ALIGN16(x)	(((x) + 15) & ~15UL)
+
+unsigned long TexFileLevelSize(enum TexFileFormat fmt, unsigned long xsz, unsigned long ysz) {
+	unsigned long bx = (xsz + 3) / 4;
+	unsigned long by = (ysz + 3) / 4;
+
+	switch(fmt) {
+	case TEXFMT_DXT1:
+		return bx * by * 8;
+
+	case TEXFMT_DXT5:
+		return bx * by * 16;
+
+	case TEXFMT_BGRA8:
+	default:
+		break;
+	}
+	return xsz * ysz * 4;
+}
+
+struct TexFile *MapTexFile(const char *fname) {
+	int fd, i;
+	struct stat sbuf;
+	struct TexFile *tf;
+	struct TexFileHeader *hdr;
+	unsigned long xsz, ysz;
+
+	if((fd = open(fname, O_RDONLY | O_BINARY)) == -1) {
+		return 0;
+	}
+
+	if(fstat(fd, &sbuf) == -1 || sbuf.st_size < (off_t)sizeof *hdr) {
+		close(fd);
+		return 0;
+	}
+
+	if(!(tf = malloc(sizeof *tf))) {
+		close(fd);
+		return 0;
+	}
+	tf->mem_size = sbuf.st_size;
+
+	tf->mem = mmap(0, tf->mem_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(tf->mem == MAP_FAILED) {
+		fprintf(stderr, "could not map texture file %s\n", fname);
+		free(tf);
+		return 0;
+	}
+
+	hdr = tf->mem;
+	if(memcmp(hdr->magic, TEXFILE_MAGIC, 4) != 0 || hdr->format > TEXFMT_DXT5 ||
+			hdr->levels < 1 || hdr->levels > TEXFILE_MAX_LEVELS) {
+		fprintf(stderr, "%s is not a valid texture file\n", fname);
+		UnmapTexFile(tf);
+		return 0;
+	}
+
+	tf->width = xsz = hdr->width;
+	tf->height = ysz = hdr->height;
+	tf->format = hdr->format;
+	tf->levels = hdr->levels;
+
+	for(i=0; i<tf->levels; i++) {
+		unsigned long offs = hdr->level[i].offset;
+		unsigned long size = hdr->level[i].size;
+
+		if(size != TexFileLevelSize(tf->format, xsz, ysz) || offs > tf->mem_size ||
+				size > tf->mem_size - offs) {
+			fprintf(stderr, "texture file %s is truncated or corrupt\n", fname);
+			UnmapTexFile(tf);
+			return 0;
+		}
+		tf->level_data[i] = (char*)tf->mem + offs;
+		tf->level_size[i] = size;
+
+		if(xsz > 1) xsz /= 2;
+		if(ysz > 1) ysz /= 2;
+	}
+
+	return tf;
+}
+
+void UnmapTexFile(struct TexFile *tf) {
+	if(!tf) return;
+	munmap(tf->mem, tf->mem_size);
+	free(tf);
+}
+
+int SaveTexFile(const char *fname, enum TexFileFormat fmt, unsigned long xsz, unsigned long ysz,
+		int levels, const void * const *level_data) {
+	FILE *fp;
+	int i;
+	unsigned long offs, size;
+	struct TexFileHeader hdr;
+	static const char zeros[16];
+
+	if(levels < 1 || levels > TEXFILE_MAX_LEVELS) {
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, TEXFILE_MAGIC, 4);
+	hdr.width = xsz;
+	hdr.height = ysz;
+	hdr.format = fmt;
+	hdr.levels = levels;
+
+	offs = ALIGN16(sizeof hdr);
+	for(i=0; i<levels; i++) {
+		size = TexFileLevelSize(fmt, xsz, ysz);
+		hdr.level[i].offset = offs;
+		hdr.level[i].size = size;
+		offs = ALIGN16(offs + size);
+
+		if(xsz > 1) xsz /= 2;
+		if(ysz > 1) ysz /= 2;
+	}
+
+	if(!(fp = fopen(fname, "wb"))) {
+		fprintf(stderr, "could not open %s for writing\n", fname);
+		return -1;
+	}
+
+	fwrite(&hdr, sizeof hdr, 1, fp);
+	offs = sizeof hdr;
+
+	for(i=0; i<levels; i++) {
+		fwrite(zeros, 1, hdr.level[i].offset - offs, fp);
+		fwrite(level_data[i], 1, hdr.level[i].size, fp);
+		offs = hdr.level[i].offset + hdr.level[i].size;
+	}
+
+	if(ferror(fp)) {
+		fprintf(stderr, "error writing %s\n", fname);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* baked texture files (.btx)
+ * --------------------------
+ * textures preprocessed offline by the tex_bake tool, holding the complete
+ * mipmap chain in the format it's going to be uploaded in (S3TC compressed
+ * or plain BGRA), so that the file can be mapped and handed to OpenGL
+ * level by level without decoding anything.
+ *
+ * layout (little endian): the TexFileHeader, then the image data of each
+ * level starting at the offsets recorded in the header.
+ */
+#ifndef _TEXFILE_H_
+#define _TEXFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+#define TEXFILE_MAGIC		"BTX1"
+#define TEXFILE_MAX_LEVELS	16
+
+enum TexFileFormat {
+	TEXFMT_BGRA8,		/* uncompressed 32bit, same layout as LoadImage() */
+	TEXFMT_DXT1,		/* 8 bytes per 4x4 block, opaque */
+	TEXFMT_DXT5			/* 16 bytes per 4x4 block, interpolated alpha */
+};
+
+struct TexFileHeader {
+	char magic[4];
+	uint32_t width, height;
+	uint32_t format;
+	uint32_t levels;
+	struct {
+		uint32_t offset, size;
+	} level[TEXFILE_MAX_LEVELS];
+};
+
+struct TexFile {
+	unsigned long width, height;
+	enum TexFileFormat format;
+	int levels;
+	const void *level_data[TEXFILE_MAX_LEVELS];
+	unsigned long level_size[TEXFILE_MAX_LEVELS];
+
+	void *mem;
+	size_t mem_size;
+};
+
+/* size in bytes of a single mipmap level of the given dimensions */
+unsigned long TexFileLevelSize(enum TexFileFormat fmt, unsigned long xsz, unsigned long ysz);
+
+/* maps a baked texture file into memory, returns 0 if it does not exist
+ * or it's not a valid texture file. The level pointers stay valid until
+ * the file is unmapped.
+ */
+struct TexFile *MapTexFile(const char *fname);
+void UnmapTexFile(struct TexFile *tf);
+
+/* writes a baked texture file, level 0 is xsz x ysz and each following
+ * level half the size of the previous one (but at least 1).
+ * Returns 0 on success, -1 on failure.
+ */
+int SaveTexFile(const char *fname, enum TexFileFormat fmt, unsigned long xsz, unsigned long ysz,
+		int levels, const void * const *level_data);
+
+#ifdef __cplusplus
+}
+#endif	/* __cplusplus */
+
+#endif	/* _TEXFILE_H_ */
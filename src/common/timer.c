@@ -58,6 +58,11 @@ void timer_reset(ntimer *timer) {
 	timer->stop = 0;	
 }
 
+/* moves the timer so that it reads msec right now */
+void timer_setmsec(ntimer *timer, unsigned long msec) {
+	timer->start = sys_get_msec() - msec;
+}
+
 unsigned long timer_getmsec(const ntimer *timer) {
 	return sys_get_msec() - timer->start;
 }
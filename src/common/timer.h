@@ -36,6 +36,7 @@ typedef struct ntimer {
 void timer_start(ntimer *timer);
 void timer_stop(ntimer *timer);
 void timer_reset(ntimer *timer);
+void timer_setmsec(ntimer *timer, unsigned long msec);
 unsigned long timer_getmsec(const ntimer *timer);
 unsigned long timer_getsec(const ntimer *timer);
 
@@ -0,0 +1,179 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the eternal demo.
+
+The eternal library is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+The eternal demo is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with the eternal demo; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+#include <stdlib.h>
+#include "SDL.h"
+#include "tpool.h"
+
+#if defined(unix) || defined(__unix__)
+#include <unistd.h>
+#else	/* assume win32 */
+#include <windows.h>
+#endif	/* defined(unix) || defined(__unix__) */
+
+struct job {
+	tpool_func func;
+	void *data;
+	struct job *next;
+};
+
+struct tpool {
+	SDL_Thread **threads;
+	int num_threads;
+
+	struct job *head, *tail;
+	int pending;	/* queued + running jobs */
+	int quit;
+
+	SDL_mutex *lock;
+	SDL_cond *job_cond;		/* signaled when a job is queued */
+	SDL_cond *done_cond;	/* signaled when pending drops to zero */
+};
+
+static int thread_func(void *arg);
+
+int tpool_get_processor_count(void) {
+#if defined(unix) || defined(__unix__)
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	return ncpu > 0 ? (int)ncpu : 1;
+#else
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#endif
+}
+
+tpool *tpool_create(int num_threads) {
+	int i;
+	tpool *tp;
+
+	if(num_threads <= 0) {
+		num_threads = tpool_get_processor_count();
+	}
+
+	if(!(tp = malloc(sizeof *tp))) {
+		return 0;
+	}
+	tp->head = tp->tail = 0;
+	tp->pending = 0;
+	tp->quit = 0;
+	tp->lock = SDL_CreateMutex();
+	tp->job_cond = SDL_CreateCond();
+	tp->done_cond = SDL_CreateCond();
+
+	tp->threads = malloc(num_threads * sizeof *tp->threads);
+	tp->num_threads = 0;
+	for(i=0; i<num_threads; i++) {
+		if(!(tp->threads[i] = SDL_CreateThread(thread_func, tp))) {
+			break;
+		}
+		tp->num_threads++;
+	}
+
+	if(!tp->num_threads) {
+		tpool_destroy(tp);
+		return 0;
+	}
+	return tp;
+}
+
+void tpool_destroy(tpool *tp) {
+	int i;
+
+	tpool_wait(tp);
+
+	SDL_mutexP(tp->lock);
+	tp->quit = 1;
+	SDL_CondBroadcast(tp->job_cond);
+	SDL_mutexV(tp->lock);
+
+	for(i=0; i<tp->num_threads; i++) {
+		SDL_WaitThread(tp->threads[i], 0);
+	}
+	free(tp->threads);
+
+	SDL_DestroyCond(tp->job_cond);
+	SDL_DestroyCond(tp->done_cond);
+	SDL_DestroyMutex(tp->lock);
+	free(tp);
+}
+
+int tpool_enqueue(tpool *tp, tpool_func func, void *data) {
+	struct job *job;
+
+	if(!(job = malloc(sizeof *job))) {
+		return -1;
+	}
+	job->func = func;
+	job->data = data;
+	job->next = 0;
+
+	SDL_mutexP(tp->lock);
+	if(tp->tail) {
+		tp->tail->next = job;
+	} else {
+		tp->head = job;
+	}
+	tp->tail = job;
+	tp->pending++;
+	SDL_CondSignal(tp->job_cond);
+	SDL_mutexV(tp->lock);
+	return 0;
+}
+
+void tpool_wait(tpool *tp) {
+	SDL_mutexP(tp->lock);
+	while(tp->pending) {
+		SDL_CondWait(tp->done_cond, tp->lock);
+	}
+	SDL_mutexV(tp->lock);
+}
+
+int tpool_get_thread_count(const tpool *tp) {
+	return tp->num_threads;
+}
+
+static int thread_func(void *arg) {
+	tpool *tp = arg;
+	struct job *job;
+
+	SDL_mutexP(tp->lock);
+	for(;;) {
+		while(!tp->head && !tp->quit) {
+			SDL_CondWait(tp->job_cond, tp->lock);
+		}
+		if(!tp->head) break;	/* quit and nothing left to do */
+
+		job = tp->head;
+		if(!(tp->head = job->next)) {
+			tp->tail = 0;
+		}
+		SDL_mutexV(tp->lock);
+
+		job->func(job->data);
+		free(job);
+
+		SDL_mutexP(tp->lock);
+		if(--tp->pending == 0) {
+			SDL_CondBroadcast(tp->done_cond);
+		}
+	}
+	SDL_mutexV(tp->lock);
+	return 0;
+}
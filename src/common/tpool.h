@@ -0,0 +1,50 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the eternal demo.
+
+The eternal library is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+The eternal demo is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with the eternal demo; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+#ifndef _TPOOL_H_
+#define _TPOOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+/* a simple worker thread pool on top of SDL threads, jobs are started
+ * in the order they are enqueued.
+ */
+typedef struct tpool tpool;
+
+typedef void (*tpool_func)(void *data);
+
+/* num_threads <= 0 creates one thread per processor */
+tpool *tpool_create(int num_threads);
+/* waits for all pending jobs to finish and frees the pool */
+void tpool_destroy(tpool *tp);
+
+int tpool_enqueue(tpool *tp, tpool_func func, void *data);
+/* blocks until there are no queued or running jobs */
+void tpool_wait(tpool *tp);
+
+int tpool_get_thread_count(const tpool *tp);
+int tpool_get_processor_count(void);
+
+#ifdef __cplusplus
+}
+#endif	/* __cplusplus */
+
+#endif	/* _TPOOL_H_ */
@@ -20,6 +20,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #include <iostream>
 #include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include <n3dmath2.hpp>
 #include <SDL.h>
 #include "3dengfx.hpp"
@@ -37,15 +40,65 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 using namespace std;
 
+// the demoscript time 0 corresponds to this point in the music
+#define MUSIC_OFFSET	19.5
+#define SEEK_STEP		5000
+
+// time spent on texture uploads between loading screen updates
+#define LOAD_UPDATE_MSEC	30
+
+// compiled material programs, reused by the next run
+#define PROGRAM_CACHE	"shaders.cache"
+
+// capture options
+static const char *capture_dest;
+static int capture_fps = 30;
+static int capture_x, capture_y;
+
+static const char *profile_fname;
+
+static long start_time;
+static long prefetch_time = -1;
+
 int Init();
+void DrawLoading(Texture *tex, float progress);
 void CleanUp();
 bool UpdateGraphics();
 int EventHandler(SDL_Event &event);
+void Seek(long msec);
+long MusicClock();
+static int GetBlurQuality(const char *name);
 
 // ----- globals ------
 std::vector<dsys::Part*> parts;
 
 int main(int argc, char **argv) {
+	for(int i=1; i<argc; i++) {
+		int blur;
+		if(!strcmp(argv[i], "-seek") && i < argc - 1) {
+			start_time = (long)(atof(argv[++i]) * 1000.0);
+		} else if(!strcmp(argv[i], "-capture") && i < argc - 1) {
+			capture_dest = argv[++i];
+		} else if(!strcmp(argv[i], "-fps") && i < argc - 1 && atoi(argv[i + 1]) > 0) {
+			capture_fps = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-prefetch") && i < argc - 1) {
+			prefetch_time = (long)(atof(argv[++i]) * 1000.0);
+		} else if(!strcmp(argv[i], "-profile") && i < argc - 1) {
+			profile_fname = argv[++i];
+		} else if(!strcmp(argv[i], "-blur") && i < argc - 1 &&
+				(blur = GetBlurQuality(argv[i + 1])) != -1) {
+			dsys::SetBlurQuality(blur);
+			i++;
+		} else if(!strcmp(argv[i], "-size") && i < argc - 1 &&
+				sscanf(argv[i + 1], "%dx%d", &capture_x, &capture_y) == 2) {
+			i++;
+		} else {
+			cerr << "usage: " << argv[0] << " [-seek <seconds>] [-capture <frame%05d.png | ->]";
+			cerr << " [-fps <n>] [-size <WxH>] [-prefetch <seconds>] [-profile <trace.json | stats.csv>]";
+			cerr << " [-blur <low | medium | high | quads>]\n";
+			return -1;
+		}
+	}
 	
 	if(Init() == -1) return -1;
 
@@ -63,6 +116,15 @@ int main(int argc, char **argv) {
 	CleanUp();
 }
 
+// -blur option values, in the order of the dsys::BLUR_* constants
+static int GetBlurQuality(const char *name) {
+	static const char *blur_names[] = {"low", "medium", "high", "quads"};
+	for(int i=0; i<4; i++) {
+		if(!strcmp(name, blur_names[i])) return i;
+	}
+	return -1;
+}
+
 int Init() {
 
 	try {
@@ -74,11 +136,16 @@ int Init() {
 		return -1;
 	}
 	SDL_WM_SetCaption("The Lab Demos", 0);
-	dsys::Init();
 
-	Clear(0);
-	dsys::Overlay(GetTexture("data/loading.png"), Vector2(0,0), Vector2(1,1), 1.0f);
-	Flip();
+	if(capture_dest && capture_x > 0 && capture_y > 0) {
+		if(!SetOffscreenFramebuffer(capture_x, capture_y)) {
+			cerr << "could not create a " << capture_x << "x" << capture_y << " offscreen framebuffer\n";
+			return -1;
+		}
+	}
+	dsys::Init();
+	LoadProgramCache(PROGRAM_CACHE);
+	if(profile_fname) EnableProfiler(true);
 
 	parts.push_back(new PartVolSph);
 	parts.push_back(new PartStart);
@@ -92,26 +159,84 @@ int Init() {
 		AddPart(parts[i]);
 	}
 
+	if(prefetch_time >= 0) dsys::SetPrefetchTime(prefetch_time);
 	dsys::StartDemo();
 
+	// the parts load in the background as the demo needs them, wait for
+	// the ones needed at the start, uploading and drawing the progress bar
+	Texture *loading = AcquireTexture("data/loading.png");
+	while(!dsys::UpdateResources(start_time, LOAD_UPDATE_MSEC)) {
+		DrawLoading(loading, GetLoadProgress());
+		SDL_PumpEvents();
+	}
+	ReleaseTexture(loading);
+	LogTextureUsage();
+	// don't count the loading time as demo time
+	dsys::Seek(start_time);
+
+	if(capture_dest) {
+		// no wall clock and no music when capturing, just frames
+		dsys::SetFixedFrameRate(capture_fps);
+		if(!dsys::StartCapture(capture_dest, capture_fps)) {
+			return -1;
+		}
+		return 0;
+	}
+
 	if(sdlvf_init("data/amigo-eternal.ogg") != SDLVF_PLAYING) {
 		std::cerr << "could not open music\n";
 	}
-	sdlvf_seek(19.5);
+	sdlvf_seek(MUSIC_OFFSET + start_time / 1000.0);
+	dsys::SetClock(MusicClock);
 
 	return 0;
 }
 
+void DrawLoading(Texture *tex, float progress) {
+	Clear(0);
+	dsys::Overlay(tex, Vector2(0,0), Vector2(1,1), 1.0f);
+	dsys::Overlay(0, Vector2(0.1f, 0.9f), Vector2(0.9f, 0.92f), Color(0.2f, 0.2f, 0.2f, 0.8f));
+	dsys::Overlay(0, Vector2(0.1f, 0.9f), Vector2(0.1f + 0.8f * progress, 0.92f), Color(1.0f, 1.0f, 1.0f, 0.8f));
+	Flip();
+}
+
+void Seek(long msec) {
+	if(msec < 0) msec = 0;
+	dsys::Seek(msec);
+	if(!capture_dest) sdlvf_seek(MUSIC_OFFSET + msec / 1000.0);
+}
+
 void CleanUp() {
+	if(profile_fname) ProfDump(profile_fname);
+
+	const dsys::ClockStats *cs = dsys::GetClockStats();
+	cerr << "clock drift: avg " << cs->avg_drift << " ms, max " << cs->max_drift;
+	cerr << " ms, " << cs->resyncs << " resyncs\n";
+
+	const StateStats *ss = GetStateStats();
+	if(ss->frames) {
+		cerr << "state changes per frame: " << ss->total_issued / ss->frames << " issued, ";
+		cerr << ss->total_elided / ss->frames << " redundant\n";
+	}
+	
 	for(int i=0; i<(int)parts.size(); i++) {
 		delete parts[i];
 	}
 	dsys::CleanUp();
+	SaveProgramCache(PROGRAM_CACHE);
+	DestroyMaterialPrograms();
 	DestroyGraphicsContext();
 }
 
+// the demo follows the music, when it's playing
+long MusicClock() {
+	double pos = sdlvf_position();
+	if(pos < MUSIC_OFFSET) return -1;
+	return (long)((pos - MUSIC_OFFSET) * 1000.0);
+}
+
 bool UpdateGraphics() {
-	sdlvf_check();
+	if(!capture_dest) sdlvf_check();
 	return dsys::UpdateGraphics() != -1;
 }
 
@@ -124,8 +249,21 @@ int EventHandler(SDL_Event &event) {
 		return -1;
 
 	case SDL_KEYDOWN:
-		if(event.key.keysym.sym == SDLK_ESCAPE || event.key.keysym.sym == 'q') {
+		switch(event.key.keysym.sym) {
+		case SDLK_ESCAPE:
+		case 'q':
 			return -1;
+
+		case SDLK_LEFT:
+			Seek((long)dsys::GetTime() - SEEK_STEP);
+			break;
+
+		case SDLK_RIGHT:
+			Seek((long)dsys::GetTime() + SEEK_STEP);
+			break;
+
+		default:
+			break;
 		}
 		break;
 	}
@@ -0,0 +1,292 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include "SDL.h"
+#include "capture.hpp"
+#include "3dengfx.hpp"
+#include "image.h"
+#include "tpool.h"
+
+#if !defined(unix) && !defined(__unix__)
+#include <io.h>
+#include <fcntl.h>
+#endif	// !defined(unix) && !defined(__unix__)
+
+using std::cerr;
+
+// frames in flight per worker thread, bounds memory use when encoding is slow
+#define FRAMES_PER_THREAD	2
+
+// longest file name a pattern may expand to, including the terminator
+#define FNAME_MAX	512
+
+struct Frame {
+	unsigned char *pixels;	// BGRA, bottom-up as read from GL
+	unsigned char *yuv;
+	unsigned long num;
+	Frame *next;
+};
+
+static bool capturing;
+static bool y4m;
+static char *pattern;
+static int xsz, ysz;
+
+static tpool *pool;
+static Frame *frames, *free_frames;
+static int frame_count;
+static unsigned long frame_num, next_write;
+
+static SDL_mutex *lock;
+static SDL_cond *free_cond, *write_cond;
+
+static void EncodeFrame(void *data);
+
+/* the output pattern goes straight to sprintf, so it must have exactly one
+ * int conversion (%d or %i, with optional flags, width and precision) and
+ * nothing else but %%. Returns the longest file name it can expand to
+ * (including the terminator), or -1 if the pattern isn't valid.
+ */
+static int PatternLength(const char *pat) {
+	int len = 1, conv = 0;
+
+	while(*pat) {
+		if(*pat++ != '%') {
+			len++;
+			continue;
+		}
+		if(*pat == '%') {
+			len++;
+			pat++;
+			continue;
+		}
+
+		while(*pat && strchr("-+ 0", *pat)) pat++;
+
+		int width = 0, prec = 0;
+		while(isdigit((unsigned char)*pat)) {
+			width = width * 10 + *pat++ - '0';
+			if(width > 99) return -1;
+		}
+		if(*pat == '.') {
+			pat++;
+			while(isdigit((unsigned char)*pat)) {
+				prec = prec * 10 + *pat++ - '0';
+				if(prec > 99) return -1;
+			}
+		}
+		if(*pat != 'd' && *pat != 'i') return -1;
+		pat++;
+
+		// at least 10 digits for a 32bit int, plus the sign
+		int digits = (prec > 10 ? prec : 10) + 1;
+		len += width > digits ? width : digits;
+		conv++;
+	}
+	return conv == 1 ? len : -1;
+}
+
+bool dsys::StartCapture(const char *dest, int fps, int threads) {
+	if(capturing) return false;
+
+	const GraphicsInitParameters *gip = GetGraphicsInitParameters();
+	xsz = gip->x;
+	ysz = gip->y;
+
+	y4m = !strcmp(dest, "-");
+	if(!y4m) {
+		int len = PatternLength(dest);
+		if(len == -1) {
+			cerr << "capture: the output pattern needs exactly one %d conversion\n";
+			return false;
+		}
+		if(len > FNAME_MAX) {
+			cerr << "capture: output pattern too long\n";
+			return false;
+		}
+	}
+	if(y4m && (xsz & 1 || ysz & 1)) {
+		cerr << "capture: YUV4MPEG2 output needs even frame dimensions\n";
+		return false;
+	}
+
+	if(!(pool = tpool_create(threads))) {
+		cerr << "capture: failed to start the worker threads\n";
+		return false;
+	}
+
+	if(y4m) {
+#if !defined(unix) && !defined(__unix__)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		printf("YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", xsz, ysz, fps);
+	} else {
+		pattern = new char[strlen(dest) + 1];
+		strcpy(pattern, dest);
+	}
+
+	frame_count = tpool_get_thread_count(pool) * FRAMES_PER_THREAD;
+	frames = new Frame[frame_count];
+	free_frames = 0;
+	for(int i=0; i<frame_count; i++) {
+		frames[i].pixels = new unsigned char[xsz * ysz * 4];
+		frames[i].yuv = y4m ? new unsigned char[xsz * ysz * 3 / 2] : 0;
+		frames[i].next = free_frames;
+		free_frames = frames + i;
+	}
+
+	lock = SDL_CreateMutex();
+	free_cond = SDL_CreateCond();
+	write_cond = SDL_CreateCond();
+
+	frame_num = next_write = 0;
+	capturing = true;
+	return true;
+}
+
+void dsys::EndCapture() {
+	if(!capturing) return;
+
+	tpool_destroy(pool);
+	if(y4m) fflush(stdout);
+
+	for(int i=0; i<frame_count; i++) {
+		delete [] frames[i].pixels;
+		delete [] frames[i].yuv;
+	}
+	delete [] frames;
+	delete [] pattern;
+	pattern = 0;
+
+	SDL_DestroyCond(free_cond);
+	SDL_DestroyCond(write_cond);
+	SDL_DestroyMutex(lock);
+
+	cerr << "capture: " << frame_num << " frames\n";
+	capturing = false;
+}
+
+bool dsys::IsCapturing() {
+	return capturing;
+}
+
+void dsys::CaptureFrame() {
+	if(!capturing) return;
+
+	// only waits if the workers fall behind by more than the frames we have
+	SDL_mutexP(lock);
+	while(!free_frames) {
+		SDL_CondWait(free_cond, lock);
+	}
+	Frame *frame = free_frames;
+	free_frames = frame->next;
+	SDL_mutexV(lock);
+
+	ReadFramebuffer(frame->pixels);
+	frame->num = frame_num++;
+	tpool_enqueue(pool, EncodeFrame, frame);
+}
+
+// BT.601 studio swing
+#define RGB_Y(r, g, b)	(((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8) + 16)
+#define RGB_U(r, g, b)	(((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8) + 128)
+#define RGB_V(r, g, b)	(((112 * (r) - 94 * (g) - 18 * (b) + 128) >> 8) + 128)
+
+static void ConvertYUV(const unsigned char *pixels, unsigned char *yuv) {
+	unsigned char *yptr = yuv;
+	unsigned char *uptr = yuv + xsz * ysz;
+	unsigned char *vptr = uptr + xsz * ysz / 4;
+	int pitch = xsz * 4;
+
+	for(int i=0; i<ysz; i++) {
+		const unsigned char *src = pixels + (ysz - i - 1) * pitch;
+		for(int j=0; j<xsz; j++) {
+			*yptr++ = RGB_Y(src[2], src[1], src[0]);
+			src += 4;
+		}
+	}
+
+	// average each 2x2 block for the chroma planes
+	for(int i=0; i<ysz; i+=2) {
+		const unsigned char *row0 = pixels + (ysz - i - 1) * pitch;
+		const unsigned char *row1 = row0 - pitch;
+		for(int j=0; j<xsz; j+=2) {
+			int b = (row0[0] + row0[4] + row1[0] + row1[4] + 2) >> 2;
+			int g = (row0[1] + row0[5] + row1[1] + row1[5] + 2) >> 2;
+			int r = (row0[2] + row0[6] + row1[2] + row1[6] + 2) >> 2;
+			*uptr++ = RGB_U(r, g, b);
+			*vptr++ = RGB_V(r, g, b);
+			row0 += 8;
+			row1 += 8;
+		}
+	}
+}
+
+static void EncodeFrame(void *data) {
+	Frame *frame = (Frame*)data;
+
+	if(y4m) {
+		ConvertYUV(frame->pixels, frame->yuv);
+
+		// the stream must stay in order, wait for the previous frames
+		SDL_mutexP(lock);
+		while(next_write != frame->num) {
+			SDL_CondWait(write_cond, lock);
+		}
+		SDL_mutexV(lock);
+
+		fputs("FRAME\n", stdout);
+		fwrite(frame->yuv, 1, xsz * ysz * 3 / 2, stdout);
+
+		SDL_mutexP(lock);
+		next_write++;
+		SDL_CondBroadcast(write_cond);
+		SDL_mutexV(lock);
+	} else {
+		// flip to top-down in place
+		int pitch = xsz * 4;
+		unsigned char *tmp = new unsigned char[pitch];
+		for(int i=0; i<ysz / 2; i++) {
+			unsigned char *top = frame->pixels + i * pitch;
+			unsigned char *bottom = frame->pixels + (ysz - i - 1) * pitch;
+			memcpy(tmp, top, pitch);
+			memcpy(top, bottom, pitch);
+			memcpy(bottom, tmp, pitch);
+		}
+		delete [] tmp;
+
+		// StartCapture made sure the pattern can't expand past FNAME_MAX
+		char fname[FNAME_MAX];
+		sprintf(fname, pattern, (int)frame->num);
+		if(SaveImage(fname, frame->pixels, xsz, ysz) == -1) {
+			cerr << "capture: failed to write " << fname << "\n";
+		}
+	}
+
+	SDL_mutexP(lock);
+	frame->next = free_frames;
+	free_frames = frame;
+	SDL_CondSignal(free_cond);
+	SDL_mutexV(lock);
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CAPTURE_HPP_
+#define _CAPTURE_HPP_
+
+namespace dsys {
+
+	/* Frame capture, the frames are read back at the end of each frame and
+	 * written out by a pool of worker threads. dest is either a printf
+	 * style pattern for PNG files with exactly one %d conversion (e.g.
+	 * "frames/%05d.png"), or "-" to write a YUV4MPEG2 stream to the
+	 * standard output. fps is only used for the stream header, see
+	 * SetFixedFrameRate() for the timing.
+	 */
+	bool StartCapture(const char *dest, int fps, int threads = 0);
+	void EndCapture();
+	bool IsCapturing();
+
+	// called by UpdateGraphics before flipping
+	void CaptureFrame();
+}
+
+#endif	// _CAPTURE_HPP_
@@ -24,5 +24,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "dsys.hpp"
 #include "fx.hpp"
 #include "part.hpp"
+#include "capture.hpp"
+#include "sprite.hpp"
 
 #endif	// _DEMOSYS_HPP_
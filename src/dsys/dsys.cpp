@@ -19,30 +19,80 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
 #include <iostream>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <map>
 #include "dsys.hpp"
 #include "part.hpp"
+#include "capture.hpp"
+#include "rgraph.hpp"
 #include "3dengfx.hpp"
 #include "timer.h"
 #include "script.h"
-#include "bstree.hpp"
 
 using namespace dsys;
 using std::cerr;
 
-static int ExecuteScript(DemoScript *ds, unsigned long time);
+static int ExecuteScript(DemoScript *ds, unsigned long time, bool verbose = true);
 
 Texture *dsys::tex[4];
 unsigned int dsys::rtex_size_x, dsys::rtex_size_y;
 
-static BSTree<Part*> parts;
-static BSTree<Part*> running;
+/* Every part added gets an entry here, the index is the part's handle.
+ * name, target, clear and init_layer keep the state of the part as it was
+ * before the script started messing with it, to restore on Seek.
+ */
+struct PartEntry {
+	Part *part;
+	bool running;
+	int layer;
+
+	char *name;
+	RenderTarget target;
+	bool clear;
+	int init_layer;
+
+	// when the part runs according to the script, to load it just in time
+	std::vector<unsigned long> start, end;
+	bool requested;		// assets queued on the loader
+	bool failed;		// Load() failed, don't retry every frame
+};
+
+static std::vector<PartEntry> parts;
+static std::map<std::string, int> part_handles;	// current name -> handle
+
+// handles of the running parts in drawing order (by layer, then by name)
+static std::vector<int> running;
+static std::vector<Part*> frame_parts;	// passed on to the render graph
+
+#define LOAD_SLICE_MSEC		4		// loader time per frame spent uploading
+
+static unsigned long prefetch_time = 5000;
 
 static ntimer timer;
+static unsigned long frame_time;
+
+// master clock & smoothing filter state
+#define CLOCK_SNAP		150		// resync instead of slewing above this drift
+#define CLOCK_SLEW		8		// fraction of the drift corrected per frame
+
+static long (*clock_func)();
+static ClockStats clock_stats;
+
+// fixed timestep mode
+static int fixed_fps;
+static unsigned long fixed_frame;
 
 static char script_fname[256];
 static DemoScript *ds;
 
+// part handles resolved for each interned script symbol, filled lazily
+static int *sym_handle;
+
 static bool demo_running = false;
+static bool seeking;	// replaying the script in Seek, parts start unloaded
 
 static int BestTexSize(int n) {
 	int i;
@@ -57,22 +107,29 @@ bool dsys::Init() {
 	int scrx = GetGraphicsInitParameters()->x;
 	int scry = GetGraphicsInitParameters()->y;
 
-	rtex_size_x = BestTexSize(scrx);
-	rtex_size_y = BestTexSize(scry);
-
-	for(int i=0; i<4; i++) {
-		tex[i] = new Texture(rtex_size_x, rtex_size_y);
+	// full resolution when we can render straight into any texture
+	SysCaps caps = GetSystemCapabilities();
+	if(caps.fb_objects && caps.npot_textures) {
+		rtex_size_x = scrx;
+		rtex_size_y = scry;
+	} else {
+		rtex_size_x = BestTexSize(scrx);
+		rtex_size_y = BestTexSize(scry);
 	}
 
 	strcpy(script_fname, "data/demoscript");
 
+	if(!StartLoader()) {
+		cerr << "could not start the asset loader, loading everything on demand\n";
+	}
+
 	return true;
 }
 
 void dsys::CleanUp() {
-	for(int i=0; i<4; i++) {
-		delete tex[i];
-	}
+	EndCapture();
+	StopLoader();
+	FreeRenderGraph();
 }
 
 void dsys::SetDemoScript(const char *fname) {
@@ -80,51 +137,160 @@ void dsys::SetDemoScript(const char *fname) {
 }
 
 
-void dsys::AddPart(Part *part) {
-	parts.Insert(part);
+int dsys::AddPart(Part *part) {
+	PartEntry pe;
+	pe.part = part;
+	pe.running = false;
+	pe.layer = pe.init_layer = 0;
+	pe.name = 0;
+	pe.requested = pe.failed = false;
+	parts.push_back(pe);
+
+	int handle = (int)parts.size() - 1;
+	if(part->GetName()) part_handles[part->GetName()] = handle;
+	return handle;
 }
 
+int dsys::GetPartHandle(const char *pname) {
+	if(!pname) return -1;
+	std::map<std::string, int>::iterator iter = part_handles.find(pname);
+	return iter == part_handles.end() ? -1 : iter->second;
+}
 
-class _KeyPart : public dsys::Part {
-protected:
-	virtual void DrawPart() {}	// must implement the pure virtuals of the parent
-};		
+Part *dsys::GetPart(int handle) {
+	if(handle < 0 || handle >= (int)parts.size()) return 0;
+	return parts[handle].part;
+}
 
-bool dsys::StartPart(const char *pname) {
-	_KeyPart key;
-	key.SetName(pname);
-	BSTreeNode<Part*> *node = parts.Find(&key);
-	if(node) {
-		running.Insert(node->data);
-		node->data->Start();
-		return true;
+// loads a part that's about to start, if the prefetching didn't
+static bool LoadNow(Part *part) {
+	if(part->IsLoaded()) return true;
+
+	FinishLoading();
+	if(!part->Load()) {
+		cerr << "failed to load part: " << part->GetName() << "\n";
+		return false;
 	}
-	return false;
+	return true;
 }
 
-bool dsys::EndPart(const char *pname) {
-	_KeyPart key;
-	key.SetName(pname);
-	BSTreeNode<Part*> *node = running.Find(&key);
-	if(node) {
-		node->data->Stop();
-		running.Remove(node->data);
-		return true;
+/* parts on the same layer keep the order of the old name-sorted tree,
+ * so scripts that don't set layers draw exactly as they used to.
+ */
+static bool DrawsBefore(int a, int b) {
+	if(parts[a].layer != parts[b].layer) {
+		return parts[a].layer < parts[b].layer;
 	}
-	return false;
+	const char *aname = parts[a].part->GetName();
+	const char *bname = parts[b].part->GetName();
+	return strcmp(aname ? aname : "", bname ? bname : "") < 0;
 }
 
-bool dsys::RenamePart(const char *pname, const char *new_name) {
-	_KeyPart key;
-	key.SetName(pname);
-	BSTreeNode<Part*> *node = parts.Find(&key);
-	if(node) {
-		node = parts.Remove(&key);
-		node->data->SetName(new_name);
-		parts.Insert(node);
-		return true;
+static void InsertRunning(int handle) {
+	size_t i;
+	for(i=0; i<running.size(); i++) {
+		if(DrawsBefore(handle, running[i])) break;
 	}
-	return false;
+	running.insert(running.begin() + i, handle);
+	parts[handle].running = true;
+}
+
+static void RemoveRunning(int handle) {
+	for(size_t i=0; i<running.size(); i++) {
+		if(running[i] == handle) {
+			running.erase(running.begin() + i);
+			break;
+		}
+	}
+	parts[handle].running = false;
+}
+
+// script symbols must be resolved again after the part names change
+static void ResetSymbols() {
+	if(!sym_handle) return;
+	int sym_count = GetSymbolCount(ds);
+	for(int i=0; i<sym_count; i++) {
+		sym_handle[i] = -1;
+	}
+}
+
+bool dsys::StartPart(int handle) {
+	Part *part = GetPart(handle);
+	if(!part || (!seeking && !LoadNow(part))) return false;
+
+	if(!parts[handle].running) InsertRunning(handle);
+	part->Start();
+	return true;
+}
+
+bool dsys::EndPart(int handle) {
+	if(!GetPart(handle) || !parts[handle].running) return false;
+
+	parts[handle].part->Stop();
+	RemoveRunning(handle);
+	return true;
+}
+
+bool dsys::RenamePart(int handle, const char *new_name) {
+	Part *part = GetPart(handle);
+	if(!part || !new_name) return false;
+
+	std::map<std::string, int>::iterator iter;
+	if(part->GetName() && (iter = part_handles.find(part->GetName())) != part_handles.end() &&
+			iter->second == handle) {
+		part_handles.erase(iter);
+	}
+	part->SetName(new_name);
+	part_handles[new_name] = handle;
+
+	if(parts[handle].running) {
+		RemoveRunning(handle);
+		InsertRunning(handle);
+	}
+
+	ResetSymbols();
+	return true;
+}
+
+bool dsys::SetRenderTarget(int handle, RenderTarget targ) {
+	Part *part = GetPart(handle);
+	if(!part) return false;
+	part->SetTarget(targ);
+	return true;
+}
+
+bool dsys::SetClear(int handle, bool enable) {
+	Part *part = GetPart(handle);
+	if(!part) return false;
+	part->SetClear(enable);
+	return true;
+}
+
+bool dsys::SetLayer(int handle, int layer) {
+	if(!GetPart(handle)) return false;
+
+	parts[handle].layer = layer;
+	if(parts[handle].running) {
+		RemoveRunning(handle);
+		InsertRunning(handle);
+	}
+	return true;
+}
+
+int dsys::GetLayer(int handle) {
+	return GetPart(handle) ? parts[handle].layer : 0;
+}
+
+bool dsys::StartPart(const char *pname) {
+	return StartPart(GetPartHandle(pname));
+}
+
+bool dsys::EndPart(const char *pname) {
+	return EndPart(GetPartHandle(pname));
+}
+
+bool dsys::RenamePart(const char *pname, const char *new_name) {
+	return RenamePart(GetPartHandle(pname), new_name);
 }
 
 bool dsys::SetRenderTarget(const char *pname, const char *treg) {
@@ -138,14 +304,7 @@ bool dsys::SetRenderTarget(const char *pname, const char *treg) {
 		}
 	}
 	
-	_KeyPart key;
-	key.SetName(pname);
-	BSTreeNode<Part*> *node = parts.Find(&key);
-	if(node) {
-		node->data->SetTarget((RenderTarget)tnum);
-		return true;
-	}
-	return false;
+	return SetRenderTarget(GetPartHandle(pname), (RenderTarget)tnum);
 }
 
 bool dsys::SetClear(const char *pname, const char *enable) {
@@ -162,75 +321,328 @@ bool dsys::SetClear(const char *pname, const char *enable) {
 		return false;
 	}
 		
-	_KeyPart key;
-	key.SetName(pname);
-	BSTreeNode<Part*> *node = parts.Find(&key);
-	if(node) {
-		node->data->SetClear(enable_val);
-		return true;
+	return SetClear(GetPartHandle(pname), enable_val);
+}
+
+bool dsys::SetLayer(const char *pname, int layer) {
+	return SetLayer(GetPartHandle(pname), layer);
+}
+
+/* Finds out when each part runs by walking the compiled script, following
+ * the part names through rename_part commands like ExecuteScript would.
+ */
+static void BuildTimeline() {
+	std::map<std::string, int> names(part_handles);
+	for(size_t i=0; i<parts.size(); i++) {
+		parts[i].start.clear();
+		parts[i].end.clear();
+		parts[i].requested = parts[i].failed = false;
+	}
+
+	for(int i=0; i<ds->cmd_count; i++) {
+		const DemoCommand *cmd = ds->cmd + i;
+		if(cmd->type != CMD_START_PART && cmd->type != CMD_END_PART && cmd->type != CMD_RENAME_PART) {
+			continue;
+		}
+
+		std::map<std::string, int>::iterator iter = names.find(GetSymbol(ds, cmd->argv[0]));
+		if(iter == names.end()) continue;
+
+		PartEntry *pe = &parts[iter->second];
+		switch(cmd->type) {
+		case CMD_START_PART:
+			if(pe->start.size() == pe->end.size()) {
+				pe->start.push_back(cmd->time);
+			}
+			break;
+
+		case CMD_END_PART:
+			if(pe->end.size() < pe->start.size()) {
+				pe->end.push_back(cmd->time);
+			}
+			break;
+
+		case CMD_RENAME_PART:
+			{
+				int handle = iter->second;
+				names.erase(iter);
+				names[GetSymbol(ds, cmd->argv[1])] = handle;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// still running when the script ends
+	for(size_t i=0; i<parts.size(); i++) {
+		if(parts[i].end.size() < parts[i].start.size()) {
+			parts[i].end.push_back(ULONG_MAX);
+		}
 	}
-	return false;
 }
 
 bool dsys::StartDemo() {
 	if(!(ds = OpenScript(script_fname))) {
 		return false;
 	}
+
+	for(size_t i=0; i<parts.size(); i++) {
+		PartEntry *pe = &parts[i];
+		delete [] pe->name;
+		pe->name = new char[strlen(pe->part->GetName()) + 1];
+		strcpy(pe->name, pe->part->GetName());
+		pe->target = pe->part->GetTarget();
+		pe->clear = pe->part->GetClear();
+		pe->init_layer = pe->layer;
+	}
+
+	BuildTimeline();
+
+	int sym_count = GetSymbolCount(ds);
+	sym_handle = new int[sym_count ? sym_count : 1];
+	ResetSymbols();
+	
 	demo_running = true;
 	timer_reset(&timer);
+	frame_time = 0;
+	fixed_frame = 0;
+	memset(&clock_stats, 0, sizeof clock_stats);
 	return true;
 }
 
 void dsys::EndDemo() {
 	CloseScript(ds);
+	delete [] sym_handle;
+	sym_handle = 0;
 	demo_running = false;
 }
 
 
-static void UpdateNode(BSTreeNode<Part*> *node) {
-	node->data->UpdateGraphics();
+bool dsys::Seek(unsigned long msec) {
+	if(!demo_running) return false;
+
+	// stop everything and bring the parts back to their initial state
+	for(size_t i=0; i<running.size(); i++) {
+		parts[running[i]].part->Stop();
+		parts[running[i]].running = false;
+	}
+	running.clear();
+	part_handles.clear();
+
+	for(size_t i=0; i<parts.size(); i++) {
+		PartEntry *pe = &parts[i];
+		pe->part->SetName(pe->name);
+		pe->part->SetTarget(pe->target);
+		pe->part->SetClear(pe->clear);
+		pe->layer = pe->init_layer;
+		part_handles[pe->name] = (int)i;
+	}
+	ResetSymbols();
+
+	// free what's not needed anymore before loading the rest
+	UpdateResources(msec, 0);
+
+	// replay the timeline up to the requested time
+	RewindScript(ds);
+	timer_setmsec(&timer, msec);
+	frame_time = msec;
+	fixed_frame = fixed_fps ? (msec * fixed_fps + 999) / 1000 : 0;
+	
+	// parts started and ended before msec are never loaded
+	int res;
+	seeking = true;
+	while((res = ExecuteScript(ds, msec, false)) == 0);
+	seeking = false;
+
+	for(size_t i=0; i<running.size();) {
+		Part *part = parts[running[i]].part;
+		if(LoadNow(part)) {
+			i++;
+		} else {
+			part->Stop();
+			RemoveRunning(running[i]);
+		}
+	}
+
+	cerr << "seek(" << msec << ")\n";
+	return res != EOF;
+}
+
+unsigned long dsys::GetTime() {
+	return frame_time;
+}
+
+void dsys::SetClock(long (*func)()) {
+	clock_func = func;
+}
+
+void dsys::SetFixedFrameRate(int fps) {
+	fixed_fps = fps;
+	fixed_frame = fps ? (frame_time * fps + 999) / 1000 : 0;
+}
+
+const ClockStats *dsys::GetClockStats() {
+	return &clock_stats;
+}
+
+void dsys::SetPrefetchTime(unsigned long msec) {
+	prefetch_time = msec;
+}
+
+static bool NeededAt(const PartEntry *pe, unsigned long time) {
+	for(size_t i=0; i<pe->start.size(); i++) {
+		unsigned long from = pe->start[i] > prefetch_time ? pe->start[i] - prefetch_time : 0;
+		if(time >= from && time < pe->end[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool dsys::UpdateResources(unsigned long time, unsigned long max_msec) {
+	bool idle = UpdateLoader(max_msec);
+	bool ready = true;
+
+	for(size_t i=0; i<parts.size(); i++) {
+		PartEntry *pe = &parts[i];
+		Part *part = pe->part;
+
+		if(!NeededAt(pe, time)) {
+			if((pe->requested || part->IsLoaded()) && !pe->running) {
+				part->Unload();
+				pe->requested = pe->failed = false;
+			}
+			continue;
+		}
+
+		if(part->IsLoaded() || pe->failed) continue;
+
+		if(!pe->requested) {
+			part->RequestAssets();
+			pe->requested = true;
+			idle = false;
+		}
+
+		// the loader doesn't track which request belongs to which part
+		if(idle && !part->Load()) {
+			cerr << "failed to load part: " << part->GetName() << "\n";
+			pe->failed = true;
+			continue;
+		}
+		if(!part->IsLoaded()) ready = false;
+	}
+	return ready;
+}
+
+/* The internal timer gives smooth frame times, the master clock is what
+ * we should be showing. Small drift is slewed away a bit every frame,
+ * large jumps (stalls, seeks) snap the timer to the master clock.
+ */
+static unsigned long ReadClock() {
+	unsigned long t = timer_getmsec(&timer);
+	long master;
+	
+	if(!clock_func || (master = clock_func()) < 0) {
+		return t;
+	}
+
+	long drift = master - (long)t;
+	long abs_drift = drift < 0 ? -drift : drift;
+
+	clock_stats.drift = drift;
+	if(abs_drift > clock_stats.max_drift) clock_stats.max_drift = abs_drift;
+	clock_stats.samples++;
+	clock_stats.avg_drift += (abs_drift - clock_stats.avg_drift) / clock_stats.samples;
+
+	if(abs_drift > CLOCK_SNAP) {
+		t = master;
+		clock_stats.resyncs++;
+	} else {
+		t += drift / CLOCK_SLEW;
+	}
+	timer_setmsec(&timer, t);
+	
+	return t;
 }
 
 int dsys::UpdateGraphics() {
 	if(!demo_running) return 1;
 
+	if(fixed_fps) {
+		// computed from the frame number so that it doesn't accumulate error
+		frame_time = (unsigned long)((double)fixed_frame++ * 1000.0 / fixed_fps);
+	} else {
+		// never let the frame time run backwards
+		unsigned long t = ReadClock();
+		if(t > frame_time) frame_time = t;
+	}
+
 	int res;
-	while((res = ExecuteScript(ds, timer_getmsec(&timer))) != 1) {
+	while((res = ExecuteScript(ds, frame_time)) != 1) {
 		if(res == EOF) {
 			EndDemo();
 			return -1;
 		}
 	}
+	UpdateResources(frame_time, LOAD_SLICE_MSEC);
 
 	// update graphics
-	Clear(Color(0.0f, 0.0f, 0.0f));
-	ClearZBufferStencil(1.0f, 0);
+	{
+		PROF_SCOPE("frame");
+		Clear(Color(0.0f, 0.0f, 0.0f));
+		ClearZBufferStencil(1.0f, 0);
 	
-	running.Traverse(UpdateNode, TRAVERSE_INORDER);
+		frame_parts.clear();
+		for(size_t i=0; i<running.size(); i++) {
+			frame_parts.push_back(parts[running[i]].part);
+		}
+		BuildRenderGraph(frame_parts.empty() ? 0 : &frame_parts[0], (int)frame_parts.size());
+		DrawRenderGraph();
 
-	Flip();
+		if(IsCapturing()) CaptureFrame();
+		Flip();
+	}
+	ProfFrame();
 	return 0;
 }
 
-static int ExecuteScript(DemoScript *ds, unsigned long time) {
-	DemoCommand cmd;
+static int FindPart(int sym) {
+	if(sym_handle[sym] == -1) {
+		sym_handle[sym] = GetPartHandle(GetSymbol(ds, sym));
+	}
+	return sym_handle[sym];
+}
+
+static std::ostream null_stream(0);
+
+static int ExecuteScript(DemoScript *ds, unsigned long time, bool verbose) {
+	const DemoCommand *cmd;
 	
 	int res = GetNextCommand(ds, &cmd, time);
 	if(res == EOF || res == 1) {
 		return res;
 	}
 
+	std::ostream &cerr = verbose ? std::cerr : null_stream;
+
 	bool op_res = true;
+	const char *arg0 = cmd->argc > 0 ? GetSymbol(ds, cmd->argv[0]) : 0;
+	const char *arg1 = cmd->argc > 1 ? GetSymbol(ds, cmd->argv[1]) : 0;
+	int handle;
 
-	switch(cmd.type) {
+	switch(cmd->type) {
 	case CMD_START_PART:
-		cerr << "start_part(" << cmd.args << ")";
-		op_res = StartPart(cmd.args);
+		cerr << "start_part(" << arg0 << ")";
+		if((op_res = StartPart(handle = FindPart(cmd->argv[0])))) {
+			parts[handle].part->SetTime(time - cmd->time);
+		}
 		break;
 
 	case CMD_END_PART:
-		cerr << "end_part(" << cmd.args << ")";
-		op_res = EndPart(cmd.args);
+		cerr << "end_part(" << arg0 << ")";
+		op_res = EndPart(FindPart(cmd->argv[0]));
 		break;
 
 	case CMD_END:
@@ -238,47 +650,23 @@ static int ExecuteScript(DemoScript *ds, unsigned long time) {
 		return EOF;
 
 	case CMD_RENAME_PART:
-		{
-			if(!cmd.args) return 1;
-			char *prev_name = strtok(cmd.args, " \t");
-			if(!prev_name) return 1;
-			
-			char *nname = strtok(0, " \t");
-			if(!nname) return 1;
-			
-			cerr << "rename_part(" << prev_name << ", " << nname << ")";
-			op_res = RenamePart(prev_name, nname);
-		}
+		cerr << "rename_part(" << arg0 << ", " << arg1 << ")";
+		op_res = RenamePart(FindPart(cmd->argv[0]), arg1);
 		break;
 
 	case CMD_SET_RTARGET:
-		{
-			if(!cmd.args) return 1;
-			char *pname = strtok(cmd.args, " \t");
-			if(!pname) return 1;
-
-			char *treg = strtok(0, " \t");
-			if(	!treg || (strcmp(treg, "fb") && 
-				(treg[0] != 't' || !isdigit(treg[1])))) return 1;
-
-			cerr << "set_rtarget(" << pname << ", " << treg << ")";
-			op_res = SetRenderTarget(pname, treg);
-		}
+		cerr << "set_rtarget(" << arg0 << ", " << arg1 << ")";
+		op_res = SetRenderTarget(FindPart(cmd->argv[0]), arg1[0] == 'f' ? RT_FB : (RenderTarget)(arg1[1] - '0'));
 		break;
 
 	case CMD_SET_CLEAR:
-		{
-			if(!cmd.args) return 1;
-			char *pname = strtok(cmd.args, " \t");
-			if(!pname) return 1;
-
-			char *enable = strtok(0, " \t");
-			if(!enable || (strcmp(enable, "true") && strcmp(enable, "false"))) {
-				return 1;
-			}
-			cerr << "set_clear(" << pname << ", " << enable << ")";
-			op_res = SetClear(pname, enable);
-		}
+		cerr << "set_clear(" << arg0 << ", " << arg1 << ")";
+		op_res = SetClear(FindPart(cmd->argv[0]), arg1[0] == 't');
+		break;
+
+	case CMD_SET_LAYER:
+		cerr << "set_layer(" << arg0 << ", " << arg1 << ")";
+		op_res = SetLayer(FindPart(cmd->argv[0]), atoi(arg1));
 		break;
 
 	default:
@@ -293,4 +681,3 @@ static int ExecuteScript(DemoScript *ds, unsigned long time) {
 
 	return 0;
 }
-
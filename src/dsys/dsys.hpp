@@ -34,24 +34,83 @@ namespace dsys {
 	extern Texture *tex[4];
 	extern unsigned int rtex_size_x, rtex_size_y;
 
+	// clock drift statistics, in milliseconds
+	struct ClockStats {
+		long drift;				// master clock minus demo clock, last frame
+		long max_drift;			// largest absolute drift seen
+		double avg_drift;		// running average of the absolute drift
+		unsigned long resyncs;	// times the demo clock jumped to the master
+		unsigned long samples;
+	};
+
 	bool Init();
 	void CleanUp();
 
 	void SetDemoScript(const char *fname);
 
-	void AddPart(Part *part);
+	/* registers a part, returning the handle that the functions below
+	 * accept in place of its name. Handles stay valid when parts are renamed.
+	 */
+	int AddPart(Part *part);
+	int GetPartHandle(const char *pname);	// -1 if there's no such part
+	Part *GetPart(int handle);
+
+	bool StartPart(int handle);
+	bool EndPart(int handle);
+	bool RenamePart(int handle, const char *new_name);
+	bool SetRenderTarget(int handle, RenderTarget targ);
+	bool SetClear(int handle, bool enable);
+
+	/* running parts are drawn in order of increasing layer (default 0),
+	 * parts on the same layer in alphabetical order of their names.
+	 */
+	bool SetLayer(int handle, int layer);
+	int GetLayer(int handle);
 	
 	bool StartPart(const char *pname);
 	bool EndPart(const char *pname);
 	bool RenamePart(const char *pname, const char *new_name);
 	bool SetRenderTarget(const char *pname, const char *treg);
 	bool SetClear(const char *pname, const char *enable);
+	bool SetLayer(const char *pname, int layer);
 	//bool StartEffect(const char *pname, const char *args);
 	//bool StopEffect(const char *pname, const char *args);
 
 	bool StartDemo();
 	int UpdateGraphics();
 	void EndDemo();
+
+	/* jumps to the specified demo time, restarting the parts that should be
+	 * running at that point with the correct local time, names, render
+	 * targets, clear flags and layers as the script would have left them.
+	 */
+	bool Seek(unsigned long msec);
+
+	/* the demo time of the current frame, the same for all parts */
+	unsigned long GetTime();
+
+	/* sets a master clock (e.g. the music playback position) to follow,
+	 * returning the demo time in msec, or a negative value when it's not
+	 * available in which case the internal timer runs free.
+	 */
+	void SetClock(long (*clock_func)());
+
+	/* steps the demo time by exactly 1/fps of a second per frame regardless
+	 * of the wall clock or the master clock, 0 returns to real time.
+	 */
+	void SetFixedFrameRate(int fps);
+	const ClockStats *GetClockStats();
+
+	/* parts are loaded when the script is about to start them, msec ahead
+	 * of their start_part, and unloaded after their end_part.
+	 */
+	void SetPrefetchTime(unsigned long msec);
+
+	/* loads and unloads parts for the given demo time, spending at most
+	 * max_msec on texture uploads. Returns true when all parts needed at
+	 * that time are loaded. Called every frame by UpdateGraphics.
+	 */
+	bool UpdateResources(unsigned long time, unsigned long max_msec);
 }
 
 #endif	// _DSYS_HPP_
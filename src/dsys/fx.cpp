@@ -18,19 +18,156 @@ along with "The Lab demosystem"; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <cstdio>
+#include <cstring>
 #include "fx.hpp"
+#include "sprite.hpp"
 #include "3dengfx.hpp"
 
+/* The blurs are a stack of shifted or scaled full screen quads, which the
+ * shader version draws in one pass. Each tap stands in for a group of
+ * consecutive quads and is weighted so that it blends like they would.
+ */
+#define MAX_BLUR_TAPS	32
+
+static const int blur_tap_count[] = {8, 16, 32};
+static int blur_quality = dsys::BLUR_MEDIUM;
+static unsigned int blur_prog[3];
+static bool blur_prog_failed[3];
+
+// uniform locations of each blur program, looked up once after linking
+struct BlurUniforms {
+	int tex, origin, blend, taps;
+};
+static BlurUniforms blur_loc[3];
+
+// per quad: texture coordinate offset (xy), inverse scale (z), alpha (w)
+static float blur_quads[4 * 256];
+static float blur_taps[4 * MAX_BLUR_TAPS];
+
+static const char *blur_psrc =
+	"uniform sampler2D tex;\n"
+	"uniform vec2 origin;\n"
+	"uniform vec4 taps[TAPS];\n"
+	"uniform float blend;\n"
+	"\n"
+	"void main() {\n"
+	"	vec2 dir = gl_TexCoord[0].xy - origin;\n"
+	"	vec3 sum = vec3(0.0, 0.0, 0.0);\n"
+	"	float trans = 1.0;\n"
+	"	for(int i=0; i<TAPS; i++) {\n"
+	"		vec2 tc = origin + dir * taps[i].z + taps[i].xy;\n"
+	"		vec2 inside = step(vec2(0.0, 0.0), tc) * step(tc, vec2(1.0, 1.0));\n"
+	"		vec4 col = texture2D(tex, tc);\n"
+	"		float a = taps[i].w * col.a * inside.x * inside.y;\n"
+	"		sum = sum * (1.0 - a * blend) + col.rgb * a;\n"
+	"		trans *= 1.0 - a * blend;\n"
+	"	}\n"
+	"	gl_FragColor = vec4(sum, trans);\n"
+	"}\n";
+
+void dsys::SetBlurQuality(int quality) {
+	blur_quality = quality;
+}
+
+static unsigned int GetBlurProgram() {
+	if(blur_quality < 0 || blur_quality > dsys::BLUR_HIGH || blur_prog_failed[blur_quality]) {
+		return 0;
+	}
+
+	if(!blur_prog[blur_quality]) {
+		char *src = new char[strlen(blur_psrc) + 32];
+		sprintf(src, "#define TAPS %d\n%s", blur_tap_count[blur_quality], blur_psrc);
+		blur_prog[blur_quality] = CreateProgram(0, src);
+		delete [] src;
+
+		if(!blur_prog[blur_quality]) {
+			blur_prog_failed[blur_quality] = true;
+			return 0;
+		}
+
+		unsigned int prog = blur_prog[blur_quality];
+		BlurUniforms *loc = blur_loc + blur_quality;
+		loc->tex = GetUniformLocation(prog, "tex");
+		loc->origin = GetUniformLocation(prog, "origin");
+		loc->blend = GetUniformLocation(prog, "blend");
+		loc->taps = GetUniformLocation(prog, "taps");
+	}
+	return blur_prog[blur_quality];
+}
+
+/* draws the quads in blur_quads with the blur shader, returns false if
+ * shaders are not available and it's up to the caller to draw them.
+ */
+static bool DrawBlur(Texture *tex, const Vector2 &origin, int count, bool additive) {
+	unsigned int prog;
+	if(!GetSystemCapabilities().glslang || !(prog = GetBlurProgram())) {
+		return false;
+	}
+	if(count <= 0) return true;
+
+	int taps = blur_tap_count[blur_quality];
+	if(taps > count) taps = count;
+
+	memset(blur_taps, 0, sizeof blur_taps);
+	for(int i=0; i<taps; i++) {
+		int first = i * count / taps;
+		int last = (i + 1) * count / taps;
+		const float *mid = blur_quads + 4 * ((first + last - 1) / 2);
+
+		float *tap = blur_taps + 4 * i;
+		tap[0] = mid[0];
+		tap[1] = mid[1];
+		tap[2] = mid[2];
+
+		// additive quads just add up, the rest cover what's behind them
+		float weight = 0.0f, trans = 1.0f;
+		for(int j=first; j<last; j++) {
+			weight += blur_quads[4 * j + 3];
+			trans *= 1.0f - blur_quads[4 * j + 3];
+		}
+		tap[3] = additive ? weight : 1.0f - trans;
+	}
+
+	const BlurUniforms *loc = blur_loc + blur_quality;
+	SetProgram(prog);
+	SetUniform(loc->tex, 0);
+	SetUniform(loc->origin, origin.x, origin.y);
+	SetUniform(loc->blend, additive ? 0.0f : 1.0f);
+	SetUniform4v(loc->taps, blur_taps, blur_tap_count[blur_quality]);
+
+	// the shader outputs the blended color and how much of the background shows
+	SetAlphaBlending(true);
+	SetBlendFunc(BLEND_ONE, BLEND_SRC_ALPHA);
+	dsys::Overlay(tex, Vector2(0.0f, 1.0f), Vector2(1.0f, 0.0f), Color(1.0f, 1.0f, 1.0f, 1.0f), false);
+	SetAlphaBlending(false);
+
+	SetProgram(0);
+	return true;
+}
+
 void dsys::RadialBlur(Texture *tex, float ammount, const Vector2 &origin, bool additive) {
+	PROF_SCOPE("RadialBlur");
 	Vector2 c1(0.0f, 1.0f), c2(1.0f, 0.0f);
 
-	SetAlphaBlending(true);
-	if(additive) {
-		SetBlendFunc(BLEND_SRC_ALPHA, BLEND_ONE);
-	} else {
-		SetBlendFunc(BLEND_SRC_ALPHA, BLEND_ONE_MINUS_SRC_ALPHA);
+	float quad_ammount = ammount + 1.0f;
+	int count = (int)(quad_ammount * 20.0f);
+	if(count > 256) count = 256;
+	float quad_dscale = (quad_ammount - 1.0f) / (float)count;
+	for(int i=0; i<count; i++) {
+		float *quad = blur_quads + 4 * i;
+		quad[0] = quad[1] = 0.0f;
+		quad[2] = 1.0f / (1.0f + quad_dscale * (float)i);
+		quad[3] = (float)((count-1) - i) / (float)count;
 	}
-	
+	// the quads are drawn flipped vertically relative to the texture
+	if(DrawBlur(tex, Vector2(origin.x, 1.0f - origin.y), count, additive)) {
+		return;
+	}
+
+	BlendingFactor dest = additive ? BLEND_ONE : BLEND_ONE_MINUS_SRC_ALPHA;
+	BeginSprites();
+
 	ammount += 1.0f;
 	int quad_count = (int)(ammount * 20.0f);
 	float dscale = (ammount - 1.0f) / (float)quad_count;
@@ -46,28 +183,46 @@ void dsys::RadialBlur(Texture *tex, float ammount, const Vector2 &origin, bool a
 		v2 += origin;
 		
 		float alpha = (float)((quad_count-1) - i) / (float)quad_count;
-		dsys::Overlay(tex, v1, v2, Color(1.0f, 1.0f, 1.0f, alpha), false);
+		DrawSprite(tex, v1, v2, Color(1.0f, 1.0f, 1.0f, alpha), BLEND_SRC_ALPHA, dest);
 		scale += dscale;
 	}
 
-	SetAlphaBlending(false);
+	EndSprites();
 }
 
 void dsys::DirBlur(Texture *tex, float ammount, int dir) {
+	PROF_SCOPE("DirBlur");
 	Vector2 c1(0.0f, 1.0f), c2(1.0f, 0.0f);
 	
 	ammount *= 0.5f;
 	int quad_count = (int)(ammount * 100.0f);
 	float offs_inc = ammount / (float)(quad_count/2);
 	float offs = 0.0f;
+
+	int count = quad_count / 2 < 256 ? quad_count / 2 : 256;
+	for(int i=0; i<count; i++) {
+		float *quad = blur_quads + 4 * i;
+		quad[0] = dir == BLUR_DIR_X ? -offs : 0.0f;
+		quad[1] = dir == BLUR_DIR_X ? 0.0f : offs;
+		quad[2] = 1.0f;
+		quad[3] = 1.0f - offs / ammount;
+		offs += offs_inc;
+	}
+	if(DrawBlur(tex, Vector2(0.0f, 0.0f), count, false)) {
+		return;
+	}
+	offs = 0.0f;
+
+	BeginSprites();
 	for(int i=0; i<quad_count/2; i++) {
 		Vector2 off_vec = dir == BLUR_DIR_X ? Vector2(offs, 0) : Vector2(0, offs);
 
 		float alpha = 1.0f - offs / ammount;
-		dsys::Overlay(tex, c1 + off_vec, c2 + off_vec, Color(1.0f, 1.0f, 1.0f, alpha));
-		//dsys::Overlay(tex, c1 - off_vec, c2 - off_vec, Color(1.0f, 1.0f, 1.0f, alpha));
+		DrawSprite(tex, c1 + off_vec, c2 + off_vec, Color(1.0f, 1.0f, 1.0f, alpha));
+		//DrawSprite(tex, c1 - off_vec, c2 - off_vec, Color(1.0f, 1.0f, 1.0f, alpha));
 		offs += offs_inc;
 	}
+	EndSprites();
 }
 
 /*
@@ -134,6 +289,7 @@ void dsys::Overlay(Texture *tex, const Vector2 &corner1, const Vector2 &corner2,
 		SetTexture(0, tex);
 	}
 	
+	MarkTargetDirty();
 	glBegin(GL_QUADS);
 	glColor4f(color.r, color.g, color.b, color.a);
 	glTexCoord2f(0.0f, 0.0f);
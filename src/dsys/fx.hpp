@@ -29,6 +29,13 @@ class Texture;
 namespace dsys {
 
 	enum {BLUR_DIR_X, BLUR_DIR_Y};
+
+	/* quality of the blurs drawn with shaders, in number of texture reads
+	 * per pixel (8, 16, 32). BLUR_QUADS always uses the old stack of
+	 * blended quads, which is also the fallback without shaders.
+	 */
+	enum {BLUR_LOW, BLUR_MEDIUM, BLUR_HIGH, BLUR_QUADS};
+	void SetBlurQuality(int quality);
 	
 	// effects
 	void RadialBlur(Texture *tex, float ammount, const Vector2 &origin = Vector2(0.5f, 0.5f), bool additive = false);
@@ -20,8 +20,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include "part.hpp"
 #include "3dengfx.hpp"
+#include "3dscene.hpp"
 
 using namespace dsys;
 
@@ -35,56 +37,105 @@ Part::Part(const char *name) {
 	
 	target = RT_FB;
 	clear = false;
-	timer_reset(&timer);
+	inputs = 0;
+	inputs_declared = false;
+	scratch = 0;
+	start_time = 0;
+	prof_zone[0] = prof_zone[1] = prof_zone[2] = -1;
+	loaded = false;
 }
 
 Part::~Part() {
 	if(name) delete [] name;
+	ReleaseTextures();
 }
 
 
-void Part::PreDraw() {
-	if(target != RT_FB) {
-		::SetRenderTarget(dsys::tex[target]);
+bool Part::LoadPart() {
+	return true;
+}
+
+void Part::UnloadPart() {}
+
+Texture *Part::LoadTexture(const char *fname) {
+	Texture *tex = GetTexture(fname);
+	UseTexture(tex);
+	return tex;
+}
+
+void Part::UseTexture(Texture *tex) {
+	if(!tex) return;
+
+	for(size_t i=0; i<textures.size(); i++) {
+		if(textures[i] == tex) return;
+	}
+	textures.push_back(tex);
+	AddTextureRef(tex);
+}
+
+void Part::AddTextures(Object *obj) {
+	Material *mat = obj->GetMaterialPtr();
+	for(int i=0; i<MAX_TEXTURES; i++) {
+		UseTexture(mat->tex[i]);
+	}
+}
+
+void Part::AddTextures(Scene *scene) {
+	std::list<Object*>::iterator iter = scene->GetObjectsList()->begin();
+	while(iter != scene->GetObjectsList()->end()) {
+		AddTextures(*iter++);
+	}
+}
+
+void Part::AddPrograms(Object *obj, unsigned int light_mask, bool instanced) {
+	unsigned int features = GetMaterialFeatures(*obj->GetMaterialPtr(), true, light_mask);
+	GetMaterialProgram(features);
+	if(instanced) GetMaterialProgram(features | MATF_INSTANCED);
+}
+
+void Part::AddPrograms(Scene *scene) {
+	std::list<Object*>::iterator iter = scene->GetObjectsList()->begin();
+	while(iter != scene->GetObjectsList()->end()) {
+		AddPrograms(*iter++, scene->GetLightMask());
+	}
+}
+
+void Part::ReleaseTextures() {
+	for(size_t i=0; i<textures.size(); i++) {
+		ReleaseTexture(textures[i]);
 	}
+	textures.clear();
+}
+
+void Part::PreDraw() {
+	BindTarget();
 	
 	if(clear) {
 		Clear(Color(0, 0, 0));
 		ClearZBufferStencil(1.0f, 0);
 	}
-	time = timer_getmsec(&timer);
+	// local time derived from the (master) demo clock
+	unsigned long now = dsys::GetTime();
+	time = now > start_time ? now - start_time : 0;
 }
 
 void Part::PostDraw() {
-	if(target != RT_FB) {
-		/*
-		SetTexture(0, dsys::tex[(int)target]);
-		while(glGetError() != GL_NO_ERROR);
-		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, rtex_size_x, rtex_size_y);
-		
-		GLenum error;
-		if((error = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "Error @ PostDraw() of part " << name << ": ";
-			std::cerr << GetGLErrorString(error) << "\n";
-		}
-
-		const GraphicsInitParameters *gip = GetGraphicsInitParameters();
-		SetViewport(0, 0, gip->x, gip->y);
-		*/
-		::SetRenderTarget(0);
+	// the next part binds its own target, no need to switch back here
+	if(scratch) {
+		ReleaseRenderTarget(scratch);
+		scratch = 0;
 	}
-
-	// TODO: apply post effects
 	
 	// reset states
 	for(int i=0; i<8; i++) {
-		glDisable(GL_LIGHT0 + i);
+		SetLight(i, false);
 	}
 
 	SetAmbientLight(0.0f);
 }
 
 void Part::SetName(const char *name) {
+	if(this->name) delete [] this->name;
 	this->name = new char[strlen(name)+1];
 	strcpy(this->name, name);
 }
@@ -97,22 +148,105 @@ void Part::SetClear(bool enable) {
 	clear = enable;
 }
 
+bool Part::GetClear() const {
+	return clear;
+}
+
 void Part::Start() {
-	timer_reset(&timer);
+	start_time = dsys::GetTime();
 }
 
 void Part::Stop() {}
 
+void Part::SetTime(unsigned long msec) {
+	start_time = dsys::GetTime() - msec;
+}
+
 void Part::SetTarget(RenderTarget targ) {
 	target = targ;
 }
 
+RenderTarget Part::GetTarget() const {
+	return target;
+}
+
+void Part::ReadTarget(RenderTarget targ) {
+	if(targ != RT_FB) inputs |= 1 << targ;
+	inputs_declared = true;
+}
+
+unsigned int Part::GetInputs() const {
+	return inputs;
+}
+
+bool Part::InputsDeclared() const {
+	return inputs_declared;
+}
+
+void Part::BindTarget() {
+	::SetRenderTarget(target == RT_FB ? 0 : dsys::tex[target]);
+}
+
+Texture *Part::GetScratchTarget() {
+	if(!scratch) {
+		scratch = AcquireRenderTarget(rtex_size_x, rtex_size_y);
+	}
+	return scratch;
+}
+
 void Part::UpdateGraphics() {
+	if(!ProfilerEnabled()) {
+		PreDraw();
+		DrawPart();
+		PostDraw();
+		return;
+	}
+
+	if(prof_zone[0] == -1) {
+		static const char *phase[] = {"pre", "draw", "post"};
+		char zname[256];
+		for(int i=0; i<3; i++) {
+			sprintf(zname, "%.200s:%s", name ? name : "part", phase[i]);
+			prof_zone[i] = ProfZone(zname);
+		}
+	}
+
+	ProfBegin(prof_zone[0]);
 	PreDraw();
+	ProfEnd(prof_zone[0]);
+
+	ProfBegin(prof_zone[1]);
 	DrawPart();
+	ProfEnd(prof_zone[1]);
+
+	ProfBegin(prof_zone[2]);
 	PostDraw();
+	ProfEnd(prof_zone[2]);
+}
+
+void Part::RequestAssets() {}
+
+bool Part::Load() {
+	if(loaded) return true;
+
+	if(!LoadPart()) {
+		// clean up whatever got loaded before the failure
+		UnloadPart();
+		ReleaseTextures();
+		return false;
+	}
+	loaded = true;
+	return true;
+}
+
+void Part::Unload() {
+	if(!loaded) return;
+
+	UnloadPart();
+	ReleaseTextures();
+	loaded = false;
 }
 
-bool Part::operator <(const Part &part) const {
-	return strcmp(name, part.name) < 0;
+bool Part::IsLoaded() const {
+	return loaded;
 }
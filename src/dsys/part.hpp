@@ -21,23 +21,77 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #ifndef _PART_HPP_
 #define _PART_HPP_
 
-#include "timer.h"
+#include <vector>
 #include "dsys.hpp"
 
+class Object;
+class Scene;
+
 namespace dsys {
 
 	class Part {
 	protected:
 		char *name;
-		ntimer timer;
+		unsigned long start_time;	// demo time when the part started
 		unsigned long time;
 		dsys::RenderTarget target;
 		bool clear;
+		unsigned int inputs;	// bit mask of the targets read, see ReadTarget
+		bool inputs_declared;
+		Texture *scratch;
+		int prof_zone[3];	// pre/draw/post profiler zones, registered lazily
+		bool loaded;
+		std::vector<Texture*> textures;	// released along with the part
 
 		virtual void PreDraw();
 		virtual void DrawPart() = 0;
 		virtual void PostDraw();
 
+		// create and free everything the part needs to draw
+		virtual bool LoadPart();
+		virtual void UnloadPart();
+
+		/* GetTexture() for textures that should be freed when the part is
+		 * unloaded, unless another loaded part still uses them. AddTextures
+		 * does the same for the material textures of loaded geometry.
+		 * Only the textures taken this way are released, and the part must
+		 * take all of them: geometry loaded by the part keeps pointers to
+		 * its material textures without holding a reference, so a part
+		 * that loads geometry and doesn't call AddTextures on it can be
+		 * left with dangling textures once another part releases them.
+		 */
+		Texture *LoadTexture(const char *fname);
+		void UseTexture(Texture *tex);
+		void AddTextures(Object *obj);
+		void AddTextures(Scene *scene);
+		void ReleaseTextures();
+
+		/* builds the material programs the objects will be drawn with, so
+		 * that they don't get compiled on their first frame. light_mask has
+		 * bit n set for each GL light enabled when the object is drawn lit, and
+		 * instanced also builds the RenderInstances variant. The scene
+		 * version uses the lights of the scene for all its objects.
+		 */
+		void AddPrograms(Object *obj, unsigned int light_mask, bool instanced = false);
+		void AddPrograms(Scene *scene);
+
+		/* declares that the part draws with the contents of another part's
+		 * target, so that the render graph draws that part first. A part
+		 * reading no target at all declares that with RT_FB. Passes drawing
+		 * to a target are only skipped as unread when all running parts
+		 * have declared what they read.
+		 */
+		void ReadTarget(RenderTarget targ);
+
+		/* a render target for intermediate results during DrawPart(), cleared
+		 * when first drawn to. It goes back to the pool after the part is
+		 * drawn, so all parts share the same one.
+		 */
+		Texture *GetScratchTarget();
+
+		// goes back to drawing to the part's target
+		void BindTarget();
+
 	public:
 
 		Part(const char *name = 0);
@@ -46,18 +100,29 @@ namespace dsys {
 		void SetName(const char *name);
 		const char *GetName() const;
 		virtual void SetClear(bool enable);
+		bool GetClear() const;
 
 		virtual void Start();
 		virtual void Stop();
 
+		// sets the local time of a started part, used when seeking
+		void SetTime(unsigned long msec);
+
 		virtual void SetTarget(RenderTarget targ);
+		RenderTarget GetTarget() const;
+		unsigned int GetInputs() const;
+		bool InputsDeclared() const;
 
 		virtual void UpdateGraphics();
 
-		/* the < operator compares the names,
-		 * intended for use by the binary tree.
+		/* RequestAssets() queues the files the part loads on the asset
+		 * loader, so that Load() finds them parsed. dsys calls both ahead
+		 * of the part's start_part, and Unload() after its end_part.
 		 */
-		bool operator <(const Part &part) const;
+		virtual void RequestAssets();
+		bool Load();
+		void Unload();
+		bool IsLoaded() const;
 	};
 }
 
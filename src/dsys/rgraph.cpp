@@ -0,0 +1,122 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <vector>
+#include "rgraph.hpp"
+#include "part.hpp"
+#include "3dengfx.hpp"
+
+using namespace dsys;
+
+#define TARGET_BIT(t)	((t) == RT_FB ? 0 : 1 << (t))
+
+static std::vector<Part*> passes;	// in drawing order
+static std::vector<Part*> unsorted;
+static std::vector<bool> done;
+
+// checks if any of the passes not drawn yet has to be drawn before pass p
+static bool MustWait(size_t p) {
+	unsigned int reads = unsorted[p]->GetInputs();
+	RenderTarget targ = unsorted[p]->GetTarget();
+
+	for(size_t i=0; i<unsorted.size(); i++) {
+		if(done[i] || i == p) continue;
+
+		RenderTarget t = unsorted[i]->GetTarget();
+		if((reads & TARGET_BIT(t)) || (i < p && t == targ)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void dsys::BuildRenderGraph(Part **parts, int count) {
+	unsigned int read = 0;
+	bool readers_known = true;
+	for(int i=0; i<count; i++) {
+		read |= parts[i]->GetInputs();
+		if(!parts[i]->InputsDeclared()) readers_known = false;
+	}
+
+	/* nobody sees what's drawn to a target that isn't read, but parts that
+	 * didn't declare their inputs may read any of dsys::tex[]
+	 */
+	unsorted.clear();
+	for(int i=0; i<count; i++) {
+		RenderTarget targ = parts[i]->GetTarget();
+		if(targ == RT_FB || !readers_known || (read & TARGET_BIT(targ))) {
+			unsorted.push_back(parts[i]);
+		}
+	}
+
+	// writers before readers, keeping the given order where possible
+	passes.clear();
+	done.assign(unsorted.size(), false);
+	for(size_t n=0; n<unsorted.size(); n++) {
+		int first = -1, next = -1;
+		for(size_t i=0; i<unsorted.size(); i++) {
+			if(done[i]) continue;
+			if(first == -1) first = (int)i;
+			if(!MustWait(i)) {
+				next = (int)i;
+				break;
+			}
+		}
+		if(next == -1) next = first;	// cycle, part of it reads last frame's results
+
+		done[next] = true;
+		passes.push_back(unsorted[next]);
+	}
+
+	unsigned int used = read;
+	for(size_t i=0; i<passes.size(); i++) {
+		used |= TARGET_BIT(passes[i]->GetTarget());
+	}
+
+	for(int i=0; i<4; i++) {
+		if((used & TARGET_BIT(i)) && !tex[i]) {
+			tex[i] = AcquireRenderTarget(rtex_size_x, rtex_size_y);
+			::SetRenderTarget(tex[i]);	// clears it, in case it's read before written
+		} else if(!(used & TARGET_BIT(i)) && tex[i]) {
+			ReleaseRenderTarget(tex[i]);
+			tex[i] = 0;
+		}
+	}
+	::SetRenderTarget(0);
+}
+
+void dsys::DrawRenderGraph() {
+	for(size_t i=0; i<passes.size(); i++) {
+		passes[i]->UpdateGraphics();
+	}
+	::SetRenderTarget(0);
+}
+
+void dsys::FreeRenderGraph() {
+	passes.clear();
+	unsorted.clear();
+
+	for(int i=0; i<4; i++) {
+		if(tex[i]) {
+			ReleaseRenderTarget(tex[i]);
+			tex[i] = 0;
+		}
+	}
+}
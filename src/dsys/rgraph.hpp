@@ -0,0 +1,44 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _RGRAPH_HPP_
+#define _RGRAPH_HPP_
+
+namespace dsys {
+
+	class Part;
+
+	/* The running parts make up a render graph, rebuilt every frame. Each
+	 * part is a pass writing its target (set_rtarget) and reading the
+	 * targets it declared with Part::ReadTarget(). Passes writing a target
+	 * are drawn before the passes reading it, otherwise in the order given,
+	 * and passes writing to a target that nothing reads are skipped, when
+	 * all the parts have declared what they read. The
+	 * target textures are taken from the render target pool while some
+	 * running part uses them, and given back afterwards.
+	 */
+	void BuildRenderGraph(Part **parts, int count);
+	void DrawRenderGraph();
+
+	// gives back all the target textures
+	void FreeRenderGraph();
+}
+
+#endif	// _RGRAPH_HPP_
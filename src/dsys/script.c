@@ -26,79 +26,88 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #define BUF_LEN		1024
 
-DemoScript *OpenScript(const char *fname) {
-	DemoScript *script = malloc(sizeof(DemoScript));
-	
-	if(!(script->file = fopen(fname, "r"))) {
-		free(script);
-		return 0;
-	}		
-	script->fname = malloc(strlen(fname)+1);
-	strcpy(script->fname, fname);
-
-	script->line_buffer = malloc(BUF_LEN);
-	script->line_buffer[0] = 0;
-
-	script->line = 0;
-
-	return script;
-}
-
-void CloseScript(DemoScript *ds) {
-	fclose(ds->file);
-	free(ds->fname);
-	free(ds);
-}
-
 static char *cmd_symb[VALID_CMD_COUNT] = {
 	"start_part",
 	"end_part",
 	"end.",
 	"rename_part",
 	"set_rtarget",
-	"set_clear"
+	"set_clear",
+	"set_layer"
 };
 
+/* number of arguments expected by each command */
+static int cmd_argc[VALID_CMD_COUNT] = {1, 1, 0, 2, 2, 2, 2};
+
 static char *SkipSpaces(char *ptr) {
 	while(*ptr && *ptr != '\n' && isspace(*ptr)) ptr++;
 	return ptr;
 }
 
-int GetNextCommand(DemoScript *ds, DemoCommand *cmd, unsigned long time) {
-	char *ptr;
-	char *cmd_tok;
+static int Intern(DemoScript *ds, const char *str, int *sym_cap) {
 	int i;
+	for(i=0; i<ds->sym_count; i++) {
+		if(!strcmp(ds->sym[i], str)) return i;
+	}
+
+	if(ds->sym_count >= *sym_cap) {
+		*sym_cap = *sym_cap ? *sym_cap * 2 : 16;
+		ds->sym = realloc(ds->sym, *sym_cap * sizeof *ds->sym);
+	}
+	ds->sym[ds->sym_count] = malloc(strlen(str) + 1);
+	strcpy(ds->sym[ds->sym_count], str);
+	return ds->sym_count++;
+}
+
+static int ValidArgs(const DemoCommand *cmd, const DemoScript *ds) {
+	const char *arg;
 	
-	if(ds->line_buffer[0] == 0) {
-		if(!fgets(ds->line_buffer, BUF_LEN, ds->file)) {
-			return EOF;
+	switch(cmd->type) {
+	case CMD_SET_RTARGET:
+		arg = ds->sym[cmd->argv[1]];
+		return !strcmp(arg, "fb") || (arg[0] == 't' && arg[1] >= '0' && arg[1] <= '3' && !arg[2]);
+
+	case CMD_SET_CLEAR:
+		arg = ds->sym[cmd->argv[1]];
+		return !strcmp(arg, "true") || !strcmp(arg, "false");
+
+	case CMD_SET_LAYER:
+		arg = ds->sym[cmd->argv[1]];
+		if(*arg == '-') arg++;
+		if(!*arg) return 0;
+		while(*arg) {
+			if(!isdigit(*arg++)) return 0;
 		}
-		ds->line++;
+		return 1;
+
+	default:
+		break;
 	}
+	return 1;
+}
 
-	ptr = SkipSpaces(ds->line_buffer);
+/* parses a single line into cmd, returns 0 for empty/comment lines,
+ * -1 for invalid lines and 1 if a command was parsed.
+ */
+static int ParseLine(DemoScript *ds, char *buf, long line, DemoCommand *cmd, int *sym_cap) {
+	char *ptr, *cmd_tok;
+	int i;
 
-	if(*ptr == '#' || *ptr == '\n') {
-		ds->line_buffer[0] = 0;
-		return GetNextCommand(ds, cmd, time);
-	}
+	ptr = SkipSpaces(buf);
+	if(!*ptr || *ptr == '#' || *ptr == '\n') return 0;
 
 	cmd->time = atoi(ptr);
+	cmd->line = line;
 
-	if(cmd->time > time) {
-		return 1;
-	}
-	
 	while(*ptr && *ptr != '\n' && (isdigit(*ptr) || isspace(*ptr))) ptr++;
 	if(!*ptr || *ptr == '\n') {
-		fprintf(stderr, "Skipping invalid line %ld: %s\n", ds->line, ds->line_buffer);
-		ds->line_buffer[0] = 0;
-		return GetNextCommand(ds, cmd, time);
+		fprintf(stderr, "Skipping invalid line %ld: %s\n", line, buf);
+		return -1;
 	}
 
 	cmd_tok = ptr;
 	while(*ptr && !isspace(*ptr)) ptr++;
-	*ptr++ = 0;
+	if(*ptr) *ptr++ = 0;
 
 	cmd->type = (CommandType)UINT_MAX;
 	for(i=0; i<VALID_CMD_COUNT; i++) {
@@ -109,23 +118,124 @@ int GetNextCommand(DemoScript *ds, DemoCommand *cmd, unsigned long time) {
 	}
 	
 	if(cmd->type == (CommandType)UINT_MAX) {
-		fprintf(stderr, "Skipping invalid line %ld: Unrecognized command %s\n", ds->line, cmd_tok);
-		ds->line_buffer[0] = 0;
-		return GetNextCommand(ds, cmd, time);
+		fprintf(stderr, "Skipping invalid line %ld: Unrecognized command %s\n", line, cmd_tok);
+		return -1;
 	}
 
-	ptr = SkipSpaces(ptr);
-	if(!*ptr || *ptr == '\n') {
-		cmd->args = 0;
-	} else {
-		unsigned int len = strlen(ptr);
-		cmd->args = malloc(len + 1);
-		strcpy(cmd->args, ptr);
-		if(cmd->args[len - 1] == '\n') {
-			cmd->args[len - 1] = 0;
+	cmd->argc = 0;
+	for(;;) {
+		char *tok;
+		
+		ptr = SkipSpaces(ptr);
+		if(!*ptr || *ptr == '\n') break;
+
+		if(cmd->argc >= MAX_CMD_ARGS) {
+			cmd->argc++;
+			break;
 		}
+
+		tok = ptr;
+		while(*ptr && !isspace(*ptr)) ptr++;
+		if(*ptr) *ptr++ = 0;
+
+		cmd->argv[cmd->argc++] = Intern(ds, tok, sym_cap);
+	}
+
+	if(cmd->argc != cmd_argc[cmd->type]) {
+		fprintf(stderr, "Skipping invalid line %ld: %s expects %d argument(s)\n", line, cmd_tok, cmd_argc[cmd->type]);
+		return -1;
+	}
+
+	if(!ValidArgs(cmd, ds)) {
+		fprintf(stderr, "Skipping invalid line %ld: bad argument to %s\n", line, cmd_tok);
+		return -1;
+	}
+
+	return 1;
+}
+
+/* commands are ordered by time, ties keep their order in the file */
+static int CmdCompare(const void *a, const void *b) {
+	const DemoCommand *c1 = a;
+	const DemoCommand *c2 = b;
+
+	if(c1->time != c2->time) return c1->time < c2->time ? -1 : 1;
+	return c1->line < c2->line ? -1 : (c1->line > c2->line);
+}
+
+DemoScript *OpenScript(const char *fname) {
+	FILE *file;
+	DemoScript *script;
+	char buf[BUF_LEN];
+	long line = 0;
+	int cmd_cap = 0, sym_cap = 0;
+	DemoCommand cmd;
+
+	if(!(file = fopen(fname, "r"))) {
+		return 0;
 	}
-	ds->line_buffer[0] = 0;
 	
+	script = malloc(sizeof(DemoScript));
+	script->fname = malloc(strlen(fname)+1);
+	strcpy(script->fname, fname);
+
+	script->cmd = 0;
+	script->cmd_count = 0;
+	script->sym = 0;
+	script->sym_count = 0;
+	script->cur = 0;
+
+	while(fgets(buf, BUF_LEN, file)) {
+		line++;
+		if(ParseLine(script, buf, line, &cmd, &sym_cap) != 1) continue;
+
+		if(script->cmd_count >= cmd_cap) {
+			cmd_cap = cmd_cap ? cmd_cap * 2 : 64;
+			script->cmd = realloc(script->cmd, cmd_cap * sizeof *script->cmd);
+		}
+		script->cmd[script->cmd_count++] = cmd;
+	}
+	fclose(file);
+
+	if(script->cmd_count) {
+		qsort(script->cmd, script->cmd_count, sizeof *script->cmd, CmdCompare);
+	}
+
+	return script;
+}
+
+void CloseScript(DemoScript *ds) {
+	int i;
+	for(i=0; i<ds->sym_count; i++) {
+		free(ds->sym[i]);
+	}
+	free(ds->sym);
+	free(ds->cmd);
+	free(ds->fname);
+	free(ds);
+}
+
+void RewindScript(DemoScript *ds) {
+	ds->cur = 0;
+}
+
+int GetNextCommand(DemoScript *ds, const DemoCommand **cmd, unsigned long time) {
+	if(ds->cur >= ds->cmd_count) {
+		return EOF;
+	}
+
+	if(ds->cmd[ds->cur].time > time) {
+		return 1;
+	}
+
+	*cmd = ds->cmd + ds->cur++;
 	return 0;
-}		
+}
+
+const char *GetSymbol(const DemoScript *ds, int sym) {
+	return sym >= 0 && sym < ds->sym_count ? ds->sym[sym] : 0;
+}
+
+int GetSymbolCount(const DemoScript *ds) {
+	return ds->sym_count;
+}
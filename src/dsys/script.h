@@ -27,38 +27,61 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 extern "C" {
 #endif	/* __cplusplus */
 
-typedef struct DemoScript {
-	char *fname;
-	FILE *file;
-	char *line_buffer;
-	long line;
-} DemoScript;
-
 typedef enum CommandType {
 	CMD_START_PART,
 	CMD_END_PART,
 	CMD_END,
 	CMD_RENAME_PART,
 	CMD_SET_RTARGET,
-	CMD_SET_CLEAR
+	CMD_SET_CLEAR,
+	CMD_SET_LAYER
 } CommandType;
 
-#define VALID_CMD_COUNT	6
+#define VALID_CMD_COUNT	7
+#define MAX_CMD_ARGS	2
 
+/* a pre-tokenized command, arguments are indices into the symbol table
+ * of the script they belong to (see GetSymbol).
+ */
 typedef struct DemoCommand {
 	unsigned long time;
 	CommandType type;
-	char *args;
+	int argc;
+	int argv[MAX_CMD_ARGS];
+	long line;
 } DemoCommand;
 
+/* the whole script is compiled at OpenScript into an immutable array of
+ * commands sorted by time, the file is not touched after that.
+ */
+typedef struct DemoScript {
+	char *fname;
+	DemoCommand *cmd;
+	int cmd_count;
+	char **sym;
+	int sym_count;
+	int cur;
+} DemoScript;
+
 
 DemoScript *OpenScript(const char *fname);
 void CloseScript(DemoScript *ds);
 
+/* moves the cursor back to the first command */
+void RewindScript(DemoScript *ds);
+
 /* returns EOF on eof, 0 for successfull retrieval of command an 1 if
- * the command on the next line is to be executed at the future
+ * the next command is to be executed at the future. On success cmd
+ * points to the command inside the script, nothing is allocated.
+ */
+int GetNextCommand(DemoScript *ds, const DemoCommand **cmd, unsigned long time);
+
+/* returns the string for an interned symbol, all equal strings in a script
+ * share the same symbol index, so indices can be used for fast lookups.
  */
-int GetNextCommand(DemoScript *ds, DemoCommand *cmd, unsigned long time);
+const char *GetSymbol(const DemoScript *ds, int sym);
+int GetSymbolCount(const DemoScript *ds);
+
 #ifdef __cplusplus
 }
 #endif	/* __cplusplus */
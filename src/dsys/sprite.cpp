@@ -0,0 +1,174 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "sprite.hpp"
+#include "3dengfx.hpp"
+
+struct Sprite {
+	Texture *tex;
+	BlendingFactor src, dest;
+	Vector2 c1, c2, uv1, uv2;
+	Color color;
+	int order;
+};
+
+struct SpriteVertex {
+	float x, y;
+	float u, v;
+	float r, g, b, a;
+};
+
+static std::vector<Sprite> sprites;
+static std::vector<SpriteVertex> sprite_verts;
+static unsigned int sprite_vbo;
+
+static bool SameState(const Sprite &a, const Sprite &b) {
+	return a.src == b.src && a.dest == b.dest && a.tex == b.tex;
+}
+
+static bool SpriteLess(const Sprite &a, const Sprite &b) {
+	if(a.src != b.src) return a.src < b.src;
+	if(a.dest != b.dest) return a.dest < b.dest;
+	if(a.tex != b.tex) return std::less<Texture*>()(a.tex, b.tex);
+	return a.order < b.order;
+}
+
+static void AddVertex(float x, float y, float u, float v, const Color &col) {
+	SpriteVertex vert;
+	vert.x = x;
+	vert.y = y;
+	vert.u = u;
+	vert.v = v;
+	vert.r = col.r;
+	vert.g = col.g;
+	vert.b = col.b;
+	vert.a = col.a;
+	sprite_verts.push_back(vert);
+}
+
+void dsys::BeginSprites() {
+	sprites.clear();
+}
+
+void dsys::DrawSprite(Texture *tex, const Vector2 &corner1, const Vector2 &corner2, const Color &color,
+		BlendingFactor src, BlendingFactor dest, const Vector2 &uv1, const Vector2 &uv2) {
+	Sprite spr;
+	spr.tex = tex;
+	spr.src = src;
+	spr.dest = dest;
+	spr.c1 = corner1;
+	spr.c2 = corner2;
+	spr.uv1 = uv1;
+	spr.uv2 = uv2;
+	spr.color = color;
+	spr.order = (int)sprites.size();
+	sprites.push_back(spr);
+}
+
+void dsys::EndSprites() {
+	if(sprites.empty()) return;
+
+	std::sort(sprites.begin(), sprites.end(), SpriteLess);
+
+	sprite_verts.clear();
+	for(size_t i=0; i<sprites.size(); i++) {
+		const Sprite &spr = sprites[i];
+		AddVertex(spr.c1.x, spr.c1.y, spr.uv1.x, spr.uv1.y, spr.color);
+		AddVertex(spr.c2.x, spr.c1.y, spr.uv2.x, spr.uv1.y, spr.color);
+		AddVertex(spr.c2.x, spr.c2.y, spr.uv2.x, spr.uv2.y, spr.color);
+		AddVertex(spr.c1.x, spr.c2.y, spr.uv1.x, spr.uv2.y, spr.color);
+	}
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, 1.0, 1.0, 0.0, 0.0, 1.0);
+
+	SetLighting(false);
+	SetZBuffering(false);
+	SetBackfaceCulling(false);
+	SetAlphaBlending(true);
+	DisableTextureUnit(1);
+	MarkTargetDirty();
+
+	// all the vertices go to the card at once, streamed through a single buffer
+	const char *base = (const char*)&sprite_verts[0];
+	if(GetSystemCapabilities().vertex_buffers) {
+		if(!sprite_vbo) glGenBuffers(1, &sprite_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER_ARB, sprite_vbo);
+		glBufferData(GL_ARRAY_BUFFER_ARB, sprite_verts.size() * sizeof(SpriteVertex), base, GL_STREAM_DRAW_ARB);
+		base = 0;
+	}
+	SpriteVertex v;
+
+	ResetVertexBinding();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glClientActiveTexture(GL_TEXTURE0);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(SpriteVertex), base + ((char*)&v.x - (char*)&v));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(SpriteVertex), base + ((char*)&v.u - (char*)&v));
+	glColorPointer(4, GL_FLOAT, sizeof(SpriteVertex), base + ((char*)&v.r - (char*)&v));
+
+	size_t first = 0;
+	while(first < sprites.size()) {
+		size_t last = first + 1;
+		while(last < sprites.size() && SameState(sprites[first], sprites[last])) {
+			last++;
+		}
+
+		SetBlendFunc(sprites[first].src, sprites[first].dest);
+		if(sprites[first].tex) {
+			EnableTextureUnit(0);
+			SetTextureUnitColor(0, TOP_REPLACE, TARG_TEXTURE, TARG_COLOR);
+			SetTextureUnitAlpha(0, TOP_MODULATE, TARG_TEXTURE, TARG_COLOR);
+			SetTexture(0, sprites[first].tex);
+		} else {
+			DisableTextureUnit(0);
+		}
+		glDrawArrays(GL_QUADS, (int)first * 4, (int)(last - first) * 4);
+
+		first = last;
+	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	if(sprite_vbo) glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+
+	DisableTextureUnit(0);
+	SetAlphaBlending(false);
+	SetBackfaceCulling(true);
+	SetZBuffering(true);
+	SetLighting(true);
+
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+
+	sprites.clear();
+}
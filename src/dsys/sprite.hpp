@@ -0,0 +1,48 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of "The Lab demosystem".
+
+"The Lab demosystem" is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+"The Lab demosystem" is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with "The Lab demosystem"; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _SPRITE_HPP_
+#define _SPRITE_HPP_
+
+#include <n3dmath2.hpp>
+#include "color2.hpp"
+#include "3denginefx_types.hpp"
+
+class Texture;
+
+namespace dsys {
+
+	/* Sprite batch for 2D overlays, in the same 0-1 screen coordinates as
+	 * Overlay(). Sprites queued between BeginSprites() and EndSprites() are
+	 * grouped by blend mode and texture and each group is drawn with a
+	 * single draw call. Within a group the sprites keep the order they were
+	 * queued in, but the groups are not drawn in queue order, so use
+	 * separate batches for overlapping sprites when that matters.
+	 * Untextured sprites (tex = 0) are drawn with the color alone, textured
+	 * ones take their color from the texture and the alpha from both.
+	 */
+	void BeginSprites();
+	void DrawSprite(Texture *tex, const Vector2 &corner1, const Vector2 &corner2, const Color &color,
+			BlendingFactor src = BLEND_SRC_ALPHA, BlendingFactor dest = BLEND_ONE_MINUS_SRC_ALPHA,
+			const Vector2 &uv1 = Vector2(0.0f, 0.0f), const Vector2 &uv2 = Vector2(1.0f, 1.0f));
+	void EndSprites();
+}
+
+#endif	// _SPRITE_HPP_
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
 #include "3denginefx.hpp"
 #include "3dgeom.hpp"
 
@@ -91,33 +92,183 @@ void Quad::CalculateNormal(const Vertex *vbuffer, bool normalize) {
 	if(normalize) normal.Normalize();
 }
 
+//////////// vertex buffer object layouts /////////////
+
+#define HALF_UV_RANGE	2.0f
+
+static unsigned short FloatToHalf(float f) {
+	union {float f; unsigned int i;} bits;
+	bits.f = f;
+
+	unsigned int sign = (bits.i >> 16) & 0x8000;
+	int exp = (int)((bits.i >> 23) & 0xff) - 127 + 15;
+	unsigned int mant = bits.i & 0x7fffff;
+
+	if(exp <= 0) return sign;		// too small, flush to zero
+	if(exp >= 31) return sign | 0x7bff;
+	return (sign | (exp << 10)) + ((mant + 0x1000) >> 13);
+}
+
+static inline signed char PackSigned(scalar_t x) {
+	if(x > 1.0) x = 1.0;
+	if(x < -1.0) x = -1.0;
+	return (signed char)(x * 127.0f + (x < 0.0 ? -0.5f : 0.5f));
+}
+
+static inline unsigned char PackUnsigned(scalar_t x) {
+	if(x > 1.0) x = 1.0;
+	if(x < 0.0) x = 0.0;
+	return (unsigned char)(x * 255.0f + 0.5f);
+}
+
+VertexFormat GetVertexFormat(unsigned int layout) {
+	VertexFormat fmt;
+
+	if(layout == VLAYOUT_RAW) {
+		Vertex v;
+		fmt.size = sizeof(Vertex);
+		fmt.normal_offs = (char*)&v.normal - (char*)&v;
+		fmt.color_offs = (char*)&v.color - (char*)&v;
+		fmt.tex_offs[0] = (char*)&v.tex[0] - (char*)&v;
+		fmt.tex_offs[1] = (char*)&v.tex[1] - (char*)&v;
+		fmt.normal_type = fmt.color_type = fmt.tex_type = GL_FLOAT;
+		return fmt;
+	}
+
+	// position (3 floats), normal (3 bytes and padding), color, texcoords
+	fmt.size = 12;
+	fmt.normal_offs = fmt.size;
+	fmt.normal_type = GL_BYTE;
+	fmt.size += 4;
+
+	fmt.color_offs = -1;
+	fmt.color_type = GL_UNSIGNED_BYTE;
+	if(layout & VLAYOUT_COLOR) {
+		fmt.color_offs = fmt.size;
+		fmt.size += 4;
+	}
+
+	int uv_size = layout & VLAYOUT_FLOAT_UV ? 8 : 4;
+	fmt.tex_type = layout & VLAYOUT_FLOAT_UV ? GL_FLOAT : GL_HALF_FLOAT_ARB;
+	fmt.tex_offs[0] = fmt.tex_offs[1] = fmt.size;
+	fmt.size += uv_size;
+	if(layout & VLAYOUT_TEX1) {
+		fmt.tex_offs[1] = fmt.size;
+		fmt.size += uv_size;
+	}
+	return fmt;
+}
+
+unsigned int ChooseLayout(const Vertex *data, unsigned long count) {
+	unsigned int layout = 0;
+	if(!GetSystemCapabilities().half_float_vertex) layout |= VLAYOUT_FLOAT_UV;
+
+	for(unsigned long i=0; i<count; i++) {
+		const Vertex &v = data[i];
+		if(v.color.r != 1.0 || v.color.g != 1.0 || v.color.b != 1.0 || v.color.a != 1.0) {
+			layout |= VLAYOUT_COLOR;
+		}
+		if(v.tex[1].u != v.tex[0].u || v.tex[1].v != v.tex[0].v) {
+			layout |= VLAYOUT_TEX1;
+		}
+		for(int j=0; j<2; j++) {
+			if(fabs(v.tex[j].u) > HALF_UV_RANGE || fabs(v.tex[j].v) > HALF_UV_RANGE) {
+				layout |= VLAYOUT_FLOAT_UV;
+			}
+		}
+	}
+	return layout;
+}
+
+int LayoutSize(const Vertex *data, unsigned int layout) {
+	return GetVertexFormat(layout).size;
+}
+
+void PackElements(void *dest, const Vertex *src, unsigned long count, unsigned int layout) {
+	if(layout == VLAYOUT_RAW) {
+		memcpy(dest, src, count * sizeof(Vertex));
+		return;
+	}
+
+	VertexFormat fmt = GetVertexFormat(layout);
+	int tex_sets = layout & VLAYOUT_TEX1 ? 2 : 1;
+	char *ptr = (char*)dest;
+
+	for(unsigned long i=0; i<count; i++) {
+		const Vertex &v = src[i];
+
+		float *pos = (float*)ptr;
+		pos[0] = v.pos.x;
+		pos[1] = v.pos.y;
+		pos[2] = v.pos.z;
+
+		signed char *norm = (signed char*)(ptr + fmt.normal_offs);
+		norm[0] = PackSigned(v.normal.x);
+		norm[1] = PackSigned(v.normal.y);
+		norm[2] = PackSigned(v.normal.z);
+		norm[3] = 0;
+
+		if(fmt.color_offs != -1) {
+			unsigned char *col = (unsigned char*)(ptr + fmt.color_offs);
+			col[0] = PackUnsigned(v.color.r);
+			col[1] = PackUnsigned(v.color.g);
+			col[2] = PackUnsigned(v.color.b);
+			col[3] = PackUnsigned(v.color.a);
+		}
+
+		for(int j=0; j<tex_sets; j++) {
+			if(fmt.tex_type == GL_FLOAT) {
+				float *uv = (float*)(ptr + fmt.tex_offs[j]);
+				uv[0] = v.tex[j].u;
+				uv[1] = v.tex[j].v;
+			} else {
+				unsigned short *uv = (unsigned short*)(ptr + fmt.tex_offs[j]);
+				uv[0] = FloatToHalf(v.tex[j].u);
+				uv[1] = FloatToHalf(v.tex[j].v);
+			}
+		}
+		ptr += fmt.size;
+	}
+}
+
 ///////////////////////////////////////////
 // Index specialization of GeometryArray //
 ///////////////////////////////////////////
 
 GeometryArray<Index>::GeometryArray(bool dynamic) {
 	data = 0;
+	short_data = 0;
 	count = 0;
 	buffer_object = INVALID_VBO;
 	vbo_in_sync = false;
+	packed = false;
+	buffer_short = false;
 
 	SetDynamic(dynamic);
 }
 
 GeometryArray<Index>::GeometryArray(const Index *data, unsigned long count, bool dynamic) {
 	this->data = 0;
+	short_data = 0;
 	this->count = 0;
 	buffer_object = INVALID_VBO;
+	vbo_in_sync = false;
+	packed = false;
+	buffer_short = false;
 	SetDynamic(dynamic);
 
 	SetData(data, count);
 }
 
 GeometryArray<Index>::GeometryArray(const GeometryArray<Triangle> &tarray) {
-	dynamic = tarray.GetDynamic();
+	SetDynamic(tarray.GetDynamic());
 	data = 0;
+	short_data = 0;
 	count = 0;
 	buffer_object = INVALID_VBO;
+	vbo_in_sync = false;
+	packed = false;
+	buffer_short = false;
 
 	unsigned long tcount = tarray.GetCount();
 	Index *tmp_data = new Index[tcount * 3];
@@ -135,8 +286,12 @@ GeometryArray<Index>::GeometryArray(const GeometryArray<Triangle> &tarray) {
 
 GeometryArray<Index>::GeometryArray(const GeometryArray<Index> &ga) {
 	data = 0;
+	short_data = 0;
 	count = 0;
 	buffer_object = INVALID_VBO;
+	vbo_in_sync = false;
+	packed = false;
+	buffer_short = false;
 	dynamic = ga.dynamic;
 
 	SetData(ga.data, ga.count);
@@ -144,44 +299,91 @@ GeometryArray<Index>::GeometryArray(const GeometryArray<Index> &ga) {
 
 GeometryArray<Index>::~GeometryArray() {
 	if(data) delete [] data;
+	if(short_data) delete [] short_data;
 	if(buffer_object != INVALID_VBO) {
-		glDeleteBuffers(1, &buffer_object);
+		DeleteBufferObject(buffer_object);
 	}
 }
 
 GeometryArray<Index> &GeometryArray<Index>::operator =(const GeometryArray<Index> &ga) {
+	if(&ga == this) return *this;
+
+	if(!ga.data) {
+		delete [] data;
+		delete [] short_data;
+		data = 0;
+		short_data = 0;
+		count = 0;
+	}
 	dynamic = ga.dynamic;
-	if(data) delete [] data;
+	vbo_in_sync = false;
 
 	SetData(ga.data, ga.count);
 
 	return *this;
 }
 
+void GeometryArray<Index>::Pack() {
+	Index max_index = 0;
+	for(unsigned long i=0; i<count; i++) {
+		if(data[i] > max_index) max_index = data[i];
+	}
+
+	if(max_index > 0xffff) {
+		delete [] short_data;
+		short_data = 0;
+	} else {
+		if(!short_data) short_data = new unsigned short[count];
+		for(unsigned long i=0; i<count; i++) {
+			short_data[i] = (unsigned short)data[i];
+		}
+	}
+	packed = true;
+}
+
 void GeometryArray<Index>::SyncBufferObject() {
 	if(dynamic) return;
 
+	if(!packed) Pack();
+	const void *src = GetDrawData();
+	unsigned long size = count * (short_data ? sizeof *short_data : sizeof *data);
+
+	// the buffer is replaced when the index size changes
+	if(buffer_object != INVALID_VBO && buffer_short != (short_data != 0)) {
+		DeleteBufferObject(buffer_object);
+		buffer_object = INVALID_VBO;
+	}
+
 	if(buffer_object == INVALID_VBO) {
 		glGenBuffers(1, &buffer_object);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, buffer_object);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER_ARB, count * sizeof(Index), data, GL_STATIC_DRAW_ARB);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER_ARB, size, src, GL_STATIC_DRAW_ARB);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		buffer_short = short_data != 0;
 	} else {
 
-		int glerr;
-		while((glerr = glGetError()) != GL_NO_ERROR) {
-			std::cerr << GetGLErrorString(glerr) << " ";
-		}
+		while(glGetError() != GL_NO_ERROR);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, buffer_object);
-		Index *ptr = (Index*)glMapBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+		void *ptr = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+		if(!ptr) {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+			std::cerr << "GeometryArray<Index>::SyncBufferObject(): glMapBuffer failed.\n";
+			std::cerr << "\tOpenGL error: " << GetGLErrorString(glGetError()) << "\n";
+			std::cerr << "\tbuffer_object = " << buffer_object << "\n";
+			return;
+		}
 		
-		memcpy(ptr, data, count * sizeof(Index));
+		memcpy(ptr, src, size);
 			
 		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
 	}
 	vbo_in_sync = true;
 
+	// static arrays draw from the buffer, the 16bit copy isn't needed anymore
+	delete [] short_data;
+	short_data = 0;
+	packed = false;
 }
 
 void GeometryArray<Index>::SetData(const Index *data, unsigned long count) {
@@ -191,32 +393,78 @@ void GeometryArray<Index>::SetData(const Index *data, unsigned long count) {
 			delete [] this->data;
 		}
 		this->data = new Index[count];
+
+		delete [] short_data;
+		short_data = 0;
 	}
 
 	memcpy(this->data, data, count * sizeof(Index));
+	packed = false;
+
+	// a buffer of a different size is replaced, not remapped
+	if(buffer_object != INVALID_VBO && count != this->count) {
+		DeleteBufferObject(buffer_object);
+		buffer_object = INVALID_VBO;
+	}
+	this->count = count;
+	vbo_in_sync = false;
 
 	if(!dynamic) {
-		if(buffer_object != INVALID_VBO && count != this->count) {
-			glDeleteBuffers(1, &buffer_object);
-		}
 		SyncBufferObject();
-		vbo_in_sync = true;
 	}
-
-	this->count = count;
 }
 
 
 ///////////// Triangle Mesh Implementation /////////////
 TriMesh::TriMesh() {
 	indices_valid = false;
+	bounds_valid = false;
 }
 
 TriMesh::TriMesh(const Vertex *vdata, unsigned long vcount, const Triangle *tdata, unsigned long tcount) {
 	indices_valid = false;
+	bounds_valid = false;
 	SetData(vdata, vcount, tdata, tcount);
 }
 
+void TriMesh::CalculateBounds() {
+	const Vertex *verts = varray.GetData();
+	unsigned long count = varray.GetCount();
+
+	aabb.min = aabb.max = count ? verts[0].pos : Vector3(0, 0, 0);
+	for(unsigned long i=1; i<count; i++) {
+		const Vector3 &pos = verts[i].pos;
+		if(pos.x < aabb.min.x) aabb.min.x = pos.x;
+		if(pos.y < aabb.min.y) aabb.min.y = pos.y;
+		if(pos.z < aabb.min.z) aabb.min.z = pos.z;
+		if(pos.x > aabb.max.x) aabb.max.x = pos.x;
+		if(pos.y > aabb.max.y) aabb.max.y = pos.y;
+		if(pos.z > aabb.max.z) aabb.max.z = pos.z;
+	}
+
+	// sphere around the center of the box, enclosing all the vertices
+	Vector3 center = (aabb.min + aabb.max) * 0.5;
+	scalar_t max_dist_sq = 0.0;
+	for(unsigned long i=0; i<count; i++) {
+		scalar_t dist_sq = (verts[i].pos - center).LengthSq();
+		if(dist_sq > max_dist_sq) max_dist_sq = dist_sq;
+	}
+	bsph.SetPosition(center);
+	bsph.SetRadius(sqrt(max_dist_sq));
+
+	bounds_valid = true;
+}
+
+const Sphere &TriMesh::GetBoundingSphere() {
+	if(!bounds_valid) CalculateBounds();
+	return bsph;
+}
+
+const AABox &TriMesh::GetAABox() {
+	if(!bounds_valid) CalculateBounds();
+	return aabb;
+}
+
 const IndexArray *TriMesh::GetIndexArray() {
 	if(!indices_valid) {
 		iarray = IndexArray(tarray);
@@ -264,6 +512,61 @@ void TriMesh::CalculateNormals() {
 	delete [] tri_indices;
 }
 
+int SplitMesh(const TriMesh &mesh, std::vector<TriMesh*> *pieces, unsigned long max_verts) {
+	const VertexArray *varray = mesh.GetVertexArray();
+	const TriangleArray *tarray = mesh.GetTriangleArray();
+	unsigned long tcount = tarray->GetCount();
+
+	// index of each vertex in the piece being built, -1 if it's not there
+	std::vector<long> remap(varray->GetCount(), -1);
+	std::vector<Index> used;
+	std::vector<Vertex> verts;
+	std::vector<Triangle> tris;
+	int added = 0;
+
+	for(unsigned long i=0; i<=tcount; i++) {
+		unsigned long new_verts = 0;
+		if(i < tcount) {
+			for(int j=0; j<3; j++) {
+				if(remap[tarray->GetData()[i].vertices[j]] == -1) new_verts++;
+			}
+		}
+
+		if(i == tcount || verts.size() + new_verts > max_verts) {
+			if(!tris.empty()) {
+				TriMesh *piece = new TriMesh;
+				piece->GetModVertexArray()->SetDynamic(varray->GetDynamic());
+				piece->GetModTriangleArray()->SetDynamic(tarray->GetDynamic());
+				piece->SetData(&verts[0], verts.size(), &tris[0], tris.size());
+				pieces->push_back(piece);
+				added++;
+			}
+
+			for(size_t j=0; j<used.size(); j++) {
+				remap[used[j]] = -1;
+			}
+			used.clear();
+			verts.clear();
+			tris.clear();
+			if(i == tcount) break;
+		}
+
+		Triangle tri = tarray->GetData()[i];
+		for(int j=0; j<3; j++) {
+			Index v = tri.vertices[j];
+			if(remap[v] == -1) {
+				remap[v] = (long)verts.size();
+				verts.push_back(varray->GetData()[v]);
+				used.push_back(v);
+			}
+			tri.vertices[j] = (Index)remap[v];
+		}
+		tris.push_back(tri);
+	}
+
+	return added;
+}
+
 
 ///////////////// PRS /////////////////////
 
@@ -21,11 +21,15 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define _3DGEOM_HPP_
 
 #include <vector>
+#include <cstring>
 #include "n3dmath2.hpp"
 #include "controller.hpp"
 #include "color2.hpp"
 
-typedef unsigned short Index;
+/* indices are 32bit in memory, index arrays are drawn with 16bit indices
+ * when all of them fit (see GeometryArray<Index>::GetIndexType).
+ */
+typedef unsigned int Index;
 
 struct TexCoord {
 	scalar_t u, v;		// or s,t if you prefer... I like u,v more though.
@@ -81,6 +85,44 @@ public:
 };
 
 
+/* Buffer object layouts. Vertices are packed when they go to a buffer
+ * object: positions stay floats, normals become signed bytes, colors RGBA8
+ * and texture coordinates half floats, and attributes no vertex uses are
+ * left out. The VLAYOUT_* bits say which parts a layout needs, or'ing two
+ * layouts gives one fit for both.
+ */
+enum {
+	VLAYOUT_COLOR		= 1,	// colors other than opaque white
+	VLAYOUT_TEX1		= 2,	// second texture coordinate set differs
+	VLAYOUT_FLOAT_UV	= 4,	// texture coordinates out of half float range
+	VLAYOUT_RAW			= 0x7fffffff	// the Vertex structure as is
+};
+
+struct VertexFormat {
+	int size;				// bytes per vertex
+	int normal_offs, color_offs, tex_offs[2];	// color_offs -1 if absent
+	unsigned int normal_type, color_type, tex_type;
+};
+
+VertexFormat GetVertexFormat(unsigned int layout);
+
+/* packing of geometry array elements into buffer objects. The templates
+ * copy them as they are, the Vertex overloads implement the layouts.
+ */
+template <class T>
+inline unsigned int ChooseLayout(const T *data, unsigned long count) {return VLAYOUT_RAW;}
+template <class T>
+inline int LayoutSize(const T *data, unsigned int layout) {return sizeof(T);}
+template <class T>
+inline void PackElements(void *dest, const T *src, unsigned long count, unsigned int layout) {
+	memcpy(dest, src, count * sizeof(T));
+}
+
+unsigned int ChooseLayout(const Vertex *data, unsigned long count);
+int LayoutSize(const Vertex *data, unsigned int layout);
+void PackElements(void *dest, const Vertex *src, unsigned long count, unsigned int layout);
+
+
 /* And for my next trick... these template classes with specialization for
  * the index case. They handle the conversion from triangle arrays to index
  * arrays in an excruciatingly smooth and automagic way.
@@ -96,8 +138,17 @@ private:
 	bool dynamic;
 	unsigned int buffer_object;		// for OGL VBOs
 	bool vbo_in_sync;
+	unsigned long dirty_start, dirty_end;	// modified since the last upload
+	bool dynamic_usage;				// buffer respecified for updates
+	unsigned int layout;			// of the buffer object, see ChooseLayout
+
+	bool stream;					// lives in the per-frame stream buffer
+	bool stream_ok, stream_mapped;
+	bool data_stale;				// MapStream wrote past data, until it's rewritten
+	unsigned long stream_offset, stream_frame;
 
 	void SyncBufferObject();
+	void SyncStream();
 
 public:
 	GeometryArray(bool dynamic = true);
@@ -109,7 +160,14 @@ public:
 
 	inline void SetData(const DataType *data, unsigned long count);
 	inline const DataType *GetData() const;
+
+	/* GetModData marks the whole array modified, the ranged version (or
+	 * Invalidate) just the elements in [first, first + n). Only the modified
+	 * elements are sent to the buffer object before the next draw.
+	 */
 	inline DataType *GetModData();
+	inline DataType *GetModData(unsigned long first, unsigned long n);
+	inline void Invalidate(unsigned long first, unsigned long n);
 
 	inline unsigned long GetCount() const;
 
@@ -117,6 +175,21 @@ public:
 	inline bool GetDynamic() const;
 	
 	inline unsigned int GetBufferObject() const;
+	inline unsigned long GetBufferOffset() const;
+	inline unsigned int GetLayout() const;	// of what GetBufferObject returned
+
+	/* streamed arrays are rewritten every frame, so they're copied to the
+	 * engine's stream buffer (see AllocStream) when drawn instead of having
+	 * a buffer object. MapStream returns space there to write all elements
+	 * directly, skipping the copy. Those are drawn until the next frame and
+	 * don't update GetData(), call UnmapStream before drawing. After that,
+	 * data is out of date until it's rewritten with SetData or GetModData(),
+	 * so the array must be mapped again every frame it's drawn (asserted).
+	 */
+	inline void SetStreaming(bool enable);
+	inline bool GetStreaming() const;
+	DataType *MapStream();
+	void UnmapStream();
 };
 
 
@@ -125,11 +198,16 @@ template <>
 class GeometryArray<Index> {
 private:
 	Index *data;
+	unsigned short *short_data;		// 16bit copy of data, if the indices fit
+									// (freed once a static buffer is uploaded)
 	unsigned long count;
 	bool dynamic;
 	unsigned int buffer_object;
 	bool vbo_in_sync;
+	bool packed;					// short_data is up to date
+	bool buffer_short;				// the buffer object holds 16bit indices
 
+	void Pack();
 	void SyncBufferObject();
 
 public:
@@ -151,6 +229,11 @@ public:
 	inline bool GetDynamic() const;
 
 	inline unsigned int GetBufferObject() const;
+
+	// GL_UNSIGNED_SHORT when all indices fit in 16 bits, else GL_UNSIGNED_INT
+	inline unsigned int GetIndexType() const;
+	// the indices as GetIndexType() says, for drawing from client memory
+	inline const void *GetDrawData() const;
 };
 
 typedef GeometryArray<Vertex> VertexArray;
@@ -158,6 +241,11 @@ typedef GeometryArray<Triangle> TriangleArray;
 typedef GeometryArray<Index> IndexArray;
 
 ////////////// triangle mesh class ////////////
+// axis aligned bounding box
+struct AABox {
+	Vector3 min, max;
+};
+
 class TriMesh {
 private:
 	VertexArray varray;
@@ -165,6 +253,12 @@ private:
 	IndexArray iarray;
 	
 	bool indices_valid;
+
+	Sphere bsph;
+	AABox aabb;
+	bool bounds_valid;
+
+	void CalculateBounds();
 	
 public:
 	TriMesh();
@@ -177,12 +271,25 @@ public:
 	inline TriangleArray *GetModTriangleArray();
 	
 	const IndexArray *GetIndexArray();
+
+	/* bounds in mesh space, recalculated after the vertices are modified.
+	 * Writes through VertexArray::MapStream go to the stream buffer and
+	 * aren't seen here.
+	 */
+	const Sphere &GetBoundingSphere();
+	const AABox &GetAABox();
 	
 	void SetData(const Vertex *vdata, unsigned long vcount, const Triangle *tdata, unsigned long tcount);	
 	
 	void CalculateNormals();
 };
 
+/* breaks a mesh into pieces of at most max_verts vertices each, so that
+ * they're drawn with 16bit indices. The pieces are appended to the vector
+ * and belong to the caller, returns how many were added.
+ */
+int SplitMesh(const TriMesh &mesh, std::vector<TriMesh*> *pieces, unsigned long max_verts = 65536);
+
 
 //////////// Transformable Node Base class /////////////
 class PRS {
@@ -18,10 +18,16 @@ along with the graphics core library; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 #include <cstring>
+#include <cassert>
 #include "3denginefx_types.hpp"
 
 SysCaps GetSystemCapabilities();
 const char *GetGLErrorString(GLenum error);
+void DeleteBufferObject(unsigned int buffer);
+void *AllocStream(unsigned long size, unsigned long *offset);
+void UnmapStream();
+unsigned int GetStreamBuffer();
+unsigned long GetStreamFrame();
 
 #define INVALID_VBO		0
 
@@ -31,6 +37,12 @@ GeometryArray<DataType>::GeometryArray(bool dynamic) {
 	count = 0;
 	buffer_object = INVALID_VBO;
 	vbo_in_sync = false;
+	dirty_start = dirty_end = 0;
+	dynamic_usage = false;
+	layout = VLAYOUT_RAW;
+	stream = stream_ok = stream_mapped = false;
+	data_stale = false;
+	stream_offset = stream_frame = 0;
 
 	SetDynamic(dynamic);
 }
@@ -40,6 +52,13 @@ GeometryArray<DataType>::GeometryArray(const DataType *data, unsigned long count
 	this->data = 0;
 	this->count = 0;
 	buffer_object = INVALID_VBO;
+	vbo_in_sync = false;
+	dirty_start = dirty_end = 0;
+	dynamic_usage = false;
+	layout = VLAYOUT_RAW;
+	stream = stream_ok = stream_mapped = false;
+	data_stale = false;
+	stream_offset = stream_frame = 0;
 	SetDynamic(dynamic);
 
 	SetData(data, count);
@@ -51,6 +70,13 @@ GeometryArray<DataType>::GeometryArray(const GeometryArray<DataType> &ga) {
 	count = 0;
 	dynamic = ga.dynamic;
 	buffer_object = INVALID_VBO;
+	vbo_in_sync = false;
+	dirty_start = dirty_end = 0;
+	dynamic_usage = false;
+	layout = VLAYOUT_RAW;
+	stream = stream_ok = stream_mapped = false;
+	data_stale = false;
+	stream_offset = stream_frame = 0;
 
 	SetData(ga.data, ga.count);
 }
@@ -59,14 +85,21 @@ template <class DataType>
 GeometryArray<DataType>::~GeometryArray() {
 	if(data) delete [] data;
 	if(buffer_object != INVALID_VBO) {
-		glDeleteBuffers(1, &buffer_object);
+		DeleteBufferObject(buffer_object);
 	}
 }
 
 template <class DataType>
 GeometryArray<DataType> &GeometryArray<DataType>::operator =(const GeometryArray<DataType> &ga) {
+	if(&ga == this) return *this;
+
+	if(!ga.data) {
+		delete [] data;
+		data = 0;
+		count = 0;
+	}
 	dynamic = ga.dynamic;
-	if(data) delete [] data;
+	vbo_in_sync = false;
 
 	SetData(ga.data, ga.count);
 	
@@ -75,31 +108,95 @@ GeometryArray<DataType> &GeometryArray<DataType>::operator =(const GeometryArray
 
 template <class DataType>
 void GeometryArray<DataType>::SyncBufferObject() {
-	if(dynamic) return;
+	if(dynamic || stream) return;
+	assert(!data_stale && "geometry array written through MapStream, data is out of date");
+
+	bool create = buffer_object == INVALID_VBO;
+	unsigned long first = 0, n = count;
+
+	if(!create && dynamic_usage) {
+		first = dirty_start;
+		n = dirty_end - dirty_start;
+
+		// modified elements that don't fit the layout need a new one
+		if((ChooseLayout(data + first, n) | layout) != layout) {
+			first = 0;
+			n = count;
+			dynamic_usage = false;
+		}
+	}
+	if(create || !dynamic_usage) {
+		layout = ChooseLayout(data, count);
+	}
+
+	int elem_size = LayoutSize(data, layout);
+	char *packed = new char[n * elem_size];
+	PackElements(packed, data + first, n, layout);
 
-	if(buffer_object == INVALID_VBO) {
+	if(create) {
 		glGenBuffers(1, &buffer_object);
 		glBindBuffer(GL_ARRAY_BUFFER_ARB, buffer_object);
-		glBufferData(GL_ARRAY_BUFFER_ARB, count * sizeof(DataType), data, GL_STATIC_DRAW_ARB);
+		glBufferData(GL_ARRAY_BUFFER_ARB, count * elem_size, packed, GL_STATIC_DRAW_ARB);
 		glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
-	} else {
-
-		while(glGetError() != GL_NO_ERROR);
+		dynamic_usage = false;
+	} else if(!dynamic_usage) {
+		/* modified after it was created, so it will probably change again.
+		 * Respecify it once as a dynamic buffer, update it in place after that.
+		 */
 		glBindBuffer(GL_ARRAY_BUFFER_ARB, buffer_object);
-		DataType *ptr = (DataType*)glMapBuffer(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-		if(!ptr) {
-			std::cerr << "GeometryArray<T>::SyncBufferObject(): glMapBuffer failed.\n";
-			std::cerr << "\tOpenGL error: " << GetGLErrorString(glGetError()) << "\n";
-			std::cerr << "\tbuffer_object = " << buffer_object << "\n";
-			return;
-		}
-		
-		memcpy(ptr, data, count * sizeof(DataType));
-			
-		glUnmapBuffer(GL_ARRAY_BUFFER_ARB);
+		glBufferData(GL_ARRAY_BUFFER_ARB, count * elem_size, packed, GL_DYNAMIC_DRAW_ARB);
+		glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
+		dynamic_usage = true;
+	} else if(n) {
+		glBindBuffer(GL_ARRAY_BUFFER_ARB, buffer_object);
+		glBufferSubData(GL_ARRAY_BUFFER_ARB, first * elem_size, n * elem_size, packed);
 		glBindBuffer(GL_ARRAY_BUFFER_ARB, 0);
 	}
+	delete [] packed;
+
+	dirty_start = dirty_end = 0;
+	vbo_in_sync = true;
+}
+
+template <class DataType>
+void GeometryArray<DataType>::SyncStream() {
+	/* the last MapStream wrote the stream buffer only, so data is out of
+	 * date: a streamed array that's mapped must be mapped every frame.
+	 */
+	assert(!data_stale && "streamed array drawn without MapStream this frame");
+
+	DataType *ptr = (DataType*)AllocStream(count * sizeof(DataType), &stream_offset);
+	stream_frame = GetStreamFrame();
+	dirty_start = dirty_end = 0;
+	vbo_in_sync = true;
+
+	// drawn from client memory if it doesn't fit this frame
+	if((stream_ok = ptr != 0)) {
+		memcpy(ptr, data, count * sizeof(DataType));
+		::UnmapStream();
+	}
+}
+
+template <class DataType>
+DataType *GeometryArray<DataType>::MapStream() {
+	if(!stream) return GetModData();
+
+	DataType *ptr = (DataType*)AllocStream(count * sizeof(DataType), &stream_offset);
+	stream_frame = GetStreamFrame();
+	dirty_start = dirty_end = 0;
 	vbo_in_sync = true;
+
+	stream_ok = stream_mapped = ptr != 0;
+	data_stale = stream_mapped;
+	return ptr ? ptr : data;
+}
+
+template <class DataType>
+void GeometryArray<DataType>::UnmapStream() {
+	if(stream_mapped) {
+		::UnmapStream();
+		stream_mapped = false;
+	}
 }
 
 
@@ -115,15 +212,18 @@ inline void GeometryArray<DataType>::SetData(const DataType *data, unsigned long
 	
 	memcpy(this->data, data, count * sizeof(DataType));
 
+	// a buffer of a different size is replaced, not remapped
+	if(buffer_object != INVALID_VBO && count != this->count) {
+		DeleteBufferObject(buffer_object);
+		buffer_object = INVALID_VBO;
+	}
+	this->count = count;
+	Invalidate(0, count);
+	data_stale = false;
+
 	if(!dynamic) {
-		if(buffer_object != INVALID_VBO && count != this->count) {
-			glDeleteBuffers(1, &buffer_object);
-		}
 		SyncBufferObject();
-		vbo_in_sync = true;
 	}
-	
-	this->count = count;
 }
 
 template <class DataType>
@@ -133,10 +233,32 @@ inline const DataType *GeometryArray<DataType>::GetData() const {
 
 template <class DataType>
 inline DataType *GeometryArray<DataType>::GetModData() {
-	vbo_in_sync = false;
+	Invalidate(0, count);
+	data_stale = false;
 	return data;
 }
 
+template <class DataType>
+inline DataType *GeometryArray<DataType>::GetModData(unsigned long first, unsigned long n) {
+	Invalidate(first, n);
+	return data + first;
+}
+
+template <class DataType>
+inline void GeometryArray<DataType>::Invalidate(unsigned long first, unsigned long n) {
+	if(!n) return;
+
+	// ranges are merged into one spanning them all
+	if(dirty_end > dirty_start) {
+		if(first < dirty_start) dirty_start = first;
+		if(first + n > dirty_end) dirty_end = first + n;
+	} else {
+		dirty_start = first;
+		dirty_end = first + n;
+	}
+	vbo_in_sync = false;
+}
+
 template <class DataType>
 inline unsigned long GeometryArray<DataType>::GetCount() const {
 	return count;
@@ -150,6 +272,27 @@ void GeometryArray<DataType>::SetDynamic(bool enable) {
 	if(!dynamic && !sys_caps.vertex_buffers) {
 		dynamic = true;
 	}
+	if(dynamic) stream = false;
+}
+
+template <class DataType>
+inline void GeometryArray<DataType>::SetStreaming(bool enable) {
+	if(enable) {
+		SetDynamic(false);
+		if(dynamic) return;
+
+		if(buffer_object != INVALID_VBO) {
+			DeleteBufferObject(buffer_object);
+			buffer_object = INVALID_VBO;
+		}
+	}
+	stream = enable;
+	vbo_in_sync = false;
+}
+
+template <class DataType>
+inline bool GeometryArray<DataType>::GetStreaming() const {
+	return stream;
 }
 
 template <class DataType>
@@ -159,6 +302,14 @@ inline bool GeometryArray<DataType>::GetDynamic() const {
 
 template <class DataType>
 inline unsigned int GeometryArray<DataType>::GetBufferObject() const {
+	if(stream) {
+		// last frame's stream space is gone
+		if(!vbo_in_sync || stream_frame != GetStreamFrame()) {
+			const_cast<GeometryArray<DataType>*>(this)->SyncStream();
+		}
+		return stream_ok ? GetStreamBuffer() : INVALID_VBO;
+	}
+
 	if(!dynamic && !vbo_in_sync) {
 		const_cast<GeometryArray<DataType>*>(this)->SyncBufferObject();
 	}
@@ -166,6 +317,16 @@ inline unsigned int GeometryArray<DataType>::GetBufferObject() const {
 	return buffer_object;
 }
 
+template <class DataType>
+inline unsigned long GeometryArray<DataType>::GetBufferOffset() const {
+	return stream ? stream_offset : 0;
+}
+
+template <class DataType>
+inline unsigned int GeometryArray<DataType>::GetLayout() const {
+	return stream || dynamic ? VLAYOUT_RAW : layout;
+}
+
 // inline functions of <index> specialization of GeometryArray
 
 inline const Index *GeometryArray<Index>::GetData() const {
@@ -174,6 +335,7 @@ inline const Index *GeometryArray<Index>::GetData() const {
 
 inline Index *GeometryArray<Index>::GetModData() {
 	vbo_in_sync = false;
+	packed = false;
 	return data;
 }
 
@@ -202,6 +364,23 @@ inline unsigned int GeometryArray<Index>::GetBufferObject() const {
 	return buffer_object;
 }
 
+inline unsigned int GeometryArray<Index>::GetIndexType() const {
+	if(!dynamic && vbo_in_sync) {
+		return buffer_short ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+	if(!packed) {
+		const_cast<GeometryArray<Index>*>(this)->Pack();
+	}
+	return short_data ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline const void *GeometryArray<Index>::GetDrawData() const {
+	if(!packed) {
+		const_cast<GeometryArray<Index>*>(this)->Pack();
+	}
+	return short_data ? (const void*)short_data : (const void*)data;
+}
+
 
 ///////// Triangle Mesh Implementation (inline functions) //////////
 inline const VertexArray *TriMesh::GetVertexArray() const {
@@ -209,6 +388,7 @@ inline const VertexArray *TriMesh::GetVertexArray() const {
 }
 
 inline VertexArray *TriMesh::GetModVertexArray() {
+	bounds_valid = false;
 	return &varray;
 }
 
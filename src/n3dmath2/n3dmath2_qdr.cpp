@@ -26,6 +26,14 @@ Quadratic::Quadratic(const Vector3 &pos) {
 
 Quadratic::~Quadratic() {}
 
+void Quadratic::SetPosition(const Vector3 &pos) {
+	this->pos = pos;
+}
+
+Vector3 Quadratic::GetPosition() const {
+	return pos;
+}
+
 //////////////// sphere implementation ///////////////
 
 Sphere::Sphere(const Vector3 &pos, scalar_t rad) : Quadratic(pos) {
@@ -34,6 +42,14 @@ Sphere::Sphere(const Vector3 &pos, scalar_t rad) : Quadratic(pos) {
 
 Sphere::~Sphere() {}
 
+void Sphere::SetRadius(scalar_t rad) {
+	radius = rad;
+}
+
+scalar_t Sphere::GetRadius() const {
+	return radius;
+}
+
 bool Sphere::CheckIntersection(const Ray &ray) const {
 	return FindIntersection(ray, 0);
 }
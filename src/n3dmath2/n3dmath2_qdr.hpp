@@ -39,6 +39,9 @@ protected:
 public:
 	Quadratic(const Vector3 &pos=Vector3(0,0,0));
 	virtual ~Quadratic();
+
+	virtual void SetPosition(const Vector3 &pos);
+	virtual Vector3 GetPosition() const;
 	
 	virtual bool CheckIntersection(const Ray &ray) const = 0;
 	virtual bool FindIntersection(const Ray &ray, SurfPoint *isect) const = 0;
@@ -52,6 +55,9 @@ protected:
 public:
 	Sphere(const Vector3 &pos=Vector3(0,0,0), scalar_t rad=1.0);
 	virtual ~Sphere();
+
+	virtual void SetRadius(scalar_t rad);
+	virtual scalar_t GetRadius() const;
 	
 	virtual bool CheckIntersection(const Ray &ray) const;
 	virtual bool FindIntersection(const Ray &ray, SurfPoint *isect) const;
@@ -37,34 +37,66 @@ static const unsigned long greets_start = 5000;
 static const unsigned long music_fade_start = 5000;//22000;
 static const unsigned long music_fade_end = 8000;//25000;
 
+void PartHairy::RequestAssets() {
+	SetDataPath("data/", DPATH_GEOM);
+	RequestObject("SphereMed", "spheres.ase");
+	RequestTexture("data/fur.png");
+	RequestTexture("data/greetz-background.png");
+	RequestTexture("data/full-greetz-without-background.png");
+}
+
 PartHairy::PartHairy() {
 	SetName("part_hairy");
+	ReadTarget(dsys::RT_FB);
 
 	light.SetPosition(Vector3(0, 10, -20));
 	cam.SetPosition(Vector3(0, 0, -10));
 
+	sph = quad = 0;
+	orig_verts = 0;
+}
+
+PartHairy::~PartHairy() {
+	Unload();
+}
+
+bool PartHairy::LoadPart() {
 	SetDataPath("data/", DPATH_GEOM);
 	if(!(sph = LoadObject("SphereMed", "spheres.ase", LGEOM_FILE))) {
 		fprintf(stderr, "failed to load object \"SphereMed\" from \"spheres.ase\"\n");
-		return;
+		return false;
 	}
+	AddTextures(sph);
+	sph->SetStreaming(true);
 
 	const VertexArray *sph_varray = sph->GetTriMeshPtr()->GetVertexArray();
 	orig_verts = new Vertex[sph_varray->GetCount()];
 	memcpy(orig_verts, sph_varray->GetData(), sph_varray->GetCount() * sizeof(Vertex));
 		
-	hair_tex = GetTexture("data/fur.png");
-	back = GetTexture("data/greetz-background.png");
-	greets = GetTexture("data/full-greetz-without-background.png");
+	hair_tex = LoadTexture("data/fur.png");
+	back = LoadTexture("data/greetz-background.png");
+	greets = LoadTexture("data/full-greetz-without-background.png");
 
 	quad = new Object;
 	CreatePlane(quad->GetTriMeshPtr(), Plane(Vector3(0,0,0)), Vector2(9, 9), 1);
 	quad->GetMaterialPtr()->SetTexture(back, TEXTYPE_DIFFUSE);
 	quad->SetZWrite(false);
+
+	// the sphere is drawn plain, then instanced with the fur texture
+	AddPrograms(quad, 1);
+	AddPrograms(sph, 1);
+	sph->GetMaterialPtr()->SetTexture(hair_tex, TEXTYPE_DIFFUSE);
+	AddPrograms(sph, 1, true);
+	sph->GetMaterialPtr()->SetTexture(0, TEXTYPE_DIFFUSE);
+	return true;
 }
 
-PartHairy::~PartHairy() {
+void PartHairy::UnloadPart() {
 	delete sph;
+	delete quad;
+	delete [] orig_verts;
+	sph = quad = 0;
+	orig_verts = 0;
 }
 
 static const unsigned long speed_time = 3000;
@@ -85,7 +117,7 @@ void PartHairy::DrawPart() {
 	//sph->SetPosition(Vector3(0, 0, 5.0f * usin(t*10.0f)));
 	sph->SetRotation(Vector3(t, t, 0));
 
-	SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
+	SetRenderTarget(GetScratchTarget());
 
 	quad->SetRotation(Vector3(0, 0, t));
 	quad->Render();
@@ -98,23 +130,26 @@ void PartHairy::DrawPart() {
 	const int sph_count = 10;
 	const float max_scale = 1.2f;
 	const float scale_inc = (max_scale - 1.0f) / (float)sph_count;
+	Matrix4x4 sph_xform[sph_count];
+	scalar_t sph_alpha[sph_count];
+	Matrix4x4 base_xform = sph->GetPRS().GetXFormMatrix();
 	float scale = 1.0f;
 	for(int i=0; i<sph_count; i++) {
-		sph->GetMaterialPtr()->alpha = 1.0f - ((float)i / (float)sph_count);
-		sph->SetScaling(Vector3(scale, scale, scale));
-		sph->Render();
+		sph_alpha[i] = 1.0f - ((float)i / (float)sph_count);
+		sph_xform[i] = base_xform;
+		sph_xform[i].Scale(Vector4(scale, scale, scale, 1.0f));
 		scale += scale_inc;
 	}
-	sph->SetScaling(Vector3(1, 1, 1));
+	sph->RenderInstances(sph_xform, sph_count, 0, sph_alpha);
 	sph->GetMaterialPtr()->SetTexture(0, TEXTYPE_DIFFUSE);
 	sph->SetBlending(false);
 	SetZBuffering(true);
 
-	SetRenderTarget(0);
+	BindTarget();
 	Clear(0);
 	ClearZBufferStencil(1.0f, 0);
 
-	dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 0.2f);
+	dsys::RadialBlur(GetScratchTarget(), 0.2f);
 	
 	if(time >= greets_start) {
 		SetAlphaBlending(true);
@@ -126,8 +161,9 @@ void PartHairy::DrawPart() {
 
 
 void PartHairy::Deform(float intensity, float speed) {
+	PROF_SCOPE("PartHairy::Deform");
 	VertexArray *varray = sph->GetTriMeshPtr()->GetModVertexArray();
-	Vertex *verts = varray->GetModData();
+	Vertex *verts = varray->MapStream();
 	int count = varray->GetCount();
 
 	float t = speed * (float)time / 1000.0f;	// 80?
@@ -146,6 +182,8 @@ void PartHairy::Deform(float intensity, float speed) {
 		sfact += ucos(angle_j * 4.0f) + usin(t * angle_k);
 		sfact *= intensity;
 		
+		verts[i] = orig_verts[i];
 		verts[i].pos = pos + (pos * sfact / 3.0f);
 	}
+	varray->UnmapStream();
 }
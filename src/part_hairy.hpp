@@ -33,11 +33,15 @@ protected:
 	Vertex *orig_verts;
 
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 	void Deform(float intensity, float speed);
 
 public:
 	PartHairy();
 	~PartHairy();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_HAIRY_HPP_
@@ -23,7 +23,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 static const int part_count = 10;
 static const int path_count = 5;
-static Texture *pic, *psys;
+static Texture *pic, *psys, *logo;
 static Vertex *vorig;
 static Curve *curve;
 static CatmullRomSpline ppath[path_count];
@@ -46,21 +46,21 @@ static const unsigned long end_trans = 30000;
 
 static void DrawParticles(int i, unsigned long time); 
 
+void PartPic::RequestAssets() {
+	RequestTexture("data/apocalypse.png");
+	RequestTexture("data/psys02.png");
+	RequestTexture("data/eternal.png");
+}
+
 PartPic::PartPic() {
 	SetName("part_pic");
+	ReadTarget(dsys::RT_FB);
 
 	light.SetPosition(Vector3(0, 50, -80));
 	cam = TargetCamera(Vector3(0, 0, 0), Vector3(0, 0, 0));
 
-	plane = new Object;
-	CreatePlane(plane->GetTriMeshPtr(), Plane(Vector3(0,0,0)), Vector2(32, 24), 50);
-
-	plane->GetMaterialPtr()->SetTexture(GetTexture("data/apocalypse.png"), TEXTYPE_DIFFUSE);
-	plane->SetBlending(true);
-
-	int count = plane->GetTriMeshPtr()->GetVertexArray()->GetCount();
-	vorig = new Vertex[count];
-	memcpy(vorig, plane->GetTriMeshPtr()->GetVertexArray()->GetData(), count * sizeof(Vertex));
+	plane = 0;
+	vorig = 0;
 
 	curve = new CatmullRomSpline;
 	curve->AddControlPoint(Vector3(0, 0, -26));
@@ -83,14 +83,37 @@ PartPic::PartPic() {
 			path_offset[i][j] = frand(0.1f);
 		}
 	}
-
-	psys = GetTexture("data/psys02.png");
 }
 
 PartPic::~PartPic() {
-	delete plane;
+	Unload();
 	delete curve;
+}
+
+bool PartPic::LoadPart() {
+	plane = new Object;
+	CreatePlane(plane->GetTriMeshPtr(), Plane(Vector3(0,0,0)), Vector2(32, 24), 50);
+	plane->SetStreaming(true);
+
+	plane->GetMaterialPtr()->SetTexture(LoadTexture("data/apocalypse.png"), TEXTYPE_DIFFUSE);
+	plane->SetBlending(true);
+
+	int count = plane->GetTriMeshPtr()->GetVertexArray()->GetCount();
+	vorig = new Vertex[count];
+	memcpy(vorig, plane->GetTriMeshPtr()->GetVertexArray()->GetData(), count * sizeof(Vertex));
+
+	psys = LoadTexture("data/psys02.png");
+	logo = LoadTexture("data/eternal.png");
+
+	AddPrograms(plane, 1);
+	return true;
+}
+
+void PartPic::UnloadPart() {
+	delete plane;
 	delete [] vorig;
+	plane = 0;
+	vorig = 0;
 }
 
 void PartPic::DrawPart() {
@@ -105,7 +128,7 @@ void PartPic::DrawPart() {
 	light.SetGLLight(0);
 
 	if(time >= start_rblur && time < end_rblur) {
-		SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
+		SetRenderTarget(GetScratchTarget());
 	}
 
 	if(time >= start_wave_fadeout && time < end_wave_fadeout) {
@@ -121,11 +144,11 @@ void PartPic::DrawPart() {
 
 	if(time >= start_rblur && time < end_rblur) {
 		dsys::Overlay(0, Vector3(0,0), Vector3(1,1), Color(0.0f, 0.0f, 0.0f, 0.94f));
-		SetRenderTarget(0);
+		BindTarget();
 		Clear(0);
 
 		float ammount = (t - (float)start_rblur / 1000.0f) / ((float)(end_rblur - start_rblur) / 1000.0f);
-		dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 2.0f * sin(ammount * pi), Vector3(0.25f + ammount / 2.0f, 0.5f), true);
+		dsys::RadialBlur(GetScratchTarget(), 2.0f * sin(ammount * pi), Vector3(0.25f + ammount / 2.0f, 0.5f), true);
 	}
 	
 	if(time < fadein_dur) {
@@ -142,15 +165,18 @@ void PartPic::DrawPart() {
 		if(time >= start_trans && time < end_trans) {
 			shrink = (t - (float)start_trans / 1000.0f) / ((float)(end_trans - start_trans) / 1000.0f) / 2.0f;
 		}
-		dsys::Overlay(GetTexture("data/eternal.png"), c1 + Vector2(shrink, shrink * 0.35), c2 - Vector2(shrink, shrink * 0.35), Color(1.0f, 1.0f, 1.0f, alpha));
+		dsys::Overlay(logo, c1 + Vector2(shrink, shrink * 0.35), c2 - Vector2(shrink, shrink * 0.35), Color(1.0f, 1.0f, 1.0f, alpha));
 	}
+	dsys::BeginSprites();
 	for(int i=0; i<path_count; i++) {
 		DrawParticles(i, time - start_logo_fadein);
 	}
+	dsys::EndSprites();
 
 }
 
 void PartPic::Distort(unsigned long time) {
+	PROF_SCOPE("PartPic::Distort");
 	float t = (float)time / 1000.0f;
 	Vertex *targ = plane->GetTriMeshPtr()->GetModVertexArray()->GetModData();
 	int count = plane->GetTriMeshPtr()->GetVertexArray()->GetCount();
@@ -168,7 +194,6 @@ static const float part_size = 0.04f;
 static void DrawParticles(int i, unsigned long time) {
 	float t = (float)time / 5000.0f;
 	
-	SetAlphaBlending(true);
 	for(int j=0; j<part_count; j++) {
 		float x = t - (float)j * path_offset[i][j];
 		if(x < 0.0f) x = 0.0f;
@@ -177,8 +202,6 @@ static void DrawParticles(int i, unsigned long time) {
 		Vector2 c1(vec.x-part_size, vec.y-part_size);
 		Vector2 c2(vec.x+part_size, vec.y+part_size);
 
-		SetBlendFunc(BLEND_ONE, BLEND_ONE);
-		dsys::Overlay(psys, c1, c2, 1.0f, false);
+		dsys::DrawSprite(psys, c1, c2, 1.0f, BLEND_ONE, BLEND_ONE);
 	}
-	SetAlphaBlending(false);
 }
@@ -31,11 +31,15 @@ protected:
 	TargetCamera cam;
 
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 	void Distort(unsigned long time);
 
 public:
 	PartPic();
 	~PartPic();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_PIC_HPP_
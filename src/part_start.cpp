@@ -25,35 +25,73 @@ static Object *land;
 static Vertex *vorig;
 static Texture *grid;
 
+void PartStart::RequestAssets() {
+	SetDataPath("data/", DPATH_GEOM);
+	SetDataPath("data/", DPATH_TEX);
+
+	RequestObject("thelab", "thelab.ase");
+	RequestObject("nuclear", "thelab.ase");
+	RequestObject("rawnoise", "thelab.ase");
+	RequestObject("amigo", "thelab.ase");
+}
+
 PartStart::PartStart() {
 	SetName("part_start");
+	ReadTarget(dsys::RT_FB);
 
 	light[0].SetPosition(Vector3(100, 100, -100));
 	light[1].SetPosition(Vector3(-100, 30, -80));
 	cam = TargetCamera(Vector3(0, 20, 0), Vector3(0, 0, 0));
 
+	// assign controller to the camera
+	MotionController xctrl(CTRL_SIN, TIME_FREE);
+	xctrl.SetControlAxis(CTRL_X);
+	MotionController zctrl(CTRL_COS, TIME_FREE);
+	zctrl.SetControlAxis(CTRL_Z);
+
+	xctrl.SetSinFunc(0.5f, 70.0f);
+	zctrl.SetSinFunc(0.5f, 70.0f);
+	cam.AddController(xctrl, CTRL_TRANSLATION);
+	cam.AddController(zctrl, CTRL_TRANSLATION);
+
+	thelab = nuclear = raw = amigo = 0;
+	land = 0;
+	vorig = 0;
+	grid = 0;
+}
+
+PartStart::~PartStart() {
+	Unload();
+}
+
+bool PartStart::LoadPart() {
 	SetDataPath("data/", DPATH_GEOM);
 	SetDataPath("data/", DPATH_TEX);
 
 	if(!(thelab = LoadObject("thelab", "thelab.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object \"thelab\" from \"thelab.ase\"\n";
-		return;
+		return false;
 	}
 
 	if(!(nuclear = LoadObject("nuclear", "thelab.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object \"nuclear\" from \"thelab.ase\"\n";
-		return;
+		return false;
 	}
 
 	if(!(raw = LoadObject("rawnoise", "thelab.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object \"rawnoise\" from \"thelab.ase\"\n";
-		return;
+		return false;
 	}
 
 	if(!(amigo = LoadObject("amigo", "thelab.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object \"amigo\" from \"thelab.ase\"\n";
-		return;
+		return false;
 	}
+
+	AddTextures(thelab);
+	AddTextures(nuclear);
+	AddTextures(raw);
+	AddTextures(amigo);
 	
 	thelab->SetDynamic(false);
 	nuclear->SetDynamic(false);
@@ -87,18 +125,13 @@ PartStart::PartStart() {
 	amigo->AddController(xctrl, CTRL_TRANSLATION);
 	amigo->AddController(zctrl, CTRL_TRANSLATION);
 
-	// assign controller to the camera
-	xctrl.SetSinFunc(0.5f, 70.0f);
-	zctrl.SetSinFunc(0.5f, 70.0f);
-	cam.AddController(xctrl, CTRL_TRANSLATION);
-	cam.AddController(zctrl, CTRL_TRANSLATION);
-
 
 	const int subdiv = 20;
 	
 	land = new Object();
 	CreatePlane(land->GetTriMeshPtr(), Plane(Vector3(0,0,0)), Vector2(80, 80), subdiv);
 	land->Rotate(Vector3(-half_pi, 0, 0));
+	land->SetStreaming(true);
 	//land->SetWireframe(true);
 	
 	const int size = 128;
@@ -116,17 +149,30 @@ PartStart::PartStart() {
 	land->SetBlending(true);
 	
 	int count = land->GetTriMeshPtr()->GetVertexArray()->GetCount();
-	vorig = new Vertex[count * sizeof(Vertex)];
+	vorig = new Vertex[count];
 	memcpy(vorig, land->GetTriMeshPtr()->GetVertexArray()->GetData(), count * sizeof(Vertex));
+
+	// lit by the two lights of DrawPart
+	AddPrograms(thelab, 3);
+	AddPrograms(nuclear, 3);
+	AddPrograms(raw, 3);
+	AddPrograms(amigo, 3);
+	AddPrograms(land, 3);
+	return true;
 }
 
-PartStart::~PartStart() {
+void PartStart::UnloadPart() {
 	delete thelab;
 	delete nuclear;
 	delete raw;
 	delete amigo;
 	delete land;
+	delete grid;
 	delete [] vorig;
+	thelab = nuclear = raw = amigo = 0;
+	land = 0;
+	vorig = 0;
+	grid = 0;
 }
 
 static const unsigned long start_fade = 2000;
@@ -155,7 +201,7 @@ void PartStart::DrawPart() {
 	}
 	if(	(time >= start_rblur && time < end_rblur) ||
 		(time >= start_rblur2 && time < end_rblur2)) {
-		SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
+		SetRenderTarget(GetScratchTarget());
 	}
 	
 	land->SetPosition(Vector3(0, -10.0f, 0));
@@ -180,21 +226,21 @@ void PartStart::DrawPart() {
 
 	
 	if(time >= start_rblur && time < end_rblur) {
-		SetRenderTarget(0);
+		BindTarget();
 		Clear(0);
 
 		float blur = (t - (float)start_rblur / 1000.0f) / ((float)(end_rblur - start_rblur) / 1000.0f);
-		//dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 2.0f * sin(blur * pi), Vector3(0.25f + blur / 2.0f, 0.5f), true);
-		dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 2.0f * sin(blur * pi));
-		//dsys::DirBlur(dsys::tex[dsys::RT_TEX0], sin(blur * pi), dsys::BLUR_DIR_X);
+		//dsys::RadialBlur(GetScratchTarget(), 2.0f * sin(blur * pi), Vector3(0.25f + blur / 2.0f, 0.5f), true);
+		dsys::RadialBlur(GetScratchTarget(), 2.0f * sin(blur * pi));
+		//dsys::DirBlur(GetScratchTarget(), sin(blur * pi), dsys::BLUR_DIR_X);
 	}
 
 	if(time >= start_rblur2 && time < end_rblur2) {
-		SetRenderTarget(0);
+		BindTarget();
 		Clear(0);
 
 		float blur = (t - (float)start_rblur2 / 1000.0f) / ((float)(end_rblur2 - start_rblur2) / 1000.0f);
-		dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 2.0f * blur);
+		dsys::RadialBlur(GetScratchTarget(), 2.0f * blur);
 		//dsys::Negative();
 	}
 
@@ -205,6 +251,7 @@ void PartStart::DrawPart() {
 }
 
 void PartStart::DeformLand() {
+	PROF_SCOPE("PartStart::DeformLand");
 	float t = (float)time / 500.0f;
 	int count = land->GetTriMeshPtr()->GetVertexArray()->GetCount();
 	Vertex *targ =  land->GetTriMeshPtr()->GetModVertexArray()->GetModData();
@@ -31,11 +31,15 @@ protected:
 	TargetCamera cam;
 
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 	void DeformLand();
 
 public:
 	PartStart();
 	~PartStart();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_START_HPP_
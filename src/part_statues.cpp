@@ -24,14 +24,31 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 static TargetCamera *cam;
 
+void PartStatues::RequestAssets() {
+	SceneLoader::SetDataPath("data/");
+	RequestScene("data/statues.3ds");
+}
+
 PartStatues::PartStatues() {
 	SetName("part_statues");
-	
+	ReadTarget(dsys::RT_FB);
+
+	scene = 0;
+	torus[0] = torus[1] = torusdef = 0;
+	sky[0] = sky[1] = 0;
+}
+
+PartStatues::~PartStatues() {
+	Unload();
+}
+
+bool PartStatues::LoadPart() {
 	SceneLoader::SetDataPath("data/");
 	if(!SceneLoader::LoadScene("data/statues.3ds", &scene)) {
 		std::cerr << "could not load scene \"statues.3ds\"\n";
-		return;
+		return false;
 	}
+	AddTextures(scene);
 
 	torus[0] = scene->GetObject("tknot1");
 	torus[1] = scene->GetObject("tknot2");
@@ -42,7 +59,7 @@ PartStatues::PartStatues() {
 	scene->RemoveObject(torus[1]);
 
 	torusdef = new Object(*torus[0]);
-	torusdef->SetDynamic(true);
+	torusdef->SetStreaming(true);
 
 	cam = (TargetCamera*)scene->GetActiveCamera();
 	Curve *path = scene->GetCurve("cpath01");
@@ -62,21 +79,34 @@ PartStatues::PartStatues() {
 	}
 
 	scene->SetAmbientLight(0.2f);
+
+	// the objects taken out of the scene are drawn right after it
+	AddPrograms(scene);
+	AddPrograms(torusdef, scene->GetLightMask(), true);
+	AddPrograms(sky[0], scene->GetLightMask());
+	AddPrograms(sky[1], scene->GetLightMask());
 	
 	//scene->AddCamera(&cam2);
 	//scene->SetActiveCamera(&cam2);
 
 	//SDL_WM_GrabInput(SDL_GRAB_ON);
 	//SDL_ShowCursor(0);
+	return true;
 }
 
-PartStatues::~PartStatues() {
+void PartStatues::UnloadPart() {
 	//SDL_WM_GrabInput(SDL_GRAB_OFF);
 	//SDL_ShowCursor(1);
 	delete scene;
 	delete torusdef;
 	delete torus[0];
 	delete torus[1];
+	delete sky[0];
+	delete sky[1];
+
+	scene = 0;
+	torus[0] = torus[1] = torusdef = 0;
+	sky[0] = sky[1] = 0;
 }
 
 static void HandleMouse(bool);
@@ -87,7 +117,7 @@ static const unsigned long rblur_end[2] = {11000, 28000};
 void PartStatues::DrawPart() {
 	bool rblur = false;
 	static bool neg = false;
-	float ammount;
+	float ammount = 0.0f;
 
 	// switch radial blur...
 	for(int i=0; i<2; i++) {
@@ -102,7 +132,7 @@ void PartStatues::DrawPart() {
 	}
 	
 	if(rblur) {
-		SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
+		SetRenderTarget(GetScratchTarget());
 	}
 	
 	scene->Render(time);
@@ -110,25 +140,27 @@ void PartStatues::DrawPart() {
 	sky[0]->Render();
 	sky[1]->Render();
 
-	MorphTorus(time + 500, 2000);
-	torusdef->SetPosition(Vector3(70, 30, 70));
-	torusdef->Render();
-
-	torusdef->SetPosition(Vector3(-70, 30, -70));
-	torusdef->Render();
+	// two pairs of knots, each pair morphing in step
+	Matrix4x4 torus_xform[4];
+	static const Vector3 torus_pos[] = {
+		Vector3(70, 30, 70), Vector3(-70, 30, -70),
+		Vector3(-70, 30, 70), Vector3(70, 30, -70)
+	};
+	for(int i=0; i<4; i++) {
+		torusdef->SetPosition(torus_pos[i]);
+		torus_xform[i] = torusdef->GetPRS().GetXFormMatrix();
+	}
 
+	MorphTorus(time + 500, 2000);
+	torusdef->RenderInstances(torus_xform, 2);
 
 	MorphTorus(time + 900, 2100);
-	torusdef->SetPosition(Vector3(-70, 30, 70));
-	torusdef->Render();
-
-	torusdef->SetPosition(Vector3(70, 30, -70));
-	torusdef->Render();
+	torusdef->RenderInstances(torus_xform + 2, 2);
 
 	if(rblur) {
-		SetRenderTarget(0);
+		BindTarget();
 		Clear(0);
-		dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], ammount);
+		dsys::RadialBlur(GetScratchTarget(), ammount);
 		//std::cerr << "ammount = " << ammount << std::endl;
 	}
 
@@ -136,7 +168,9 @@ void PartStatues::DrawPart() {
 }
 
 void PartStatues::MorphTorus(unsigned long time, unsigned long duration) {
+	PROF_SCOPE("PartStatues::MorphTorus");
 	const Vertex *varray[2];
+	const Vertex *base = torus[0]->GetTriMeshPtr()->GetVertexArray()->GetData();
 	Vertex *final;
 
 	if(time % (duration * 2) < duration) {
@@ -146,16 +180,20 @@ void PartStatues::MorphTorus(unsigned long time, unsigned long duration) {
 		varray[0] = torus[1]->GetTriMeshPtr()->GetVertexArray()->GetData();
 		varray[1] = torus[0]->GetTriMeshPtr()->GetVertexArray()->GetData();
 	}
-	final = torusdef->GetTriMeshPtr()->GetModVertexArray()->GetModData();
+	VertexArray *targ = torusdef->GetTriMeshPtr()->GetModVertexArray();
+	final = targ->MapStream();
 
 	int count = torus[0]->GetTriMeshPtr()->GetVertexArray()->GetCount();
 
 	float t = (float)(time % duration) / (float)duration;
 	for(int i=0; i<count; i++) {
 		Vector3 v0 = varray[0][i].pos, v1 = varray[1][i].pos;
-		final[i].pos = v0 + (v1 - v0) * t;
-		final[i].pos *= 0.6f;
+		// written once, final may be uncached GPU memory
+		Vertex v = base[i];
+		v.pos = (v0 + (v1 - v0) * t) * 0.6f;
+		final[i] = v;
 	}
+	targ->UnmapStream();
 }
 
 static void HandleMouse(bool draw_only) {
@@ -32,11 +32,15 @@ protected:
 	Object *sky[2];
 	
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 	void MorphTorus(unsigned long time, unsigned long duration);
 
 public:
 	PartStatues();
 	~PartStatues();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_STATUES_HPP_
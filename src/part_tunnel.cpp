@@ -25,14 +25,30 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 static TargetCamera *cam;
 static Texture *overlay;
 
+void PartTunnel::RequestAssets() {
+	SceneLoader::SetDataPath("data/");
+	RequestScene("data/tunnel.3ds");
+	RequestTexture("data/overlay2.png");
+}
+
 PartTunnel::PartTunnel() {
 	SetName("part_tunnel");
-	
+	ReadTarget(dsys::RT_FB);
+	scene = 0;
+}
+
+PartTunnel::~PartTunnel() {
+	Unload();
+}
+
+bool PartTunnel::LoadPart() {
 	SceneLoader::SetDataPath("data/");
 	if(!SceneLoader::LoadScene("data/tunnel.3ds", &scene)) {
 		std::cerr << "could not load scene \"tunnel.3ds\"\n";
-		return;
+		return false;
 	}
+	AddTextures(scene);
+	AddPrograms(scene);
 
 	scene->SetAmbientLight(Color(0.2f, 0.2f, 0.2f));
 
@@ -56,11 +72,13 @@ PartTunnel::PartTunnel() {
 	cam->target.AddController(xctrl, CTRL_TRANSLATION);
 	cam->target.AddController(zctrl, CTRL_TRANSLATION);
 
-	overlay = GetTexture("data/overlay2.png");
+	overlay = LoadTexture("data/overlay2.png");
+	return true;
 }
 
-PartTunnel::~PartTunnel() {
+void PartTunnel::UnloadPart() {
 	delete scene;
+	scene = 0;
 }
 
 void PartTunnel::DrawPart() {
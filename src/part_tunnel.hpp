@@ -30,10 +30,14 @@ protected:
 	Scene *scene;
 	
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 
 public:
 	PartTunnel();
 	~PartTunnel();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_TUNNEL_HPP_
@@ -37,39 +37,62 @@ static Texture *overlay;
 
 static void DoTheThing(unsigned long time);
 
+void PartTunnel2::RequestAssets() {
+	SceneLoader::SetDataPath("data/");
+	RequestScene("data/tunnel2.3ds");
+	RequestTexture("data/overlay1.png");
+}
+
 PartTunnel2::PartTunnel2() {
 	SetName("part_tunnel2");
-	
+	ReadTarget(dsys::RT_FB);
+
+	float zone_width = 8.0f / zone_count;
+	for(int i=0; i<zone_count; i++) {
+		zone[i].max_dist = (i+1) * zone_width;
+	}
+
+	scene = 0;
+}
+
+PartTunnel2::~PartTunnel2() {
+	Unload();
+}
+
+bool PartTunnel2::LoadPart() {
 	SceneLoader::SetDataPath("data/");
 	if(!SceneLoader::LoadScene("data/tunnel2.3ds", &scene)) {
 		std::cerr << "could not load scene \"tunnel2.3ds\"\n";
-		return;
+		return false;
 	}
+	AddTextures(scene);
 
 	//scene->SetAmbientLight(0.2f);
 	tunnel = scene->GetObject("Torus01");
 	thing = scene->GetObject("thing");	
 	cam = (TargetCamera*)scene->GetActiveCamera();
 
-	thing->SetDynamic(true);
+	thing->SetDynamic(false);
 
 	scene->RemoveObject(tunnel);
+	AddPrograms(scene);
+	AddPrograms(tunnel, scene->GetLightMask());
 
 	int count = thing->GetTriMeshPtr()->GetVertexArray()->GetCount();
 	vorig = new Vertex[count];
 	memcpy(vorig, thing->GetTriMeshPtr()->GetVertexArray()->GetData(), count * sizeof(Vertex));
-	
-	float zone_width = 8.0f / zone_count;
-	for(int i=0; i<zone_count; i++) {
-		zone[i].max_dist = (i+1) * zone_width;
-	}
 
-	overlay = GetTexture("data/overlay1.png");
+	overlay = LoadTexture("data/overlay1.png");
+	return true;
 }
 
-PartTunnel2::~PartTunnel2() {
+void PartTunnel2::UnloadPart() {
 	delete [] vorig;
+	delete tunnel;
 	delete scene;
+	vorig = 0;
+	tunnel = 0;
+	scene = 0;
 }
 
 static const unsigned long start_tunnel = 11000;//15000;
@@ -30,10 +30,14 @@ protected:
 	Scene *scene;
 	
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 
 public:
 	PartTunnel2();
 	~PartTunnel2();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_TUNNEL2_HPP_
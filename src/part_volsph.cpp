@@ -28,39 +28,69 @@ static float ypos[5];
 
 static void Credits(unsigned long time);
 
+void PartVolSph::RequestAssets() {
+	SetDataPath("data/", DPATH_GEOM);
+	RequestObject("SphereLow", "spheres.ase");
+	RequestObject("SphereMed", "spheres.ase");
+	RequestTexture("data/vol/lava02.png");
+	RequestTexture("data/lavacr_s.png");
+
+	for(int i=0; i<5; i++) {
+		char fname[] = "data/credits/credit#.png";
+		*strchr(fname, '#') = '0' + i;
+		RequestTexture(fname);
+	}
+}
+
 PartVolSph::PartVolSph() {
 	SetName("volsph");
+	ReadTarget(dsys::RT_FB);
 	
 	// setup the scene
 	light.SetPosition(Vector3(10, 10, -20));
 	cam.SetPosition(Vector3(0, 0, -6));
 
-	
+	ypos[0] = -0.25f;
+	ypos[1] = 0.30f;
+	ypos[2] = -0.13f;
+	ypos[3] = 0.24f;
+	ypos[4] = 0.0f;
+
+	sph = vol_sph = 0;
+}
+
+PartVolSph::~PartVolSph() {
+	Unload();
+}
+
+bool PartVolSph::LoadPart() {
 	SetDataPath("data/", DPATH_GEOM);
 	if(!(vol_sph = LoadObject("SphereLow", "spheres.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object SphereLow from spheres.ase\n";
-		return;
+		return false;
 	}
 
 	if(!(sph = LoadObject("SphereMed", "spheres.ase", LGEOM_FILE))) {
 		std::cerr << "failed to load object SphereMed from spheres.ase\n";
-		return;
+		return false;
 	}
+	AddTextures(vol_sph);
+	AddTextures(sph);
 
-	if(!(vol_tex = GetTexture("data/vol/lava02.png"))) {
+	if(!(vol_tex = LoadTexture("data/vol/lava02.png"))) {
 		std::cerr << "failed to load data/vol/lava02.png\n";
-		return;
+		return false;
 	}
 
-	if(!(tex = GetTexture("data/lavacr_s.png"))) {
+	if(!(tex = LoadTexture("data/lavacr_s.png"))) {
 		std::cerr << "failed to load data/lavacr_s.png\n";
-		return;
+		return false;
 	}
 
 	for(int i=0; i<5; i++) {
 		char fname[] = "data/credits/credit#.png";
 		*strchr(fname, '#') = '0' + i;
-		if(!(credits[i] = GetTexture(fname))) {
+		if(!(credits[i] = LoadTexture(fname))) {
 			std::cerr << "could not load: " << fname << std::endl;
 		}
 	}		
@@ -77,16 +107,15 @@ PartVolSph::PartVolSph() {
 	sph->SetDynamic(false);
 	vol_sph->SetDynamic(false);
 
-	ypos[0] = -0.25f;
-	ypos[1] = 0.30f;
-	ypos[2] = -0.13f;
-	ypos[3] = 0.24f;
-	ypos[4] = 0.0f;
+	AddPrograms(sph, 1);
+	AddPrograms(vol_sph, 1, true);
+	return true;
 }
 
-PartVolSph::~PartVolSph() {
+void PartVolSph::UnloadPart() {
 	delete vol_sph;
 	delete sph;
+	sph = vol_sph = 0;
 }
 
 static const unsigned int start_credits = 1000;
@@ -101,7 +130,7 @@ void PartVolSph::DrawPart() {
 	if(tindex >= vol_tex_count) tindex = vol_tex_count - 1;
 	//vol_sph->GetMaterialPtr()->SetTexture(vol_tex[tindex], TEXTYPE_DIFFUSE);
 
-	SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
+	SetRenderTarget(GetScratchTarget());
 	
 	float t = (float)time / 1000.0f;
 	sph->SetRotation(Vector3(t, t*2, 0));
@@ -114,39 +143,34 @@ void PartVolSph::DrawPart() {
 	static const float vol_scale_inc = 0.5f * vol_max_scale / (float)vol_sph_count;
 	static const float vol_alpha_dec = 1.0f / (float)vol_sph_count;
 	
-	SetFrontFace(ORDER_CCW);
+	// the layers of the volume, growing and fading out
+	Matrix4x4 vol_xform[vol_sph_count];
+	Color vol_color[vol_sph_count];
+	Matrix4x4 base_xform = vol_sph->GetPRS().GetXFormMatrix();
 	float s = 1.0f;
 	float alpha = 1.0f;
-	Material *mptr = vol_sph->GetMaterialPtr();
 	for(int i=0; i<vol_sph_count; i++) {
-		mptr->emissive_color = Color(alpha, alpha, alpha);
-
-		vol_sph->SetScaling(Vector3(s, s, s)); 
-		vol_sph->Render();
+		vol_xform[i] = base_xform;
+		vol_xform[i].Scale(Vector4(s, s, s, 1.0f));
+		vol_color[i] = Color(alpha, alpha, alpha);
 		s += vol_scale_inc;
 		alpha -= vol_alpha_dec;
 	}
+
+	SetFrontFace(ORDER_CCW);
+	vol_sph->RenderInstances(vol_xform, vol_sph_count, vol_color);
 	
 	SetFrontFace(ORDER_CW);
 	sph->Render();
 	
-	SetRenderTarget(dsys::tex[dsys::RT_TEX0]);
-	s = 1.0f;
-	alpha = 1.0f;
-	for(int i=0; i<vol_sph_count; i++) {
-		mptr->emissive_color = Color(alpha, alpha, alpha);
-
-		vol_sph->SetScaling(Vector3(s, s, s)); 
-		vol_sph->Render();
-		s += vol_scale_inc;
-		alpha -= vol_alpha_dec;
-	}
+	SetRenderTarget(GetScratchTarget());
+	vol_sph->RenderInstances(vol_xform, vol_sph_count, vol_color);
 	SetZBuffering(true);
 
-	SetRenderTarget(0);
+	BindTarget();
 
 	// also use a slight radial blur to cover up the imperfections
-	dsys::RadialBlur(dsys::tex[dsys::RT_TEX0], 0.2f);
+	dsys::RadialBlur(GetScratchTarget(), 0.2f);
 
 	if(time >= start_credits) {
 		Credits(time - start_credits);
@@ -165,8 +189,7 @@ static const float start_interval = 2.5;
 static void Credits(unsigned long time) {
 	float t = (float)time / 1000.0f;
 
-	SetAlphaBlending(true);
-	SetBlendFunc(BLEND_SRC_ALPHA, BLEND_ONE);
+	dsys::BeginSprites();
 	for(int i=0; i<5; i++) {
 		float xoffs = 1.3 - t / 1.2f + (float)i * start_interval;
 		float x = xoffs < 0.0f ? 0.0f : (xoffs > 1.0f ? 1.0f : xoffs);
@@ -175,7 +198,7 @@ static void Credits(unsigned long time) {
 		xoffs /= 10.0f;
 
 		Vector2 c0(0.3f, 0.4f), c1(0.8f, 0.6f);
-		dsys::Overlay(credits[i], c0 + Vector2(xoffs, ypos[i]), c1 + Vector2(xoffs, ypos[i]), Color(0.0f, 0.0f, 0.0f, alpha), false);
+		dsys::DrawSprite(credits[i], c0 + Vector2(xoffs, ypos[i]), c1 + Vector2(xoffs, ypos[i]), Color(0.0f, 0.0f, 0.0f, alpha), BLEND_SRC_ALPHA, BLEND_ONE);
 	}
-	SetAlphaBlending(false);
+	dsys::EndSprites();
 }
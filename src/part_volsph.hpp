@@ -32,10 +32,14 @@ protected:
 	PointLight light;
 
 	virtual void DrawPart();
+	virtual bool LoadPart();
+	virtual void UnloadPart();
 
 public:
 	PartVolSph();
 	~PartVolSph();
+
+	virtual void RequestAssets();
 };
 
 #endif	// _PART_VOLSPH_HPP_
@@ -21,6 +21,9 @@
 #include <vorbis/vorbisfile.h>
 #include <SDL.h>
 #include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
 #include "sdlvf.h"
 
 #define SDL_SAMPLES 2048
@@ -49,6 +52,37 @@ static char *audio_errors[] = {
 static OggVorbis_File audio_vf;
 static volatile int audio_stopped, audio_reopen;
 
+/*
+ * Playback position published by the audio callback without any lock,
+ * so the callback never waits on a reader (see sdlvf_position).
+ * pos_samples is the stream position audible at pos_ticks, i.e. the
+ * start of the buffer being filled minus the device buffer latency.
+ * pos_seq is odd while the pair is being written; there is only ever
+ * one writer, since the callback and sdlvf_seek hold the audio lock.
+ */
+static volatile long pos_seq;
+static volatile long pos_samples;
+static volatile Uint32 pos_ticks;
+static long audio_rate, audio_latency;
+
+#ifdef WIN32
+#define seq_increment(x)	InterlockedIncrement(x)
+#define memory_barrier()	MemoryBarrier()
+#else
+#define seq_increment(x)	__sync_fetch_and_add(x, 1)
+#define memory_barrier()	__sync_synchronize()
+#endif
+
+static void publish_position(long samples)
+{
+    seq_increment(&pos_seq);
+    memory_barrier();
+    pos_samples = samples;
+    pos_ticks = SDL_GetTicks();
+    memory_barrier();
+    seq_increment(&pos_seq);
+}
+
 /*
  * This function is called by SDL when more audio data is needed.
  */
@@ -71,6 +105,9 @@ static void audio_callback(void *userdata, Uint8 *stream, int len)
     }
     if (audio_stopped || audio_reopen) return;
 
+    /* what we write now becomes audible after the data already queued */
+    publish_position((long)ov_pcm_tell(&audio_vf) - buflen / (2 * ov_info(&audio_vf, -1)->channels) - audio_latency);
+
     /* check for leftovers in our buffer */
     if (buflen != 0) {
         int copy = MIN(buflen, len);
@@ -122,6 +159,12 @@ static int audio_open(void)
     as.userdata = NULL;
     if (SDL_OpenAudio(&as, NULL) == -1)
         return SDLVF_NOAUDIO;
+
+    /* SDL updates the desired spec with what it got */
+    audio_rate = as.freq;
+    audio_latency = as.samples;
+    publish_position((long)ov_pcm_tell(&audio_vf));
+
     SDL_PauseAudio(0);
 
     return SDLVF_PLAYING;
@@ -179,10 +222,48 @@ int sdlvf_seek(double time)
 	int result;
 	SDL_LockAudio();
 	result = ov_time_seek_lap(&audio_vf, time);
+	if (result == 0) {
+		audio_stopped = 0;	/* seeking back after the end resumes playback */
+		publish_position((long)ov_pcm_tell(&audio_vf));
+	}
 	SDL_UnlockAudio();
 	return result;
 }
 
+/*
+ * Returns the position of the sample currently heard, in seconds, or a
+ * negative value if nothing is playing. Safe to call from any thread
+ * without locking the audio device.
+ */
+double sdlvf_position(void)
+{
+    long samples, elapsed, seq;
+    Uint32 ticks, dt;
+
+    if (audio_stopped || !audio_rate)
+        return -1.0;
+
+    /* retry if the callback published a new position while reading */
+    do {
+        while ((seq = pos_seq) & 1)
+            ;
+        memory_barrier();
+        samples = pos_samples;
+        ticks = pos_ticks;
+        memory_barrier();
+    } while (pos_seq != seq);
+
+    /* interpolate between callbacks, but never past the data we queued */
+    if ((dt = SDL_GetTicks() - ticks) > 1000)
+        dt = 1000;
+    elapsed = (long)dt * audio_rate / 1000;
+    if (elapsed > 2 * audio_latency)
+        elapsed = 2 * audio_latency;
+
+    samples += elapsed;
+    return samples < 0 ? 0.0 : (double)samples / audio_rate;
+}
+
 /*
  * Shuts down SDL/vorbisfile, closing the audio device and freeing
  * data structures.
@@ -190,6 +271,7 @@ int sdlvf_seek(double time)
 void sdlvf_done(void)
 {
     audio_close();
+    audio_rate = 0;
     ov_clear(&audio_vf);
 }
 
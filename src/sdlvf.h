@@ -61,6 +61,14 @@ int sdlvf_check(void);
  */
 int sdlvf_seek(double);
 
+/*
+ * Returns the playback position in seconds as heard from the device,
+ * taking the output latency into account, or a negative value when not
+ * playing. It does not lock the audio device and can be called at any
+ * time, e.g. once per frame to drive the demo clock.
+ */
+double sdlvf_position(void);
+
 /*
  * Stops playback and shuts down the sound system.
  */
@@ -0,0 +1,141 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* render graph test: builds the graph from stand-in parts, with the
+ * engine calls and the Part members the graph uses stubbed out, and
+ * checks which passes are drawn and in what order.
+ */
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "part.hpp"
+#include "rgraph.hpp"
+
+using namespace dsys;
+
+// ---- stubs ----
+Texture *dsys::tex[4];
+unsigned int dsys::rtex_size_x = 256, dsys::rtex_size_y = 256;
+
+// never dereferenced, the graph only passes the pointers around
+static char target_pool[4];
+static int targets_acquired;
+
+Texture *AcquireRenderTarget(int x, int y, unsigned int format, bool depth) {
+	return (Texture*)&target_pool[targets_acquired++ % 4];
+}
+void ReleaseRenderTarget(Texture *tex) {}
+void SetRenderTarget(Texture *tex) {}
+
+static std::vector<const char*> drawn;
+
+Part::Part(const char *name) {
+	this->name = (char*)name;
+	target = RT_FB;
+	inputs = 0;
+	inputs_declared = false;
+}
+Part::~Part() {}
+void Part::PreDraw() {}
+void Part::PostDraw() {}
+bool Part::LoadPart() {return true;}
+void Part::UnloadPart() {}
+void Part::SetClear(bool enable) {}
+void Part::Start() {}
+void Part::Stop() {}
+void Part::RequestAssets() {}
+void Part::SetTarget(RenderTarget targ) {target = targ;}
+RenderTarget Part::GetTarget() const {return target;}
+void Part::ReadTarget(RenderTarget targ) {
+	if(targ != RT_FB) inputs |= 1 << targ;
+	inputs_declared = true;
+}
+unsigned int Part::GetInputs() const {return inputs;}
+bool Part::InputsDeclared() const {return inputs_declared;}
+void Part::UpdateGraphics() {drawn.push_back(name);}
+
+class TestPart : public Part {
+public:
+	TestPart(const char *name, RenderTarget targ) : Part(name) {SetTarget(targ);}
+	void DrawPart() {}
+	void Reads(RenderTarget targ) {ReadTarget(targ);}
+};
+
+// ---- tests ----
+static int failed;
+
+static void Check(const char *test, const char *expected) {
+	std::string res;
+	for(size_t i=0; i<drawn.size(); i++) {
+		if(i) res += " ";
+		res += drawn[i];
+	}
+
+	if(res != expected) {
+		printf("FAIL %s: drew \"%s\", expected \"%s\"\n", test, res.c_str(), expected);
+		failed++;
+	} else {
+		printf("ok   %s\n", test);
+	}
+}
+
+static void Draw(Part **parts, int count) {
+	drawn.clear();
+	BuildRenderGraph(parts, count);
+	DrawRenderGraph();
+}
+
+int main() {
+	// set_rtarget to t0 without any declared reads, the pass must stay
+	{
+		TestPart tunnel("tunnel", RT_TEX0), pic("pic", RT_FB);
+		Part *parts[] = {&tunnel, &pic};
+		Draw(parts, 2);
+		Check("undeclared t0 pass kept", "tunnel pic");
+		if(!tex[RT_TEX0]) {
+			printf("FAIL undeclared t0 pass kept: no target texture for t0\n");
+			failed++;
+		}
+	}
+
+	// all inputs declared and nothing reads t1, its pass goes
+	{
+		TestPart blur("blur", RT_TEX1), pic("pic", RT_FB);
+		blur.Reads(RT_FB);
+		pic.Reads(RT_FB);
+		Part *parts[] = {&blur, &pic};
+		Draw(parts, 2);
+		Check("unread t1 pass skipped", "pic");
+	}
+
+	// a declared reader is drawn after the writer of its input
+	{
+		TestPart post("post", RT_FB), scene("scene", RT_TEX0);
+		post.Reads(RT_TEX0);
+		scene.Reads(RT_FB);
+		Part *parts[] = {&post, &scene};
+		Draw(parts, 2);
+		Check("writer before reader", "scene post");
+	}
+
+	FreeRenderGraph();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,338 @@
+/*
+Copyright 2004 John Tsiombikas <nuclear@siggraph.org>
+
+This file is part of the 3dengfx, realtime visualization system.
+
+3dengfx is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+3dengfx is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with 3dengfx; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* tex_bake - offline texture preprocessor
+ * converts images to baked texture files (see texfile.h) next to the
+ * originals, which GetTexture() picks up in place of the source image.
+ *
+ * usage: tex_bake [-f auto|dxt1|dxt5|bgra] [-n] <image> [<image> ...]
+ *   -f: output format, auto (the default) picks DXT1 for opaque images
+ *       and DXT5 for images with an alpha channel.
+ *   -n: do not generate mipmaps.
+ */
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+extern "C" {
+#include "image.h"
+#include "texfile.h"
+}
+
+using namespace std;
+
+typedef unsigned int Pixel;		// 0xAARRGGBB, as returned by LoadImage()
+
+#define CHAN_B(p)	((p) & 0xff)
+#define CHAN_G(p)	(((p) >> 8) & 0xff)
+#define CHAN_R(p)	(((p) >> 16) & 0xff)
+#define CHAN_A(p)	(((p) >> 24) & 0xff)
+
+struct Image {
+	unsigned long width, height;
+	vector<Pixel> pixels;
+};
+
+// box filters the image down to half size in each dimension (but at least 1)
+static Image HalfSize(const Image &src) {
+	Image dst;
+	dst.width = src.width > 1 ? src.width / 2 : 1;
+	dst.height = src.height > 1 ? src.height / 2 : 1;
+	dst.pixels.resize(dst.width * dst.height);
+
+	for(unsigned long y=0; y<dst.height; y++) {
+		unsigned long y0 = y * 2;
+		unsigned long y1 = y0 + 1 < src.height ? y0 + 1 : y0;
+
+		for(unsigned long x=0; x<dst.width; x++) {
+			unsigned long x0 = x * 2;
+			unsigned long x1 = x0 + 1 < src.width ? x0 + 1 : x0;
+
+			Pixel p[4];
+			p[0] = src.pixels[y0 * src.width + x0];
+			p[1] = src.pixels[y0 * src.width + x1];
+			p[2] = src.pixels[y1 * src.width + x0];
+			p[3] = src.pixels[y1 * src.width + x1];
+
+			Pixel res = 0;
+			for(int c=0; c<32; c+=8) {
+				unsigned int sum = 2;	// round to nearest
+				for(int i=0; i<4; i++) {
+					sum += (p[i] >> c) & 0xff;
+				}
+				res |= (sum / 4) << c;
+			}
+			dst.pixels[y * dst.width + x] = res;
+		}
+	}
+	return dst;
+}
+
+// ---- S3TC block encoding ----
+
+static unsigned int Pack565(const int *rgb) {
+	return ((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255);
+}
+
+static void Unpack565(unsigned int c, int *rgb) {
+	int r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// fetches a 4x4 block as r,g,b,a bytes, replicating the edges of small images
+static void GetBlock(const Image &img, unsigned long bx, unsigned long by, int (*block)[4]) {
+	for(int y=0; y<4; y++) {
+		unsigned long py = by * 4 + y < img.height ? by * 4 + y : img.height - 1;
+		for(int x=0; x<4; x++) {
+			unsigned long px = bx * 4 + x < img.width ? bx * 4 + x : img.width - 1;
+			Pixel p = img.pixels[py * img.width + px];
+
+			int *dst = block[y * 4 + x];
+			dst[0] = CHAN_R(p);
+			dst[1] = CHAN_G(p);
+			dst[2] = CHAN_B(p);
+			dst[3] = CHAN_A(p);
+		}
+	}
+}
+
+/* the endpoints are the corners of the bounding box of the block colors,
+ * along the diagonal that best follows their spread, inset a bit so that
+ * the interpolated colors cover the block better.
+ */
+static void EncodeColorBlock(int (*block)[4], unsigned char *out) {
+	int mean[3] = {0, 0, 0};
+	int cmin[3] = {255, 255, 255}, cmax[3] = {0, 0, 0};
+
+	for(int i=0; i<16; i++) {
+		for(int c=0; c<3; c++) {
+			mean[c] += block[i][c];
+			if(block[i][c] < cmin[c]) cmin[c] = block[i][c];
+			if(block[i][c] > cmax[c]) cmax[c] = block[i][c];
+		}
+	}
+
+	int cov_rg = 0, cov_rb = 0;
+	for(int i=0; i<16; i++) {
+		int dr = block[i][0] * 16 - mean[0];
+		cov_rg += dr * (block[i][1] * 16 - mean[1]) / 16;
+		cov_rb += dr * (block[i][2] * 16 - mean[2]) / 16;
+	}
+	if(cov_rg < 0) {
+		int tmp = cmin[1]; cmin[1] = cmax[1]; cmax[1] = tmp;
+	}
+	if(cov_rb < 0) {
+		int tmp = cmin[2]; cmin[2] = cmax[2]; cmax[2] = tmp;
+	}
+
+	for(int c=0; c<3; c++) {
+		int inset = (cmax[c] - cmin[c]) / 16;
+		cmax[c] -= inset;
+		cmin[c] += inset;
+	}
+
+	unsigned int c0 = Pack565(cmax);
+	unsigned int c1 = Pack565(cmin);
+	if(c0 < c1) {
+		unsigned int tmp = c0; c0 = c1; c1 = tmp;
+	}
+
+	// c0 > c1 selects the 4 color mode, with c0 == c1 all indices stay 0
+	int pal[4][3];
+	Unpack565(c0, pal[0]);
+	Unpack565(c1, pal[1]);
+	for(int c=0; c<3; c++) {
+		pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+		pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+	}
+
+	unsigned long indices = 0;
+	if(c0 != c1) {
+		for(int i=0; i<16; i++) {
+			int best = 0, best_dist = 0x7fffffff;
+			for(int j=0; j<4; j++) {
+				int dr = block[i][0] - pal[j][0];
+				int dg = block[i][1] - pal[j][1];
+				int db = block[i][2] - pal[j][2];
+				int dist = dr * dr + dg * dg + db * db;
+				if(dist < best_dist) {
+					best_dist = dist;
+					best = j;
+				}
+			}
+			indices |= (unsigned long)best << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for(int i=0; i<4; i++) {
+		out[4 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+static void EncodeAlphaBlock(int (*block)[4], unsigned char *out) {
+	int amin = 255, amax = 0;
+	for(int i=0; i<16; i++) {
+		if(block[i][3] < amin) amin = block[i][3];
+		if(block[i][3] > amax) amax = block[i][3];
+	}
+
+	// a0 > a1 selects the 8 alpha mode, with a0 == a1 all indices stay 0
+	int pal[8];
+	pal[0] = amax;
+	pal[1] = amin;
+	for(int i=1; i<7; i++) {
+		pal[i + 1] = ((7 - i) * amax + i * amin) / 7;
+	}
+
+	// 3 bits per pixel, written out as two 24bit halves
+	unsigned long bits[2] = {0, 0};
+	if(amax != amin) {
+		for(int i=0; i<16; i++) {
+			int best = 0, best_dist = 256;
+			for(int j=0; j<8; j++) {
+				int dist = abs(block[i][3] - pal[j]);
+				if(dist < best_dist) {
+					best_dist = dist;
+					best = j;
+				}
+			}
+			bits[i / 8] |= (unsigned long)best << ((i % 8) * 3);
+		}
+	}
+
+	out[0] = amax;
+	out[1] = amin;
+	for(int i=0; i<3; i++) {
+		out[2 + i] = (bits[0] >> (i * 8)) & 0xff;
+		out[5 + i] = (bits[1] >> (i * 8)) & 0xff;
+	}
+}
+
+static vector<unsigned char> EncodeLevel(const Image &img, TexFileFormat fmt) {
+	vector<unsigned char> data(TexFileLevelSize(fmt, img.width, img.height));
+
+	if(fmt == TEXFMT_BGRA8) {
+		memcpy(&data[0], &img.pixels[0], data.size());
+		return data;
+	}
+
+	unsigned char *dptr = &data[0];
+	for(unsigned long by=0; by<(img.height + 3) / 4; by++) {
+		for(unsigned long bx=0; bx<(img.width + 3) / 4; bx++) {
+			int block[16][4];
+			GetBlock(img, bx, by, block);
+
+			if(fmt == TEXFMT_DXT5) {
+				EncodeAlphaBlock(block, dptr);
+				dptr += 8;
+			}
+			EncodeColorBlock(block, dptr);
+			dptr += 8;
+		}
+	}
+	return data;
+}
+
+static bool HasAlpha(const Image &img) {
+	for(size_t i=0; i<img.pixels.size(); i++) {
+		if(CHAN_A(img.pixels[i]) != 0xff) return true;
+	}
+	return false;
+}
+
+static bool Bake(const char *fname, const char *fmt_str, bool mipmaps) {
+	Image img;
+	Pixel *pixels = (Pixel*)LoadImage(fname, &img.width, &img.height);
+	if(!pixels) {
+		cerr << "failed to load " << fname << endl;
+		return false;
+	}
+	img.pixels.assign(pixels, pixels + img.width * img.height);
+	free(pixels);
+
+	TexFileFormat fmt;
+	if(!strcmp(fmt_str, "dxt1")) {
+		fmt = TEXFMT_DXT1;
+	} else if(!strcmp(fmt_str, "dxt5")) {
+		fmt = TEXFMT_DXT5;
+	} else if(!strcmp(fmt_str, "bgra")) {
+		fmt = TEXFMT_BGRA8;
+	} else {
+		fmt = HasAlpha(img) ? TEXFMT_DXT5 : TEXFMT_DXT1;
+	}
+
+	unsigned long xsz = img.width, ysz = img.height;
+
+	vector<vector<unsigned char> > levels;
+	levels.push_back(EncodeLevel(img, fmt));
+
+	while(mipmaps && (img.width > 1 || img.height > 1) && levels.size() < TEXFILE_MAX_LEVELS) {
+		img = HalfSize(img);
+		levels.push_back(EncodeLevel(img, fmt));
+	}
+
+	vector<const void*> level_data;
+	for(size_t i=0; i<levels.size(); i++) {
+		level_data.push_back(&levels[i][0]);
+	}
+
+	string out_name = fname;
+	string::size_type dot = out_name.rfind('.');
+	if(dot != string::npos && out_name.find('/', dot) == string::npos) {
+		out_name.erase(dot);
+	}
+	out_name += ".btx";
+
+	if(SaveTexFile(out_name.c_str(), fmt, xsz, ysz, (int)levels.size(), &level_data[0]) == -1) {
+		return false;
+	}
+
+	static const char *fmt_names[] = {"bgra", "dxt1", "dxt5"};
+	cout << fname << " -> " << out_name << " (" << fmt_names[fmt] << ", " << levels.size() << " levels)\n";
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const char *fmt = "auto";
+	bool mipmaps = true;
+	int failed = 0;
+
+	for(int i=1; i<argc; i++) {
+		if(!strcmp(argv[i], "-f") && i + 1 < argc) {
+			fmt = argv[++i];
+		} else if(!strcmp(argv[i], "-n")) {
+			mipmaps = false;
+		} else if(argv[i][0] == '-') {
+			cerr << "usage: " << argv[0] << " [-f auto|dxt1|dxt5|bgra] [-n] <image> [<image> ...]\n";
+			return EXIT_FAILURE;
+		} else {
+			if(!Bake(argv[i], fmt, mipmaps)) failed++;
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}